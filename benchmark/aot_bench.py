@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Compares a workload compiled with nemo --emit-c against the interpreter.
+
+Prints one JSON line with the C compile time and the median wall time of
+both over the iterations.
+
+usage: aot_bench.py NAME SCRIPT NEMO RUNTIME_INCLUDE RUNTIME_LIB -- CC...
+"""
+
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+ITERATIONS = 5
+
+
+def wall_ns(command):
+    start = time.perf_counter_ns()
+    subprocess.run(command, stdout=subprocess.DEVNULL, check=False)
+    return time.perf_counter_ns() - start
+
+
+def main():
+    separator = sys.argv.index("--")
+    name, script, nemo, include, runtime = sys.argv[1:separator]
+    compiler = sys.argv[separator + 1:]
+
+    with tempfile.TemporaryDirectory() as directory:
+        source = os.path.join(directory, name + ".c")
+        executable = os.path.join(directory, name)
+        subprocess.run([nemo, "--emit-c=" + source, script], check=True)
+        compile_ns = wall_ns(compiler + ["-O2", "-I", include, source,
+                                         runtime, "-o", executable])
+        if not os.path.exists(executable):
+            sys.exit(f"{name}: C compiler failed")
+
+        interpreted = [wall_ns([nemo, script]) for _ in range(ITERATIONS)]
+        compiled = [wall_ns([executable]) for _ in range(ITERATIONS)]
+
+    interpreted_ns = statistics.median(interpreted)
+    compiled_ns = statistics.median(compiled)
+    print(json.dumps({
+        "benchmark": name,
+        "iterations": ITERATIONS,
+        "compile_ns": compile_ns,
+        "interpreted_ns": interpreted_ns,
+        "compiled_ns": compiled_ns,
+        "speedup": round(interpreted_ns / compiled_ns, 2),
+    }, separators=(",", ":")))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,247 @@
+#include "grammar/grammar.h"
+#include "interpreter/interpreter.h"
+#include "mpc/mpc.h"
+#include "nemo/common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// Allocation counting. The harness interposes the C allocator so that both
+// the mpc parser (C) and the interpreter (C++ operator new) are accounted for.
+static std::atomic<bool> countAllocations{false};
+static std::atomic<unsigned long long> allocationCount{0};
+static std::atomic<unsigned long long> allocatedBytes{0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+  if (countAllocations.load(std::memory_order_relaxed)) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (countAllocations.load(std::memory_order_relaxed)) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(n * size, std::memory_order_relaxed);
+  }
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (countAllocations.load(std::memory_order_relaxed)) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+}
+static const bool allocationsSupported = true;
+#else
+static const bool allocationsSupported = false;
+#endif
+
+struct Options {
+  std::string name;
+  std::string path;
+  int iterations = 5;
+  bool parseOnly = false;
+  bool repl = false;
+  bool packrat = false;
+};
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--iterations N] [--parse-only | --repl] [--packrat]"
+            << " <name> <script.nemo>"
+            << std::endl;
+  exit(2);
+}
+
+static Options parseOptions(int argc, char **argv) {
+  Options options;
+  std::vector<std::string> positional;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      options.iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--parse-only") == 0) {
+      options.parseOnly = true;
+    } else if (strcmp(argv[i], "--repl") == 0) {
+      options.repl = true;
+    } else if (strcmp(argv[i], "--packrat") == 0) {
+      options.packrat = true;
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+    } else {
+      positional.push_back(argv[i]);
+    }
+  }
+
+  if (positional.size() != 2) {
+    usage(argv[0]);
+  }
+
+  options.name = positional[0];
+  options.path = positional[1];
+  return options;
+}
+
+// Runs one parse (and evaluation unless parse-only) of the script. Script
+// output is discarded so that only the JSON report reaches stdout.
+static bool runOnce(const Options &options, const std::string &source) {
+  mpc_result_t r;
+  if (!mpc_parse_mode(options.path.c_str(), source.c_str(), Nemo, &r,
+                      options.packrat ? MPC_PARSE_PACKRAT
+                                      : MPC_PARSE_DEFAULT)) {
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    return false;
+  }
+
+  bool success = true;
+  if (!options.parseOnly) {
+    std::shared_ptr<ScopeContext> globalContext = createGlobalContext();
+
+    std::ostringstream sink;
+    std::streambuf *previous = std::cout.rdbuf(sink.rdbuf());
+    success =
+        evaluate(static_cast<const mpc_ast_t *>(r.output), globalContext);
+    std::cout.rdbuf(previous);
+  }
+
+  mpc_ast_delete(static_cast<mpc_ast_t *>(r.output));
+  return success;
+}
+
+// Feeds the script to one session line by line the way the REPL does and
+// records the time from submitting a line to its result for each of them.
+static bool runRepl(const Options &options, const std::string &source,
+                    std::vector<long long> &lineNs) {
+  std::shared_ptr<ScopeContext> globalContext = createGlobalContext();
+  std::ostringstream sink;
+  std::streambuf *previous = std::cout.rdbuf(sink.rdbuf());
+
+  bool success = true;
+  std::istringstream lines(source);
+  std::string line;
+  while (success && std::getline(lines, line)) {
+    const auto start = std::chrono::steady_clock::now();
+
+    mpc_result_t r;
+    if (mpc_parse_mode("<stdin>", line.c_str(), Nemo, &r,
+                       options.packrat ? MPC_PARSE_PACKRAT
+                                       : MPC_PARSE_DEFAULT)) {
+      success =
+          evaluate(static_cast<const mpc_ast_t *>(r.output), globalContext);
+      mpc_ast_delete(static_cast<mpc_ast_t *>(r.output));
+    } else {
+      mpc_err_print(r.error);
+      mpc_err_delete(r.error);
+      success = false;
+    }
+
+    lineNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+  }
+
+  std::cout.rdbuf(previous);
+  return success;
+}
+
+int main(int argc, char **argv) {
+  const auto options = parseOptions(argc, argv);
+
+  std::ifstream file(options.path);
+  if (!file) {
+    std::cerr << "Could not open " << options.path << std::endl;
+    return 1;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  const auto source = buffer.str();
+
+  create_parsers();
+  define_grammar();
+
+  std::vector<long long> wallNs;
+  std::vector<long long> lineNs;
+  unsigned long long allocations = 0;
+  unsigned long long bytes = 0;
+
+  for (int i = 0; i < options.iterations; i++) {
+    allocationCount = 0;
+    allocatedBytes = 0;
+    countAllocations = true;
+    const auto start = std::chrono::steady_clock::now();
+    const auto success = options.repl ? runRepl(options, source, lineNs)
+                                      : runOnce(options, source);
+    const auto end = std::chrono::steady_clock::now();
+    countAllocations = false;
+
+    if (!success) {
+      cleanup_parsers();
+      return 1;
+    }
+
+    wallNs.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+    allocations += allocationCount;
+    bytes += allocatedBytes;
+  }
+
+  cleanup_parsers();
+
+  std::sort(wallNs.begin(), wallNs.end());
+  std::sort(lineNs.begin(), lineNs.end());
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  // One JSON object per line so results can be appended to a history file.
+  std::cout << "{\"benchmark\":\"" << options.name << "\""
+            << ",\"mode\":\""
+            << (options.parseOnly ? "parse" : options.repl ? "repl" : "run")
+            << "\""
+            << ",\"packrat\":" << (options.packrat ? "true" : "false")
+            << ",\"iterations\":" << options.iterations
+            << ",\"wall_ns\":{\"min\":" << wallNs.front()
+            << ",\"median\":" << wallNs[wallNs.size() / 2]
+            << ",\"max\":" << wallNs.back() << "}"
+            << ",\"peak_rss_kb\":" << usage.ru_maxrss;
+  if (!lineNs.empty()) {
+    std::cout << ",\"line_ns\":{\"p50\":" << lineNs[lineNs.size() / 2]
+              << ",\"p99\":" << lineNs[lineNs.size() * 99 / 100]
+              << ",\"max\":" << lineNs.back() << "}";
+  }
+  if (allocationsSupported) {
+    std::cout << ",\"allocations_per_run\":" << allocations / options.iterations
+              << ",\"allocated_bytes_per_run\":" << bytes / options.iterations;
+  } else {
+    std::cout << ",\"allocations_per_run\":null"
+              << ",\"allocated_bytes_per_run\":null";
+  }
+  std::cout << "}" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Generates the large benchmark workloads that are not worth checking in."""
+
+import sys
+
+
+def deep_pipeline(lines, stages):
+    for _ in range(lines):
+        chain = " |> ".join(["to_string |> len"] * stages)
+        yield f"[4096] |> range |> sum |> {chain} |> println"
+
+
+def string_concat(lines, _):
+    yield 'let s <= ""'
+    for i in range(lines):
+        yield f'let s <= s + "chunk{i % 10}"'
+    yield "s |> len |> println"
+
+
+def parse_large(lines, _):
+    for i in range(lines):
+        yield f"# statement {i}"
+        yield f"const value{i} <= [{i} {i + 1} 'x' \"s{i}\" [{i}]] |> len"
+        yield f"let fn{i} <= (a: number, b) -> {{ a + b |> to_string }}"
+        yield f"var sum{i} <= {i} + {i} * 2 - 1 |> to_string |> len"
+
+
+def record_columns(lines, rows):
+    yield "type Point = { x: number y: number tag: char }"
+    points = " ".join(f"[{i} {i % 7} 'p']" for i in range(rows))
+    yield f"let points <= [{points}] |> Point"
+    for _ in range(lines):
+        yield "points |> .x |> sum |> println"
+
+
+def lambda_arithmetic(lines, terms):
+    body = " + ".join(["x * 3 - x / 2"] * terms)
+    yield f"let poly <= (x: number) -> {{ let y <= {body}"
+    yield "  y * 2 + y - x }"
+    for i in range(lines):
+        yield f"{i} |> poly |> poly |> poly |> poly |> poly"
+
+
+def lambda_calls(lines, stages):
+    yield "let inc <= (x: number) -> { x + 1 }"
+    yield "let twice <= (x) -> { x |> inc |> inc }"
+    for i in range(lines):
+        yield f"{i} |> " + " |> ".join(["twice"] * stages)
+
+
+WORKLOADS = {
+    "deep_pipeline": (deep_pipeline, 200, 250),
+    "string_concat": (string_concat, 20000, 0),
+    "parse_large": (parse_large, 5000, 0),
+    "record_columns": (record_columns, 2000, 20000),
+    "lambda_arithmetic": (lambda_arithmetic, 2000, 100),
+    "lambda_calls": (lambda_calls, 2000, 50),
+}
+
+
+def main():
+    if len(sys.argv) != 3 or sys.argv[1] not in WORKLOADS:
+        sys.exit(f"usage: {sys.argv[0]} <{'|'.join(WORKLOADS)}> <output>")
+
+    generator, lines, width = WORKLOADS[sys.argv[1]]
+    with open(sys.argv[2], "w") as out:
+        for line in generator(lines, width):
+            out.write(line + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#include "nemo/heap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+// Replays the churn of a pipeline building small values: a window of live
+// blocks of the sizes Nemo values use (collections of one to three
+// elements, short strings), each replaced by a new block as it dies. Runs
+// the same sequence through nemo::memory::Heap and operator new.
+static const size_t sizes[] = {24, 48, 88, 176, 264, 352};
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0 << " [--iterations N] [--operations N]"
+            << std::endl;
+  exit(2);
+}
+
+template <typename Allocate, typename Deallocate>
+static long long churnNs(size_t operations, Allocate allocate,
+                         Deallocate deallocate) {
+  constexpr size_t window = 1024;
+  std::vector<void *> live(window, nullptr);
+  std::vector<size_t> liveSizes(window, 0);
+  unsigned state = 1;
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < operations; i++) {
+    state = state * 1103515245 + 12345;
+    const size_t slot = (state >> 8) % window;
+    if (live[slot] != nullptr) {
+      deallocate(live[slot], liveSizes[slot]);
+    }
+    const size_t size = sizes[(state >> 20) % std::size(sizes)];
+    live[slot] = allocate(size);
+    static_cast<char *>(live[slot])[0] = 1;
+    liveSizes[slot] = size;
+  }
+  for (size_t slot = 0; slot < window; slot++) {
+    if (live[slot] != nullptr) {
+      deallocate(live[slot], liveSizes[slot]);
+    }
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  int iterations = 5;
+  size_t operations = 10000000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--operations") == 0 && i + 1 < argc) {
+      operations = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  for (const bool heap : {true, false}) {
+    std::vector<long long> wallNs;
+    for (int i = 0; i < iterations; i++) {
+      if (heap) {
+        nemo::memory::Heap nemoHeap;
+        wallNs.push_back(churnNs(
+            operations, [&](size_t size) { return nemoHeap.allocate(size); },
+            [&](void *p, size_t size) {
+              nemo::memory::Heap::deallocate(p, size, &nemoHeap);
+            }));
+      } else {
+        wallNs.push_back(churnNs(
+            operations, [](size_t size) { return ::operator new(size); },
+            [](void *p, size_t) { ::operator delete(p); }));
+      }
+    }
+    std::sort(wallNs.begin(), wallNs.end());
+
+    std::cout << "{\"benchmark\":\"heap_churn\""
+              << ",\"allocator\":\"" << (heap ? "heap" : "new") << "\""
+              << ",\"operations\":" << operations
+              << ",\"iterations\":" << iterations
+              << ",\"wall_ns\":{\"min\":" << wallNs.front()
+              << ",\"median\":" << wallNs[wallNs.size() / 2]
+              << ",\"max\":" << wallNs.back() << "}}" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include "nemo/map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Counts a stream of keys drawn from a set of distinct keys, as count_by
+// does, then looks every key of the stream up again. Runs the same streams of
+// number and string keys through nemo::map::HashMap and std::unordered_map.
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--iterations N] [--operations N] [--keys N]" << std::endl;
+  exit(2);
+}
+
+struct Times {
+  long long buildNs;
+  long long lookupNs;
+  long long checksum;
+};
+
+static long long since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// The key HashMap takes for a key of the stream.
+static int keyOf(int key) { return key; }
+static std::string_view keyOf(const std::string &key) { return key; }
+
+template <typename Key>
+static Times nemoMap(const std::vector<Key> &stream) {
+  using Map = nemo::map::HashMap<int>;
+  Map map(std::is_same_v<Key, int> ? Map::Keys::Number : Map::Keys::String);
+
+  auto start = std::chrono::steady_clock::now();
+  for (const auto &key : stream) {
+    ++map.emplace(keyOf(key)).first;
+  }
+  const auto buildNs = since(start);
+
+  long long checksum = 0;
+  start = std::chrono::steady_clock::now();
+  for (const auto &key : stream) {
+    checksum += *map.find(keyOf(key));
+  }
+  return Times{buildNs, since(start), checksum};
+}
+
+template <typename Key>
+static Times unorderedMap(const std::vector<Key> &stream) {
+  std::unordered_map<Key, int> map;
+
+  auto start = std::chrono::steady_clock::now();
+  for (const auto &key : stream) {
+    ++map[key];
+  }
+  const auto buildNs = since(start);
+
+  long long checksum = 0;
+  start = std::chrono::steady_clock::now();
+  for (const auto &key : stream) {
+    checksum += map.find(key)->second;
+  }
+  return Times{buildNs, since(start), checksum};
+}
+
+template <typename Key>
+static void run(const char *keys, const std::vector<Key> &stream,
+                size_t distinct, int iterations) {
+  for (const auto *table : {"nemo", "unordered_map"}) {
+    std::vector<long long> buildNs, lookupNs;
+    long long checksum = 0;
+    for (int i = 0; i < iterations; i++) {
+      const auto times = strcmp(table, "nemo") == 0 ? nemoMap(stream)
+                                                    : unorderedMap(stream);
+      buildNs.push_back(times.buildNs);
+      lookupNs.push_back(times.lookupNs);
+      checksum = times.checksum;
+    }
+    std::sort(buildNs.begin(), buildNs.end());
+    std::sort(lookupNs.begin(), lookupNs.end());
+
+    std::cout << "{\"benchmark\":\"map_count\""
+              << ",\"keys\":\"" << keys << "\""
+              << ",\"table\":\"" << table << "\""
+              << ",\"operations\":" << stream.size()
+              << ",\"distinct\":" << distinct
+              << ",\"iterations\":" << iterations
+              << ",\"checksum\":" << checksum
+              << ",\"build_ns\":{\"min\":" << buildNs.front()
+              << ",\"median\":" << buildNs[buildNs.size() / 2] << "}"
+              << ",\"lookup_ns\":{\"min\":" << lookupNs.front()
+              << ",\"median\":" << lookupNs[lookupNs.size() / 2] << "}}"
+              << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  int iterations = 3;
+  size_t operations = 4000000;
+  size_t distinct = 1000000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--operations") == 0 && i + 1 < argc) {
+      operations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+      distinct = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  std::vector<int> numbers;
+  unsigned state = 1;
+  for (size_t i = 0; i < operations; i++) {
+    state = state * 1103515245 + 12345;
+    numbers.push_back(static_cast<int>((state >> 4) % distinct));
+  }
+  std::vector<std::string> strings;
+  for (const auto number : numbers) {
+    strings.push_back("key" + std::to_string(number));
+  }
+
+  run("number", numbers, distinct, iterations);
+  run("string", strings, distinct, iterations);
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "interpreter/operators.h"
+#include "nemo/common.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// An arithmetic loop of 100M operator applications on a running number, as
+// a pipeline of operators would evaluate it, dispatched three ways: by
+// comparing the symbol string as eval_operator used to, through the
+// operator table updating the number in place, and on unboxed ints as in
+// specialized lambda bodies.
+using Kind = nemo::ir::Operator::Kind;
+
+struct Step {
+  Kind kind;
+  std::string symbol;
+  int operand;
+};
+
+// The sequence keeps the running number small.
+static const Step steps[] = {{Kind::Add, "+", 7},
+                             {Kind::Multiply, "*", 3},
+                             {Kind::Modulo, "%", 1000003},
+                             {Kind::Subtract, "-", 5}};
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0 << " [--iterations N] [--operations N]"
+            << std::endl;
+  exit(2);
+}
+
+// Dispatch on the symbol, as eval_operator did before operators were
+// decoded when compiling.
+static NemoType byString(const NemoType &a, const NemoType &b,
+                         const std::string &op) {
+  if (a.type == BuiltinType::INT) {
+    const int x = std::get<int>(a.value.value());
+    const int y = std::get<int>(b.value.value());
+    if (op.compare("+") == 0) {
+      return numberType(x + y);
+    } else if (op.compare("-") == 0) {
+      return numberType(x - y);
+    } else if (op.compare("*") == 0) {
+      return numberType(x * y);
+    } else if (op.compare("/") == 0) {
+      return numberType(x / y);
+    } else if (op.compare("%") == 0) {
+      return numberType(x % y);
+    }
+  }
+  return voidType();
+}
+
+int main(int argc, char **argv) {
+  int iterations = 3;
+  size_t operations = 100000000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--operations") == 0 && i + 1 < argc) {
+      operations = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  // Built at run time so the compiler cannot fold the operators.
+  const std::vector<Step> program(std::begin(steps), std::end(steps));
+  std::vector<NemoType> operands;
+  for (const auto &step : program) {
+    operands.push_back(numberType(step.operand));
+  }
+  ScopeContext ctx;
+
+  for (const auto *dispatch : {"string", "table", "number"}) {
+    std::vector<long long> wallNs;
+    int result = 0;
+    for (int i = 0; i < iterations; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      if (strcmp(dispatch, "number") == 0) {
+        int value = 1;
+        for (size_t j = 0; j < operations; j++) {
+          const auto &step = program[j % program.size()];
+          value = nemo::operators::apply(step.kind, value, step.operand);
+        }
+        result = value;
+      } else {
+        const bool table = strcmp(dispatch, "table") == 0;
+        NemoType value = numberType(1);
+        for (size_t j = 0; j < operations; j++) {
+          const auto k = j % program.size();
+          if (table) {
+            nemo::operators::apply(program[k].kind, value, operands[k], ctx);
+          } else {
+            value = byString(value, operands[k], program[k].symbol);
+          }
+        }
+        result = std::get<int>(value.value.value());
+      }
+      wallNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count());
+    }
+    std::sort(wallNs.begin(), wallNs.end());
+
+    std::cout << "{\"benchmark\":\"operator_loop\""
+              << ",\"dispatch\":\"" << dispatch << "\""
+              << ",\"operations\":" << operations
+              << ",\"iterations\":" << iterations << ",\"result\":" << result
+              << ",\"wall_ns\":{\"min\":" << wallNs.front()
+              << ",\"median\":" << wallNs[wallNs.size() / 2]
+              << ",\"max\":" << wallNs.back() << "}}" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "mpc/mpc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Parses nested parentheses with a grammar that tries `term` twice at every
+// level, once for each alternative of `expr`. Without memoization the work
+// doubles with every level of nesting; in packrat mode it grows linearly.
+static const char *grammar = " expr : <term> '+' <expr> | <term> ;   "
+                             " term : '(' <expr> ')' | 'n' ;          ";
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0 << " [--iterations N] [--max-depth N]"
+            << std::endl;
+  exit(2);
+}
+
+static long long parseNs(mpc_parser_t *expr, const std::string &input,
+                         int mode) {
+  const auto start = std::chrono::steady_clock::now();
+  mpc_result_t r;
+  if (!mpc_parse_mode("<packrat>", input.c_str(), expr, &r, mode)) {
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    exit(1);
+  }
+  mpc_ast_delete(static_cast<mpc_ast_t *>(r.output));
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  int iterations = 5;
+  int maxDepth = 16;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+      maxDepth = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  mpc_parser_t *expr = mpc_new("expr");
+  mpc_parser_t *term = mpc_new("term");
+  mpc_err_t *error = mpca_lang(MPCA_LANG_DEFAULT, grammar, expr, term, NULL);
+  if (error != NULL) {
+    mpc_err_print(error);
+    mpc_err_delete(error);
+    return 1;
+  }
+
+  // One JSON line per depth and mode, median over the iterations.
+  for (int depth = 2; depth <= maxDepth; depth += 2) {
+    const auto input =
+        std::string(depth, '(') + "n" + std::string(depth, ')');
+
+    for (const int mode : {MPC_PARSE_DEFAULT, MPC_PARSE_PACKRAT}) {
+      std::vector<long long> wallNs;
+      for (int i = 0; i < iterations; i++) {
+        wallNs.push_back(parseNs(expr, input, mode));
+      }
+      std::sort(wallNs.begin(), wallNs.end());
+
+      std::cout << "{\"benchmark\":\"packrat_nesting\""
+                << ",\"mode\":\""
+                << (mode == MPC_PARSE_PACKRAT ? "packrat" : "default") << "\""
+                << ",\"depth\":" << depth << ",\"iterations\":" << iterations
+                << ",\"wall_ns\":{\"min\":" << wallNs.front()
+                << ",\"median\":" << wallNs[wallNs.size() / 2]
+                << ",\"max\":" << wallNs.back() << "}}" << std::endl;
+    }
+  }
+
+  mpc_cleanup(2, expr, term);
+  return 0;
+}
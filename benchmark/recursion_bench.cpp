@@ -0,0 +1,74 @@
+#include "interpreter/instance.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Recurses through a lambda whose last statement calls itself. With tail
+// calls the recursion runs in constant stack, so any depth completes; without
+// them ten million calls overflow the stack. The script cannot stop itself
+// yet, so the host's tick builtin exits once the wanted depth is reached.
+static const char *script = "let count <= (n: number) -> {\n"
+                            "  n |> tick\n"
+                            "  n + 1 |> count\n"
+                            "}\n"
+                            "0 |> count\n";
+
+static int depth = 10000000;
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0 << " [--iterations N] [--depth N]"
+            << std::endl;
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      depth = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  std::vector<long long> wallNs;
+  for (int i = 0; i < iterations; i++) {
+    std::ostringstream output;
+    nemo::Interpreter interpreter(output);
+    interpreter.registerNative<void(ScopeContext &, int)>(
+        "tick", [](ScopeContext &ctx, int n) {
+          if (n + 1 >= depth) {
+            ctx.exit(0);
+          }
+        });
+
+    const auto start = std::chrono::steady_clock::now();
+    interpreter.run("<recursion>", script);
+    wallNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count());
+
+    if (interpreter.exitCode() != 0 || !output.str().empty()) {
+      std::cerr << "recursion stopped early: " << output.str() << std::endl;
+      return 1;
+    }
+  }
+  std::sort(wallNs.begin(), wallNs.end());
+
+  std::cout << "{\"benchmark\":\"tail_recursion\""
+            << ",\"depth\":" << depth << ",\"iterations\":" << iterations
+            << ",\"wall_ns\":{\"min\":" << wallNs.front()
+            << ",\"median\":" << wallNs[wallNs.size() / 2]
+            << ",\"max\":" << wallNs.back() << "}"
+            << ",\"ns_per_call\":" << wallNs[wallNs.size() / 2] / depth << "}"
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "mpc/mpc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The token regexes of the Nemo grammar, with one sample token each. `str`
+// needs backtracking and is always built from combinators; it is listed so
+// that the cost of the fallback shows up next to the DFA tokens.
+struct Token {
+  const char *name;
+  const char *regex;
+  const char *sample;
+};
+
+static const Token tokens[] = {
+    {"ident", "[a-zA-Z_][a-zA-Z0-9_]*", "collection_size_2"},
+    {"number", "[0-9]+", "1234567"},
+    {"character", "'.'", "'x'"},
+    {"str", "\"(\\\\\\\\.|[^\"])*\"", "\"hello, world\""},
+    {"comment", ".*", "# a comment running to the end of the line"},
+};
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0 << " [--iterations N] [--tokens N]"
+            << std::endl;
+  exit(2);
+}
+
+static long long parseNs(mpc_parser_t *parser, const std::string &input) {
+  const auto start = std::chrono::steady_clock::now();
+  mpc_result_t r;
+  if (!mpc_parse("<tokens>", input.c_str(), parser, &r)) {
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    exit(1);
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  int iterations = 5;
+  int count = 100000;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--tokens") == 0 && i + 1 < argc) {
+      count = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  // One JSON line per token and regex mode, median over the iterations.
+  for (const auto &token : tokens) {
+    std::string input;
+    for (int i = 0; i < count; i++) {
+      input += token.sample;
+      input += '\n';
+    }
+
+    for (const int mode : {MPC_RE_DEFAULT, MPC_RE_NO_DFA}) {
+      mpc_parser_t *parser =
+          mpc_many(mpcf_all_free,
+                   mpc_and(2, mpcf_all_free, mpc_re_mode(token.regex, mode),
+                           mpc_char('\n'), free));
+
+      std::vector<long long> wallNs;
+      for (int i = 0; i < iterations; i++) {
+        wallNs.push_back(parseNs(parser, input));
+      }
+      std::sort(wallNs.begin(), wallNs.end());
+      mpc_delete(parser);
+
+      const auto median = wallNs[wallNs.size() / 2];
+      std::cout << "{\"benchmark\":\"regex_tokens\""
+                << ",\"token\":\"" << token.name << "\""
+                << ",\"mode\":\""
+                << (mode == MPC_RE_NO_DFA ? "no_dfa" : "default") << "\""
+                << ",\"tokens\":" << count << ",\"iterations\":" << iterations
+                << ",\"wall_ns\":{\"min\":" << wallNs.front()
+                << ",\"median\":" << median << ",\"max\":" << wallNs.back()
+                << "}"
+                << ",\"tokens_per_s\":"
+                << static_cast<long long>(count * 1e9 / median) << "}"
+                << std::endl;
+    }
+  }
+
+  return 0;
+}
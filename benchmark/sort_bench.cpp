@@ -0,0 +1,145 @@
+#include "nemo/sort.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Sorts the same random numbers and strings with the kernels of the sort
+// builtin and with std::sort, and picks the greatest of the numbers with
+// topK and std::partial_sort. Numbers and strings are also sorted with
+// --threads threads, the way nemo --threads sorts large inputs.
+
+static void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--iterations N] [--elements N] [--top N] [--threads N]"
+            << std::endl;
+  exit(2);
+}
+
+static long long since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Runs sort on a fresh copy of input iterations times and prints the times.
+template <typename T, typename Sort>
+static void run(const char *benchmark, const char *kernel,
+                const std::vector<T> &input, int iterations, Sort sort) {
+  std::vector<long long> times;
+  long long checksum = 0;
+  for (int i = 0; i < iterations; i++) {
+    auto items = input;
+    const auto start = std::chrono::steady_clock::now();
+    checksum = sort(items);
+    times.push_back(since(start));
+  }
+  std::sort(times.begin(), times.end());
+
+  std::cout << "{\"benchmark\":\"" << benchmark << "\""
+            << ",\"kernel\":\"" << kernel << "\""
+            << ",\"elements\":" << input.size()
+            << ",\"threads\":" << nemo::sort::threads
+            << ",\"iterations\":" << iterations
+            << ",\"checksum\":" << checksum
+            << ",\"ns\":{\"min\":" << times.front()
+            << ",\"median\":" << times[times.size() / 2] << "}}" << std::endl;
+}
+
+static long long sortNumbers(std::vector<int> &numbers) {
+  const auto n = numbers.size();
+  std::vector<uint32_t> keys(2 * n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = nemo::sort::numberKey(numbers[i]);
+  }
+  nemo::sort::parallelSort(keys.data(), keys.data() + n, n,
+                           nemo::sort::radixSort<uint32_t>, std::less<>());
+  return nemo::sort::numberOf(keys[n / 2]);
+}
+
+static long long sortStrings(std::vector<std::string_view> &strings) {
+  const auto n = strings.size();
+  std::vector<nemo::sort::StringKey> keys;
+  keys.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    keys.emplace_back(strings[i], i);
+  }
+  auto buffer = keys;
+  nemo::sort::parallelSort(
+      keys.data(), buffer.data(), n,
+      [](nemo::sort::StringKey *items, nemo::sort::StringKey *, size_t count) {
+        nemo::sort::pdqsort(items, items + count, std::less<>());
+      },
+      std::less<>());
+  return static_cast<long long>(keys[n / 2].index);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 3;
+  size_t elements = 4000000;
+  size_t top = 100;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--elements") == 0 && i + 1 < argc) {
+      elements = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+      top = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  std::vector<int> numbers;
+  unsigned state = 1;
+  for (size_t i = 0; i < elements; i++) {
+    state = state * 1103515245 + 12345;
+    numbers.push_back(static_cast<int>(state) >> 1);
+  }
+  std::vector<std::string> storage;
+  for (const auto number : numbers) {
+    storage.push_back("key" + std::to_string(number % 1000000));
+  }
+  const std::vector<std::string_view> strings(storage.begin(), storage.end());
+
+  run("sort_numbers", "std::sort", numbers, iterations, [](auto &items) {
+    std::sort(items.begin(), items.end());
+    return static_cast<long long>(items[items.size() / 2]);
+  });
+  run("sort_numbers", "radix", numbers, iterations, sortNumbers);
+  run("sort_strings", "std::sort", strings, iterations, [](auto &items) {
+    std::sort(items.begin(), items.end());
+    return static_cast<long long>(items[items.size() / 2].size());
+  });
+  run("sort_strings", "pdqsort", strings, iterations, sortStrings);
+  run("top_k", "std::partial_sort", numbers, iterations, [&](auto &items) {
+    const auto k = std::min(top, items.size());
+    std::partial_sort(items.begin(), items.begin() + k, items.end(),
+                      std::greater<>());
+    return static_cast<long long>(items[k - 1]);
+  });
+  run("top_k", "heap", numbers, iterations, [&](auto &items) {
+    const auto k = std::min(top, items.size());
+    nemo::sort::topK(items.data(), items.size(), k, std::less<>());
+    return static_cast<long long>(items[k - 1]);
+  });
+
+  nemo::sort::threads = threads;
+  if (threads > 1) {
+    run("sort_numbers", "radix", numbers, iterations, sortNumbers);
+    run("sort_strings", "pdqsort", strings, iterations, sortStrings);
+  }
+  return 0;
+}
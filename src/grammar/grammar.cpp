@@ -2,62 +2,85 @@
 #include "mpc/mpc.h"
 #include <stdio.h>
 
-mpc_parser_t *Identifier;
-mpc_parser_t *Integer;
-mpc_parser_t *Char;
-mpc_parser_t *String;
-mpc_parser_t *Collection;
-mpc_parser_t *Lambda;
-mpc_parser_t *Operator;
-mpc_parser_t *TypeDefinition;
-mpc_parser_t *Statement;
-mpc_parser_t *Expression;
-mpc_parser_t *Pipeline;
-mpc_parser_t *Assignment;
-mpc_parser_t *Comment;
+#ifndef NEMO_GRAMMAR_PATH
+#define NEMO_GRAMMAR_PATH "/home/x/projects/nemo-lang/src/grammar/grammar.mpc"
+#endif
+
 mpc_parser_t *Nemo;
 
-void create_parsers(void) {
-  Identifier = mpc_new("ident");
-  Integer = mpc_new("number");
-  Char = mpc_new("character");
-  String = mpc_new("str");
-  Collection = mpc_new("collection");
-  Lambda = mpc_new("lambda");
-  Operator = mpc_new("operator");
-  TypeDefinition = mpc_new("type_definition");
-  Statement = mpc_new("statement");
-  Expression = mpc_new("expression");
-  Pipeline = mpc_new("pipeline");
-  Assignment = mpc_new("assignment");
-  Comment = mpc_new("comment");
-  Nemo = mpc_new("nemo");
+static NemoGrammar *defaultGrammar;
+
+// Rule names in the order they are passed to mpca_lang_file.
+static const char *ruleNames[NEMO_GRAMMAR_RULES] = {
+    "ident",     "number",     "character", "str",
+    "collection", "lambda",    "operator",  "type_definition",
+    "statement", "expression", "pipeline",  "assignment",
+    "comment",   "field",      "block",     "conditional",
+    "arm",       "match",      "loop",      "nemo"};
+
+static NemoGrammar *grammar_create(void) {
+  NemoGrammar *grammar = new NemoGrammar;
+  for (int i = 0; i < NEMO_GRAMMAR_RULES; i++) {
+    grammar->rules[i] = mpc_new(ruleNames[i]);
+  }
+  grammar->nemo = grammar->rules[NEMO_GRAMMAR_RULES - 1];
+  return grammar;
 }
 
-void define_grammar(void) {
-  FILE *grammar =
-      fopen("/home/x/projects/nemo-lang/src/grammar/grammar.mpc", "r");
-  if (grammar == NULL) {
+// Defines the rules of grammar from the grammar file, printing any error.
+static bool grammar_define(NemoGrammar *grammar) {
+  FILE *file = fopen(NEMO_GRAMMAR_PATH, "r");
+  if (file == NULL) {
     fprintf(stderr, "Could not find grammar file\n");
-    exit(1);
+    return false;
   }
 
-  mpc_err_t *error =
-      mpca_lang_file(MPCA_LANG_DEFAULT, grammar, Identifier, Integer, Char,
-                     String, Collection, Lambda, Operator, TypeDefinition, Statement,
-                     Expression, Pipeline, Assignment, Comment, Nemo, NULL);
+  mpc_parser_t **r = grammar->rules;
+  mpc_err_t *error = mpca_lang_file(MPCA_LANG_DEFAULT, file, r[0], r[1], r[2],
+                                    r[3], r[4], r[5], r[6], r[7], r[8], r[9],
+                                    r[10], r[11], r[12], r[13], r[14], r[15],
+                                    r[16], r[17], r[18], r[19], NULL);
+  fclose(file);
 
   if (error != NULL) {
     mpc_err_print(error);
     mpc_err_delete(error);
-    exit(1);
+    return false;
   }
 
-  fclose(grammar);
+  return true;
+}
+
+NemoGrammar *grammar_new(void) {
+  NemoGrammar *grammar = grammar_create();
+  if (!grammar_define(grammar)) {
+    grammar_delete(grammar);
+    return NULL;
+  }
+  return grammar;
+}
+
+void grammar_delete(NemoGrammar *grammar) {
+  mpc_parser_t **r = grammar->rules;
+  mpc_cleanup(NEMO_GRAMMAR_RULES, r[0], r[1], r[2], r[3], r[4], r[5], r[6],
+              r[7], r[8], r[9], r[10], r[11], r[12], r[13], r[14], r[15],
+              r[16], r[17], r[18], r[19]);
+  delete grammar;
+}
+
+void create_parsers(void) {
+  defaultGrammar = grammar_create();
+  Nemo = defaultGrammar->nemo;
+}
+
+void define_grammar(void) {
+  if (!grammar_define(defaultGrammar)) {
+    exit(1);
+  }
 }
 
 void cleanup_parsers(void) {
-  mpc_cleanup(14, Identifier, Integer, Char, String, Collection, Lambda,
-              Statement, Operator, TypeDefinition, Expression, Pipeline, Comment, Assignment,
-              Nemo);
+  grammar_delete(defaultGrammar);
+  defaultGrammar = NULL;
+  Nemo = NULL;
 }
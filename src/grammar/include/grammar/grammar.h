@@ -1,6 +1,22 @@
 #pragma once
 #include "mpc/mpc.h"
 
+enum { NEMO_GRAMMAR_RULES = 20 };
+
+// An independent set of the Nemo grammar's parsers. `nemo` is the entry rule.
+struct NemoGrammar {
+  mpc_parser_t *rules[NEMO_GRAMMAR_RULES];
+  mpc_parser_t *nemo;
+};
+
+// Builds a new set of parsers from the grammar file. Prints the error and
+// returns NULL if the grammar cannot be read or defined.
+NemoGrammar *grammar_new(void);
+void grammar_delete(NemoGrammar *grammar);
+
+// The process-wide grammar used by the command line tools. It is only
+// modified by define_grammar() and cleanup_parsers(). In between, Nemo may be
+// used by any number of concurrent mpc_parse calls.
 extern mpc_parser_t *Nemo;
 
 void create_parsers(void);
@@ -1,66 +1,228 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
+#include <ir/ir.h>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <mpc/mpc.h>
+#include <nemo/map.hpp>
+#include <nemo/memory.hpp>
 #include <optional>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
-enum class BuiltinType { INT, CHAR, STRING, COLLECTION, LAMBDA, VOID };
+enum class BuiltinType {
+  INT,
+  CHAR,
+  STRING,
+  COLLECTION,
+  LAMBDA,
+  ARRAY,
+  RECORD,
+  TABLE,
+  MAP,
+  VOID
+};
+
+struct NemoType;
+
+// Strings and collections are allocated through the accounting allocator so
+// every byte held by a Nemo value is charged to its kind.
+using NemoString = std::basic_string<
+    char, std::char_traits<char>,
+    nemo::memory::Allocator<char, nemo::memory::Kind::String>>;
+using NemoCollection =
+    std::vector<NemoType, nemo::memory::Allocator<
+                              NemoType, nemo::memory::Kind::Collection>>;
+
+// Read-only view of a typed buffer. Values share the view; the elements are
+// never copied into NemoTypes. A buffer lent by an embedder (see
+// interpreter/capi.h) is not owned by `data` and must outlive every value
+// referring to it; a column of a record table is kept alive by the view.
+struct NemoArray {
+  enum class Element { Number, Char };
+
+  Element element;
+  std::shared_ptr<const void> data;
+  size_t size;
+
+  const int *numbers() const { return static_cast<const int *>(data.get()); }
+  const char *chars() const { return static_cast<const char *>(data.get()); }
+};
+
+// Layout of a record type, fixed when the type is defined. Fields are stored
+// in declaration order; offsets maps a session-wide field id (see
+// nemo::ir::Field) to the field's position, -1 for fields of other types.
+struct RecordType {
+  std::string name;
+  std::vector<nemo::ir::Parameter> fields;
+  // Record type of each field annotated with one, null for other fields.
+  std::vector<const RecordType *> fieldTypes;
+  std::vector<int> offsets;
+
+  int offset(int field) const {
+    return field < static_cast<int>(offsets.size()) ? offsets[field] : -1;
+  }
+};
+
+// A column of a record table. Number and char fields are packed so a scan
+// over one field reads contiguous memory; other fields are kept as values.
+using NemoNumbers =
+    std::vector<int,
+                nemo::memory::Allocator<int, nemo::memory::Kind::Collection>>;
+using NemoChars =
+    std::vector<char,
+                nemo::memory::Allocator<char, nemo::memory::Kind::Collection>>;
+using NemoColumn = std::variant<NemoNumbers, NemoChars, NemoCollection>;
+
+// A collection of records of one type, stored as one column per field.
+// Tables are immutable, so copies share their columns.
+struct NemoTable {
+  const RecordType *type;
+  size_t rows;
+  std::shared_ptr<const std::vector<NemoColumn>> columns;
+};
 
-using NemoValue = std::variant<int, char, std::string, const mpc_ast_t *>;
+using NemoHashMap = nemo::map::HashMap<NemoType>;
+
+// A map from numbers, chars or strings to values, see nemo/map.hpp. Maps are
+// immutable, so copies share their table.
+struct NemoMap {
+  std::shared_ptr<const NemoHashMap> table;
+};
+
+// A record keeps its type in `value` and its fields, in layout order, in
+// `collection`.
+using NemoValue =
+    std::variant<int, char, NemoString, const nemo::ir::Lambda *, NemoArray,
+                 const RecordType *, NemoTable, NemoMap>;
 
 struct NemoType {
   BuiltinType type;
   std::optional<NemoValue> value;
-  std::optional<std::vector<NemoType>> collection;
+  std::optional<NemoCollection> collection;
 
-  void print() const {
+  void print(std::ostream &out) const {
 
     switch (type) {
     case BuiltinType::VOID:
-      std::cout << "None";
+      out << "None";
       break;
     case BuiltinType::INT:
-      std::cout << std::get<int>(value.value_or(0));
+      out << std::get<int>(value.value_or(0));
       break;
     case BuiltinType::CHAR:
-      std::cout << std::get<char>(value.value_or(0));
+      out << std::get<char>(value.value_or(0));
       break;
     case BuiltinType::STRING:
-      std::cout << std::get<std::string>(value.value_or(""));
+      out << std::get<NemoString>(value.value_or(""));
       break;
     case BuiltinType::COLLECTION:
-      std::cout << "[ ";
-      for (const auto &item : collection.value_or(std::vector<NemoType>{})) {
-        item.print();
-        std::cout << " ";
+      out << "[ ";
+      for (const auto &item : collection.value_or(NemoCollection{})) {
+        item.print(out);
+        out << " ";
       }
-      std::cout << "]";
+      out << "]";
       break;
 
     case BuiltinType::LAMBDA:
-      mpc_ast_print(const_cast<mpc_ast_t*>(std::get<const mpc_ast_t *>(value.value_or(nullptr))));
+      out << std::get<const nemo::ir::Lambda *>(value.value())->to_string();
+      break;
+    case BuiltinType::ARRAY: {
+      const auto &array = std::get<NemoArray>(value.value());
+      out << "[ ";
+      for (size_t i = 0; i < array.size; i++) {
+        if (array.element == NemoArray::Element::Number) {
+          out << array.numbers()[i];
+        } else {
+          out << array.chars()[i];
+        }
+        out << " ";
+      }
+      out << "]";
+      break;
+    }
+    case BuiltinType::RECORD: {
+      const auto *record = std::get<const RecordType *>(value.value());
+      out << record->name << " {";
+      for (size_t i = 0; i < record->fields.size(); i++) {
+        out << " " << record->fields[i].name << ": ";
+        collection.value()[i].print(out);
+      }
+      out << " }";
+      break;
+    }
+    case BuiltinType::TABLE: {
+      const auto &table = std::get<NemoTable>(value.value());
+      const auto &fields = table.type->fields;
+      out << "[ ";
+      for (size_t row = 0; row < table.rows; row++) {
+        out << table.type->name << " {";
+        for (size_t i = 0; i < fields.size(); i++) {
+          out << " " << fields[i].name << ": ";
+          std::visit(
+              [&](const auto &column) {
+                using Column = std::decay_t<decltype(column)>;
+                if constexpr (std::is_same_v<Column, NemoCollection>) {
+                  column[row].print(out);
+                } else {
+                  out << column[row];
+                }
+              },
+              (*table.columns)[i]);
+        }
+        out << " } ";
+      }
+      out << "]";
+      break;
+    }
+    case BuiltinType::MAP: {
+      const auto &map = *std::get<NemoMap>(value.value()).table;
+      out << "{ ";
+      for (size_t i = 0; i < map.size(); i++) {
+        switch (map.keys()) {
+        case NemoHashMap::Keys::Number:
+          out << map.numberKey(i);
+          break;
+        case NemoHashMap::Keys::Char:
+          out << static_cast<char>(map.numberKey(i));
+          break;
+        case NemoHashMap::Keys::String:
+          out << map.stringKey(i);
+          break;
+        }
+        out << ": ";
+        map.value(i).print(out);
+        out << " ";
+      }
+      out << "}";
       break;
+    }
     default:
-      std::cout << "Not implemeneted";
+      out << "Not implemeneted";
     }
   }
 
   void debugPrint() const {}
 };
 
-NemoType voidType() {
+inline NemoType voidType() {
   NemoType type;
   type.type = BuiltinType::VOID;
 
   return type;
 }
 
-NemoType numberType(int value) {
+inline NemoType numberType(int value) {
   NemoType type;
   type.type = BuiltinType::INT;
   type.value = value;
@@ -68,15 +230,19 @@ NemoType numberType(int value) {
   return type;
 }
 
-NemoType stringType(std::string value) {
+inline NemoType stringType(NemoString &&value) {
   NemoType type;
   type.type = BuiltinType::STRING;
-  type.value = value;
+  type.value = std::move(value);
 
   return type;
 }
 
-NemoType charType(char value) {
+inline NemoType stringType(std::string_view value) {
+  return stringType(NemoString(value.begin(), value.end()));
+}
+
+inline NemoType charType(char value) {
   NemoType type;
   type.type = BuiltinType::CHAR;
   type.value = value;
@@ -84,7 +250,7 @@ NemoType charType(char value) {
   return type;
 }
 
-NemoType lambdaType(const mpc_ast_t *value) {
+inline NemoType lambdaType(const nemo::ir::Lambda *value) {
   NemoType type;
   type.type = BuiltinType::LAMBDA;
   type.value = value;
@@ -92,48 +258,160 @@ NemoType lambdaType(const mpc_ast_t *value) {
   return type;
 }
 
-NemoType collectionType(std::vector<NemoType> value) {
+inline NemoType arrayType(NemoArray value) {
+  NemoType type;
+  type.type = BuiltinType::ARRAY;
+  type.value = value;
+
+  return type;
+}
+
+inline NemoType recordType(const RecordType *layout, NemoCollection fields) {
+  NemoType type;
+  type.type = BuiltinType::RECORD;
+  type.value = layout;
+  type.collection = std::move(fields);
+
+  return type;
+}
+
+inline NemoType tableType(NemoTable value) {
+  NemoType type;
+  type.type = BuiltinType::TABLE;
+  type.value = std::move(value);
+
+  return type;
+}
+
+inline NemoType mapType(NemoMap value) {
+  NemoType type;
+  type.type = BuiltinType::MAP;
+  type.value = std::move(value);
+
+  return type;
+}
+
+inline NemoType collectionType(NemoCollection value) {
   NemoType type;
   type.type = BuiltinType::COLLECTION;
-  type.collection = value;
+  type.collection = std::move(value);
 
   return type;
 }
 
+// Local slots of the lambda calls in progress. Frames are carved from
+// blocks of slots in call order and released in reverse, so a call costs
+// moving a top index rather than allocating its locals. A block is kept
+// once allocated and frames never move, so a reference to a local stays
+// valid while its call runs. Lambdas see only their own locals and globals,
+// so no value refers into a frame and releasing it cannot leave one behind.
+class FrameStack {
+public:
+  static constexpr size_t blockSlots = 256;
+
+  struct Mark {
+    size_t block;
+    size_t top;
+  };
+
+  Mark mark() const { return Mark{block, top}; }
+
+  // A frame of count slots, each holding None.
+  std::span<NemoType> push(size_t count) {
+    if (block == blocks.size() || top + count > blocks[block].size()) {
+      nextBlock(count);
+    }
+    const std::span<NemoType> frame(blocks[block].data() + top, count);
+    top += count;
+    return frame;
+  }
+
+  // Releases the frames pushed since mark, dropping the values they hold.
+  void release(Mark mark) {
+    while (block > mark.block || top > mark.top) {
+      if (top == 0) {
+        top = used[--block];
+        continue;
+      }
+      blocks[block][--top] = voidType();
+    }
+  }
+
+private:
+  // Moves to the next block that fits count slots, allocating one if
+  // needed. used remembers where each block was left.
+  void nextBlock(size_t count) {
+    size_t next = block == blocks.size() ? block : block + 1;
+    if (next < blocks.size() && blocks[next].size() < count) {
+      blocks.resize(next);
+      used.resize(next);
+    }
+    if (next == blocks.size()) {
+      blocks.emplace_back(std::max(blockSlots, count), voidType());
+      used.push_back(0);
+    }
+    if (next != block) {
+      used[block] = top;
+    }
+    block = next;
+    top = 0;
+  }
+
+  std::vector<std::vector<NemoType>> blocks;
+  std::vector<size_t> used;
+  size_t block = 0;
+  size_t top = 0;
+};
+
+// Global environment of a session. Names are resolved once by the compiler
+// through the symbol table; at run time builtins and globals are plain
+// vector slots. Compiled programs are kept for the lifetime of the context
+// because lambda values point into them. Script output and the exit builtin
+// go through the context, so an embedder can redirect both per session.
 class ScopeContext {
 public:
+  using Function = std::function<NemoType(std::vector<NemoType>)>;
+  using ExitHandler = std::function<void(int)>;
+  // Unboxes the arguments for, and calls, a native builtin registered with
+  // nemo::native::registerNative (see nemo/native.hpp).
+  using Thunk = NemoType (*)(ScopeContext &ctx, int index, void (*native)(),
+                             std::span<NemoType> args);
+
   ScopeContext(std::shared_ptr<ScopeContext *> parent = nullptr)
       : parent(parent) {}
 
-  std::weak_ptr<ScopeContext *> createChildContext(std::string name) {
-    std::shared_ptr<ScopeContext *> child =
-        std::make_shared<ScopeContext *>(this);
-    children[name] = child;
-    return child;
+  void registerFunction(std::string name, Function func) {
+    builtin(name) = Builtin{nullptr, nullptr, std::move(func)};
   }
 
-  void registerFunction(std::string name,
-                        std::function<NemoType(std::vector<NemoType>)> func) {
-    if (functions.find(name) == functions.end()) {
-      functions.insert({name, func});
-    } else {
-      functions[name] = func;
-    }
+  void registerNative(std::string name, Thunk thunk, void (*native)()) {
+    builtin(name) = Builtin{thunk, native, nullptr};
   }
 
   void bind(std::string name, NemoType type) {
-    if (variables.find(name) == variables.end()) {
-      variables.insert({name, type});
-    } else {
-      variables[name] = type;
+    assign(symbols.declareGlobal(name), std::move(type));
+  }
+
+  // Stores a global. Rebinding a global that holds, or now holds, a lambda
+  // starts a new bindings epoch, invalidating the call site caches.
+  void assign(int index, NemoType value) {
+    auto &slot = global(index);
+    if (value.type == BuiltinType::LAMBDA ||
+        (slot.has_value() && slot->type == BuiltinType::LAMBDA)) {
+      epoch++;
     }
+    slot = std::move(value);
   }
 
-  int size() { return variables.size(); }
+  uint64_t bindingsEpoch() const { return epoch; }
+
+  int size() { return symbols.globalCount(); }
 
   NemoType get(std::string name) {
-    if (variables.find(name) != variables.end()) {
-      return variables[name];
+    const auto binding = symbols.lookupGlobal(name);
+    if (binding.kind == nemo::ir::Binding::Kind::Global &&
+        global(binding.index).has_value()) {
+      return global(binding.index).value();
     } else {
       if (parent != nullptr) {
         return (*parent)->get(name);
@@ -144,8 +422,9 @@ public:
   }
 
   NemoType callFunction(std::string name, std::vector<NemoType> args) {
-    if (functions.find(name) != functions.end()) {
-      return functions[name](args);
+    const auto binding = symbols.lookupBuiltin(name);
+    if (binding.kind == nemo::ir::Binding::Kind::Builtin) {
+      return callFunction(binding.index, std::span<NemoType>(args));
     } else {
       if (parent != nullptr) {
         return (*parent)->callFunction(name, args);
@@ -155,10 +434,130 @@ public:
     }
   }
 
+  // Native builtins are called straight through their thunk; boxed ones
+  // receive the arguments moved into a vector.
+  NemoType callFunction(int index, std::span<NemoType> args) {
+    // A builtin declared by a program that failed to compile, such as the
+    // constructor of its record type, was never registered.
+    if (index >= static_cast<int>(functions.size()) ||
+        (functions[index].thunk == nullptr && !functions[index].boxed))
+        [[unlikely]] {
+      throw std::invalid_argument("Function not found");
+    }
+    const auto &function = functions[index];
+    if (function.thunk != nullptr) {
+      return function.thunk(*this, index, function.native, args);
+    }
+    return function.boxed(std::vector<NemoType>(
+        std::make_move_iterator(args.begin()),
+        std::make_move_iterator(args.end())));
+  }
+
+  // Slot of a global, empty until the global is first assigned. Slots are
+  // created lazily since compiling may declare new globals.
+  std::optional<NemoType> &global(int index) {
+    if (index >= static_cast<int>(globals.size())) {
+      globals.resize(symbols.globalCount());
+    }
+    return globals[index];
+  }
+
+  nemo::ir::SymbolTable &symbolTable() { return symbols; }
+
+  std::ostream &output() { return *out; }
+  void setOutput(std::ostream &stream) { out = &stream; }
+
+  // Ends the script with the given status. Exits the process unless an
+  // exit handler was installed.
+  void exit(int code) { onExit(code); }
+  void setExitHandler(ExitHandler handler) { onExit = std::move(handler); }
+
+  const nemo::ir::Program &
+  adopt(std::unique_ptr<nemo::ir::Program> program) {
+    programs.push_back(std::move(program));
+    return *programs.back();
+  }
+
+  // Local slots of the lambda call being evaluated, a frame of frameStack.
+  // enterFrame returns the caller's frame, to be restored when the call
+  // returns.
+  NemoType &local(int index) { return frame[index]; }
+  std::span<NemoType> enterFrame(std::span<NemoType> callee) {
+    return std::exchange(frame, callee);
+  }
+  FrameStack &frameStack() { return frames; }
+
+  // Lambda calls in progress. A call nested deeper than maxCallDepth fails
+  // instead of overflowing the C++ stack; tail calls reuse their caller's
+  // frame and do not nest.
+  static constexpr int maxCallDepth = 1000;
+  int &callDepth() { return depth; }
+
+  // Bodies of a lambda specialized for the argument types they were
+  // compiled for, see nemo::ir::specialize. A null body means the generic
+  // one is used for those types.
+  struct Specialization {
+    std::vector<nemo::ir::BuiltinType> arguments;
+    std::unique_ptr<nemo::ir::Lambda> body;
+  };
+
+  std::vector<Specialization> &specializations(const nemo::ir::Lambda *lambda) {
+    return specialized[lambda];
+  }
+
+  // Closure-compiled lambda bodies live as long as the context since the
+  // lambdas they were compiled from point to them.
+  const nemo::closure::Body &
+  adopt(std::shared_ptr<const nemo::closure::Body> body) {
+    compiled.push_back(std::move(body));
+    return *compiled.back();
+  }
+
+  // Record types live as long as the context since records point to them. A
+  // redefinition gets a new layout; existing records keep the old one.
+  const RecordType &defineRecordType(RecordType type) {
+    recordTypes.push_back(std::make_unique<RecordType>(std::move(type)));
+    return *recordTypes.back();
+  }
+
+  // The latest definition of a record type, null if there is none.
+  const RecordType *findRecordType(const std::string &name) const {
+    for (auto it = recordTypes.rbegin(); it != recordTypes.rend(); ++it) {
+      if ((*it)->name == name) {
+        return it->get();
+      }
+    }
+    return nullptr;
+  }
+
 private:
+  struct Builtin {
+    Thunk thunk;
+    void (*native)();
+    Function boxed;
+  };
+
+  Builtin &builtin(const std::string &name) {
+    const auto index = symbols.declareBuiltin(name);
+    if (index >= static_cast<int>(functions.size())) {
+      functions.resize(index + 1);
+    }
+    return functions[index];
+  }
+
   std::shared_ptr<ScopeContext *> parent = nullptr;
-  std::map<std::string, std::shared_ptr<ScopeContext *>> children;
-  std::map<std::string, NemoType> variables;
-  std::map<std::string, std::function<NemoType(std::vector<NemoType>)>>
-      functions;
+  nemo::ir::SymbolTable symbols;
+  std::vector<Builtin> functions;
+  std::vector<std::optional<NemoType>> globals;
+  std::vector<std::unique_ptr<nemo::ir::Program>> programs;
+  std::vector<std::unique_ptr<RecordType>> recordTypes;
+  std::unordered_map<const nemo::ir::Lambda *, std::vector<Specialization>>
+      specialized;
+  std::vector<std::shared_ptr<const nemo::closure::Body>> compiled;
+  FrameStack frames;
+  std::span<NemoType> frame;
+  int depth = 0;
+  uint64_t epoch = 1;
+  std::ostream *out = &std::cout;
+  ExitHandler onExit = [](int code) { std::exit(code); };
 };
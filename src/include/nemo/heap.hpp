@@ -0,0 +1,338 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Heap for the blocks of Nemo values.
+//
+// Blocks of up to maxSmall bytes are carved from 64 KiB chunks by bumping a
+// pointer. When its value dies a block goes on the free list of its size
+// class, where the next allocation of that class takes it, so steady churn
+// costs a pointer bump or a list pop rather than a malloc/free pair. Larger
+// blocks go straight to operator new.
+//
+// Nemo values own their contents outright, without sharing or cycles, so a
+// block is garbage exactly when its value deallocates it and nothing has to
+// be traced. What the heap collects are chunks: at safe points between
+// statements, once enough has been freed, collect() sweeps the free lists
+// and returns every chunk without a live block to the system. These sweeps
+// are the only pauses; they are recorded in HeapStats.
+//
+// A heap belongs to one Accounting. Only the thread that has installed it
+// allocates from it, one thread at a time, and that thread frees blocks
+// straight onto the free lists. Any other thread may free blocks too: they
+// are queued under the Owner's lock and reclaim() moves them to the free
+// lists, with the bytes to release for each tag, on the installing thread.
+// Every chunk and large block points back to its heap's Owner, so a block is
+// always released against the Accounting that charged it. A chunk still
+// holding live blocks when its heap is destroyed is released by the last of
+// them.
+namespace nemo::memory {
+
+struct Accounting;
+
+struct HeapStats {
+  uint64_t chunks = 0;
+  uint64_t bumpedBytes = 0;
+  // Small allocations served from a free list.
+  uint64_t reused = 0;
+  // Allocations too large for a chunk.
+  uint64_t large = 0;
+  // Blocks freed by other threads.
+  uint64_t remote = 0;
+  uint64_t collections = 0;
+  uint64_t releasedChunks = 0;
+  uint64_t pauseNs = 0;
+  uint64_t maxPauseNs = 0;
+};
+
+class Heap {
+public:
+  static constexpr size_t chunkSize = 64 * 1024;
+  static constexpr size_t granule = 16;
+  static constexpr size_t maxSmall = 512;
+  // Bytes freed into the free lists before a safe point sweeps them.
+  static constexpr size_t collectThreshold = 4 * chunkSize;
+  // Distinct tags the bytes of remote frees are counted under.
+  static constexpr size_t tagCount = 4;
+
+  explicit Heap(Accounting *accounting = nullptr)
+      : owner(new Owner(this, accounting)) {}
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  ~Heap() {
+    {
+      std::lock_guard lock(owner->mutex);
+      for (auto *block = owner->remote; block != nullptr;
+           block = block->next) {
+        chunkOf(block)->live--;
+      }
+      owner->heap.store(nullptr, std::memory_order_release);
+      for (auto *chunk : chunks) {
+        if (chunk->live == 0) {
+          freeChunk(chunk);
+        }
+      }
+    }
+    unref(owner);
+  }
+
+  void *allocate(size_t bytes) {
+    if (bytes > maxSmall) {
+      stats.large++;
+      owner->references.fetch_add(1, std::memory_order_relaxed);
+      auto *header =
+          static_cast<Large *>(::operator new(sizeof(Large) + bytes));
+      header->owner = owner;
+      return header + 1;
+    }
+
+    const auto index = sizeClass(bytes);
+    if (auto *block = freeLists[index]) {
+      freeLists[index] = block->next;
+      chunkOf(block)->live++;
+      stats.reused++;
+      return block;
+    }
+
+    const auto size = classSize(index);
+    if (top == nullptr || top + size > end) {
+      refill();
+    }
+    void *block = top;
+    top += size;
+    chunkOf(block)->live++;
+    stats.bumpedBytes += size;
+    return block;
+  }
+
+  // Frees a block on behalf of the thread whose installed heap is `user`.
+  // Returns the Accounting to release the block against when it came from
+  // that heap. Otherwise returns nullptr and, unless its heap has been
+  // destroyed, queues the block with its bytes counted under `tag` for the
+  // owning thread's next reclaim().
+  static Accounting *deallocate(void *p, size_t bytes, const Heap *user,
+                                size_t tag = 0) noexcept {
+    if (bytes > maxSmall) {
+      auto *header = static_cast<Large *>(p) - 1;
+      auto *from = header->owner;
+      ::operator delete(header);
+      Accounting *charged = nullptr;
+      if (from->heap.load(std::memory_order_relaxed) == user) {
+        charged = from->accounting;
+      } else {
+        std::lock_guard lock(from->mutex);
+        if (from->heap.load(std::memory_order_relaxed) != nullptr) {
+          from->released[tag] += bytes;
+          from->pending.store(true, std::memory_order_release);
+        }
+      }
+      unref(from);
+      return charged;
+    }
+
+    auto *chunk = chunkOf(p);
+    auto *from = chunk->owner;
+    auto *heap = from->heap.load(std::memory_order_relaxed);
+    const auto index = sizeClass(bytes);
+    if (heap == user) {
+      chunk->live--;
+      heap->freeLists[index] = new (p) FreeBlock{heap->freeLists[index]};
+      heap->freedSinceCollect += classSize(index);
+      return from->accounting;
+    }
+
+    bool orphaned = false;
+    {
+      std::lock_guard lock(from->mutex);
+      if (from->heap.load(std::memory_order_relaxed) != nullptr) {
+        from->remote = new (p) RemoteBlock{from->remote, index};
+        from->released[tag] += bytes;
+        from->pending.store(true, std::memory_order_release);
+      } else {
+        orphaned = --chunk->live == 0;
+      }
+    }
+    if (orphaned) {
+      freeChunk(chunk);
+    }
+    return nullptr;
+  }
+
+  // Takes back the blocks other threads have freed and calls
+  // release(tag, bytes) for the bytes they counted under each tag.
+  template <typename Release> void reclaim(Release release) {
+    if (!owner->pending.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    RemoteBlock *blocks;
+    size_t released[tagCount];
+    {
+      std::lock_guard lock(owner->mutex);
+      blocks = owner->remote;
+      owner->remote = nullptr;
+      for (size_t tag = 0; tag < tagCount; tag++) {
+        released[tag] = owner->released[tag];
+        owner->released[tag] = 0;
+      }
+      owner->pending.store(false, std::memory_order_relaxed);
+    }
+
+    while (blocks != nullptr) {
+      auto *next = blocks->next;
+      const auto index = blocks->index;
+      chunkOf(blocks)->live--;
+      freeLists[index] = new (blocks) FreeBlock{freeLists[index]};
+      freedSinceCollect += classSize(index);
+      stats.remote++;
+      blocks = next;
+    }
+    for (size_t tag = 0; tag < tagCount; tag++) {
+      if (released[tag] != 0) {
+        release(tag, released[tag]);
+      }
+    }
+  }
+
+  // Safe point: no block is referenced from outside a live value. Sweeps
+  // the free lists once enough has been freed since the last sweep.
+  void collect() {
+    if (freedSinceCollect < collectThreshold) {
+      return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto *bumping = top != nullptr ? chunkOf(top - 1) : nullptr;
+    auto empty = [&](Chunk *chunk) {
+      return chunk->live == 0 && chunk != bumping;
+    };
+
+    freedSinceCollect = 0;
+    for (auto *&list : freeLists) {
+      auto **link = &list;
+      while (*link != nullptr) {
+        if (empty(chunkOf(*link))) {
+          *link = (*link)->next;
+        } else {
+          link = &(*link)->next;
+        }
+      }
+    }
+
+    size_t kept = 0;
+    for (auto *chunk : chunks) {
+      if (empty(chunk)) {
+        freeChunk(chunk);
+        stats.releasedChunks++;
+      } else {
+        chunks[kept++] = chunk;
+      }
+    }
+    chunks.resize(kept);
+    stats.chunks = kept;
+
+    const uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    stats.collections++;
+    stats.pauseNs += pause;
+    if (pause > stats.maxPauseNs) {
+      stats.maxPauseNs = pause;
+    }
+  }
+
+  HeapStats stats;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  // A block freed by another thread, waiting for reclaim().
+  struct RemoteBlock {
+    RemoteBlock *next;
+    size_t index;
+  };
+
+  // Shared by a heap and its blocks; freed with the last of them.
+  struct Owner {
+    Owner(Heap *heap, Accounting *accounting)
+        : heap(heap), accounting(accounting) {}
+
+    // nullptr once the heap is destroyed; changed under the mutex.
+    std::atomic<Heap *> heap;
+    Accounting *const accounting;
+    // The heap, its chunks and its large blocks.
+    std::atomic<size_t> references{1};
+    // Set while remote or released hold something for reclaim().
+    std::atomic<bool> pending{false};
+    std::mutex mutex;
+    RemoteBlock *remote = nullptr;
+    size_t released[tagCount] = {};
+  };
+
+  struct Chunk {
+    Owner *owner;
+    size_t live;
+  };
+
+  // Precedes every large block, keeping it aligned like a small one.
+  struct alignas(granule) Large {
+    Owner *owner;
+  };
+
+  static_assert(sizeof(Chunk) <= granule);
+  static_assert(sizeof(Large) == granule);
+  static_assert(sizeof(RemoteBlock) <= granule);
+
+  static constexpr size_t classCount = maxSmall / granule;
+
+  static size_t sizeClass(size_t bytes) {
+    return bytes == 0 ? 0 : (bytes - 1) / granule;
+  }
+  static size_t classSize(size_t index) { return (index + 1) * granule; }
+
+  // Chunks are aligned to their size, so a block's chunk is found by
+  // masking its address.
+  static Chunk *chunkOf(const void *p) {
+    return reinterpret_cast<Chunk *>(reinterpret_cast<uintptr_t>(p) &
+                                     ~(chunkSize - 1));
+  }
+
+  static void unref(Owner *owner) {
+    if (owner->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete owner;
+    }
+  }
+
+  static void freeChunk(Chunk *chunk) {
+    auto *from = chunk->owner;
+    ::operator delete(chunk, std::align_val_t(chunkSize));
+    unref(from);
+  }
+
+  void refill() {
+    auto *memory = static_cast<char *>(
+        ::operator new(chunkSize, std::align_val_t(chunkSize)));
+    owner->references.fetch_add(1, std::memory_order_relaxed);
+    chunks.push_back(new (memory) Chunk{owner, 0});
+    stats.chunks = chunks.size();
+    top = memory + granule;
+    end = memory + chunkSize;
+  }
+
+  Owner *owner;
+  FreeBlock *freeLists[classCount] = {};
+  std::vector<Chunk *> chunks;
+  char *top = nullptr;
+  char *end = nullptr;
+  size_t freedSinceCollect = 0;
+};
+
+} // namespace nemo::memory
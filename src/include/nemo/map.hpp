@@ -0,0 +1,191 @@
+#pragma once
+#include <nemo/memory.hpp>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Hash table of Nemo maps.
+//
+// The keys of a map are all numbers, all chars or all strings. Entries are
+// kept in insertion order in dense arrays, one for keys and one for values.
+// Number and char keys are stored as ints. String keys are interned into a
+// single byte pool, so each distinct key is stored once and needs no
+// allocation of its own.
+//
+// The table is an array of 64-bit slots, open addressed with linear
+// probing. A slot holds an entry index and 32 bits of the key's hash, so a
+// probe reads consecutive slots and only looks at a key when its hash bits
+// match. The table is at most 3/4 full and doubles when it fills. At that
+// load a successful lookup averages fewer than 3 probes, which usually share
+// one cache line. An entry costs 8 to 16 bytes of slots plus its key and
+// value. Maps are built once and then only read, so entries are never
+// removed and no tombstones are needed.
+namespace nemo::map {
+
+template <typename T>
+using Vector =
+    std::vector<T, nemo::memory::Allocator<T, nemo::memory::Kind::Map>>;
+
+// Hash of a number key. The low 32 bits, kept in the slot, are a bijection
+// of the key, so slots of different keys never match.
+inline uint64_t hash(int key) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(key)) *
+         0x9E3779B97F4A7C15ull;
+}
+
+inline uint64_t mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+// Hash of a string key, reading 8 bytes at a time.
+inline uint64_t hash(std::string_view key) {
+  uint64_t h = 0x9E3779B97F4A7C15ull ^ key.size();
+  size_t i = 0;
+  for (; i + 8 <= key.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, key.data() + i, 8);
+    h = (h ^ word) * 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+  }
+  uint64_t rest = 0;
+  if (i < key.size()) {
+    std::memcpy(&rest, key.data() + i, key.size() - i);
+  }
+  return mix(h ^ rest);
+}
+
+template <typename Value> class HashMap {
+public:
+  enum class Keys { Number, Char, String };
+
+  explicit HashMap(Keys keys) : keyKind(keys) { resize(minimumSlots); }
+
+  Keys keys() const { return keyKind; }
+  size_t size() const { return values.size(); }
+
+  // Sizes the table for count entries so building the map does not grow it.
+  void reserve(size_t count) {
+    size_t capacity = minimumSlots;
+    while (count * 4 > capacity * 3) {
+      capacity *= 2;
+    }
+    if (capacity > slots.size()) {
+      resize(capacity);
+    }
+  }
+
+  // The value of key, and whether the key was added. An added key gets a
+  // default-constructed value.
+  std::pair<Value &, bool> emplace(int key) {
+    const auto h = hash(key);
+    const auto i =
+        slotOf(h, [&](uint32_t entry) { return numbers[entry] == key; });
+    if (slots[i] != 0) {
+      return {values[entryOf(slots[i])], false};
+    }
+    numbers.push_back(key);
+    return {add(i, h), true};
+  }
+
+  std::pair<Value &, bool> emplace(std::string_view key) {
+    const auto h = hash(key);
+    const auto i =
+        slotOf(h, [&](uint32_t entry) { return stringKey(entry) == key; });
+    if (slots[i] != 0) {
+      return {values[entryOf(slots[i])], false};
+    }
+    bytes.insert(bytes.end(), key.begin(), key.end());
+    offsets.push_back(bytes.size());
+    return {add(i, h), true};
+  }
+
+  // The value of key, null if the map does not have it.
+  const Value *find(int key) const {
+    const auto i = slotOf(
+        hash(key), [&](uint32_t entry) { return numbers[entry] == key; });
+    return slots[i] != 0 ? &values[entryOf(slots[i])] : nullptr;
+  }
+
+  const Value *find(std::string_view key) const {
+    const auto i = slotOf(
+        hash(key), [&](uint32_t entry) { return stringKey(entry) == key; });
+    return slots[i] != 0 ? &values[entryOf(slots[i])] : nullptr;
+  }
+
+  // Keys and values of the entries, in insertion order.
+  int numberKey(size_t entry) const { return numbers[entry]; }
+  std::string_view stringKey(size_t entry) const {
+    return std::string_view(bytes.data() + offsets[entry],
+                            offsets[entry + 1] - offsets[entry]);
+  }
+  const Value &value(size_t entry) const { return values[entry]; }
+  Value &value(size_t entry) { return values[entry]; }
+
+private:
+  static constexpr size_t minimumSlots = 8;
+  static constexpr uint64_t entryMask = 0xFFFFFFFFull;
+
+  static uint32_t entryOf(uint64_t slot) {
+    return static_cast<uint32_t>(slot & entryMask) - 1;
+  }
+
+  // The slot of the entry whose key has hash h and is the same as the key
+  // looked up, or the empty slot where that key goes.
+  template <typename Same> size_t slotOf(uint64_t h, Same same) const {
+    const uint64_t tag = h << 32;
+    size_t i = h >> shift;
+    while (true) {
+      const uint64_t slot = slots[i];
+      if (slot == 0 || ((slot & ~entryMask) == tag && same(entryOf(slot)))) {
+        return i;
+      }
+      i = (i + 1) & (slots.size() - 1);
+    }
+  }
+
+  // Adds an entry whose key was just stored, in the empty slot i.
+  Value &add(size_t i, uint64_t h) {
+    slots[i] = (h << 32) | (values.size() + 1);
+    values.emplace_back();
+    if (values.size() * 4 > slots.size() * 3) {
+      resize(slots.size() * 2);
+    }
+    return values.back();
+  }
+
+  uint64_t hashOf(size_t entry) const {
+    return keyKind == Keys::String ? hash(stringKey(entry))
+                                   : hash(numbers[entry]);
+  }
+
+  // Rebuilds the table with capacity slots, a power of two.
+  void resize(size_t capacity) {
+    slots.assign(capacity, 0);
+    shift = 64 - std::countr_zero(capacity);
+    for (size_t entry = 0; entry < values.size(); entry++) {
+      const auto h = hashOf(entry);
+      size_t i = h >> shift;
+      while (slots[i] != 0) {
+        i = (i + 1) & (capacity - 1);
+      }
+      slots[i] = (h << 32) | (entry + 1);
+    }
+  }
+
+  Keys keyKind;
+  Vector<uint64_t> slots;
+  int shift = 0;
+  Vector<int> numbers;
+  Vector<char> bytes;
+  Vector<size_t> offsets{0};
+  Vector<Value> values;
+};
+
+} // namespace nemo::map
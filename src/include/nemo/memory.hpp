@@ -0,0 +1,155 @@
+#pragma once
+#include <nemo/heap.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// Accounting for the memory held by Nemo values.
+//
+// Strings, collections and maps allocate through nemo::memory::Allocator,
+// which charges every allocation to a value kind before taking it from the
+// heap of the charged Accounting (see nemo/heap.hpp). The totals are reported
+// by --stats and a configurable limit turns a runaway script into a Nemo
+// error instead of an OOM kill.
+//
+// Allocations are charged to the Accounting installed on the calling thread,
+// which is the process-wide `accounting` unless an embedded interpreter
+// installs its own with a Use guard. Deallocations are released against the
+// Accounting whose heap the block came from, whichever one is installed:
+// right away on a thread that has it installed, otherwise once that thread
+// reclaims the block when installing it, restoring it or at a safe point.
+namespace nemo::memory {
+
+enum class Kind { String, Collection, Map };
+
+constexpr int kindCount = 3;
+
+static_assert(kindCount <= Heap::tagCount);
+
+inline const char *kindName(Kind kind) {
+  switch (kind) {
+  case Kind::String:
+    return "string";
+  case Kind::Collection:
+    return "collection";
+  case Kind::Map:
+    return "map";
+  }
+  return "unknown";
+}
+
+struct Usage {
+  size_t live = 0;
+  size_t peak = 0;
+  size_t allocated = 0;
+};
+
+struct Accounting {
+  Usage kinds[kindCount];
+  Usage total;
+  // Maximum number of live bytes, 0 for no limit.
+  size_t limit = 0;
+  Heap heap{this};
+};
+
+inline Accounting accounting;
+
+inline thread_local Accounting *current = &accounting;
+
+inline void release(Accounting &target, Kind kind, size_t bytes) {
+  target.kinds[static_cast<int>(kind)].live -= bytes;
+  target.total.live -= bytes;
+}
+
+// Takes back the blocks of target that other threads have freed.
+inline void reclaim(Accounting &target) {
+  target.heap.reclaim([&](size_t tag, size_t bytes) {
+    release(target, static_cast<Kind>(tag), bytes);
+  });
+}
+
+// Safe point of the calling thread's Accounting, see Heap::collect().
+inline void collect() {
+  reclaim(*current);
+  current->heap.collect();
+}
+
+// Charges the allocations of the calling thread to `target` for the lifetime
+// of the guard.
+class Use {
+public:
+  explicit Use(Accounting &target) : previous(current) {
+    current = &target;
+    reclaim(target);
+  }
+  ~Use() {
+    current = previous;
+    reclaim(*previous);
+  }
+
+  Use(const Use &) = delete;
+  Use &operator=(const Use &) = delete;
+
+private:
+  Accounting *previous;
+};
+
+class LimitExceeded : public std::runtime_error {
+public:
+  explicit LimitExceeded(size_t limit)
+      : std::runtime_error("memory limit of " + std::to_string(limit) +
+                           " bytes exceeded") {}
+};
+
+inline void charge(Kind kind, size_t bytes) {
+  auto &target = *current;
+  auto &total = target.total;
+  if (target.limit != 0 && total.live + bytes > target.limit) [[unlikely]] {
+    throw LimitExceeded(target.limit);
+  }
+
+  auto &usage = target.kinds[static_cast<int>(kind)];
+  for (auto *entry : {&usage, &total}) {
+    entry->live += bytes;
+    entry->allocated += bytes;
+    if (entry->live > entry->peak) {
+      entry->peak = entry->live;
+    }
+  }
+}
+
+template <typename T, Kind K>
+struct Allocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = Allocator<U, K>;
+  };
+
+  Allocator() noexcept = default;
+
+  template <typename U>
+  Allocator(const Allocator<U, K> &) noexcept {}
+
+  T *allocate(size_t n) {
+    charge(K, n * sizeof(T));
+    return static_cast<T *>(current->heap.allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n) noexcept {
+    const auto bytes = n * sizeof(T);
+    if (auto *charged = Heap::deallocate(p, bytes, &current->heap,
+                                         static_cast<size_t>(K))) {
+      release(*charged, K, bytes);
+    }
+  }
+
+  friend bool operator==(const Allocator &, const Allocator &) {
+    return true;
+  }
+};
+
+} // namespace nemo::memory
@@ -0,0 +1,239 @@
+#pragma once
+#include <nemo/common.hpp>
+
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+std::string typeToString(BuiltinType type);
+
+// Builtins with typed signatures.
+//
+// registerNative<int(std::string_view, int)>(ctx, "name", fn) registers a
+// plain function pointer together with a thunk generated for its signature.
+// The thunk checks the argument count and types, unboxes the arguments
+// straight from the evaluator's span and boxes the result, so a call needs
+// neither a std::vector nor a std::function. A leading ScopeContext &
+// parameter receives the calling context.
+//
+// Parameters may be integers that hold every int (Nemo numbers), char,
+// std::string_view, const NemoString &, const NemoCollection &,
+// NemoCollection (moved out of the argument), const NemoType & (any value,
+// checked by the function) or NemoType (likewise, moved out of the
+// argument). Results may additionally be void, std::string, NemoType and
+// any integer; one outside the range of int raises an error.
+namespace nemo::native {
+
+template <typename T>
+concept Number =
+    std::integral<T> && !std::same_as<T, char> && !std::same_as<T, bool>;
+
+// How a parameter of type T is read from an argument. `type` is the kind the
+// argument must have, std::nullopt for any.
+template <typename T> struct Arg;
+
+template <typename T>
+  requires Number<T>
+struct Arg<T> {
+  static_assert(std::in_range<T>(std::numeric_limits<int>::min()) &&
+                    std::in_range<T>(std::numeric_limits<int>::max()),
+                "number parameters must hold every int");
+  static constexpr std::optional<BuiltinType> type = BuiltinType::INT;
+  static T get(NemoType &arg) {
+    return static_cast<T>(std::get<int>(*arg.value));
+  }
+};
+
+template <> struct Arg<char> {
+  static constexpr std::optional<BuiltinType> type = BuiltinType::CHAR;
+  static char get(NemoType &arg) { return std::get<char>(*arg.value); }
+};
+
+template <> struct Arg<std::string_view> {
+  static constexpr std::optional<BuiltinType> type = BuiltinType::STRING;
+  static std::string_view get(NemoType &arg) {
+    const auto &string = std::get<NemoString>(*arg.value);
+    return std::string_view(string.data(), string.size());
+  }
+};
+
+template <> struct Arg<const NemoString &> {
+  static constexpr std::optional<BuiltinType> type = BuiltinType::STRING;
+  static const NemoString &get(NemoType &arg) {
+    return std::get<NemoString>(*arg.value);
+  }
+};
+
+template <> struct Arg<const NemoCollection &> {
+  static constexpr std::optional<BuiltinType> type = BuiltinType::COLLECTION;
+  static const NemoCollection &get(NemoType &arg) { return *arg.collection; }
+};
+
+template <> struct Arg<NemoCollection> {
+  static constexpr std::optional<BuiltinType> type = BuiltinType::COLLECTION;
+  static NemoCollection get(NemoType &arg) {
+    return std::move(*arg.collection);
+  }
+};
+
+template <> struct Arg<const NemoType &> {
+  static constexpr std::optional<BuiltinType> type = std::nullopt;
+  static const NemoType &get(NemoType &arg) { return arg; }
+};
+
+template <> struct Arg<NemoType> {
+  static constexpr std::optional<BuiltinType> type = std::nullopt;
+  static NemoType get(NemoType &arg) { return std::move(arg); }
+};
+
+inline std::string withArticle(BuiltinType type) {
+  const auto name =
+      type == BuiltinType::INT ? std::string("integer") : typeToString(type);
+  return (std::string_view("aeiou").find(name[0]) != std::string_view::npos
+              ? "an "
+              : "a ") +
+         name;
+}
+
+[[noreturn]] inline void arityError(ScopeContext &ctx, int index,
+                                    size_t arity) {
+  const auto &name = ctx.symbolTable().builtinName(index);
+  throw std::runtime_error(
+      name + " function takes " +
+      (arity == 0   ? std::string("no arguments")
+       : arity == 1 ? std::string("exactly one argument")
+                    : "exactly " + std::to_string(arity) + " arguments"));
+}
+
+[[noreturn]] inline void typeError(ScopeContext &ctx, int index,
+                                   size_t arity, size_t position,
+                                   BuiltinType expected, BuiltinType actual) {
+  const auto &name = ctx.symbolTable().builtinName(index);
+  throw std::runtime_error(
+      name + " function takes " + withArticle(expected) +
+      (arity == 1 ? std::string(" argument")
+                  : " as argument " + std::to_string(position + 1)) +
+      ", but got " + typeToString(actual));
+}
+
+[[noreturn]] inline void rangeError(ScopeContext &ctx, int index,
+                                    const std::string &result) {
+  const auto &name = ctx.symbolTable().builtinName(index);
+  throw std::runtime_error(name + " function returned " + result +
+                           ", which is out of the range of " +
+                           withArticle(BuiltinType::INT));
+}
+
+template <typename R>
+NemoType box(ScopeContext &ctx, int index, R &&result) {
+  using T = std::decay_t<R>;
+  if constexpr (Number<T>) {
+    if (!std::in_range<int>(result)) [[unlikely]] {
+      rangeError(ctx, index, std::to_string(result));
+    }
+    return numberType(static_cast<int>(result));
+  } else if constexpr (std::same_as<T, char>) {
+    return charType(result);
+  } else if constexpr (std::same_as<T, NemoString>) {
+    return stringType(std::forward<R>(result));
+  } else if constexpr (std::same_as<T, std::string> ||
+                       std::same_as<T, std::string_view>) {
+    return stringType(std::string_view(result));
+  } else if constexpr (std::same_as<T, NemoCollection>) {
+    return collectionType(std::forward<R>(result));
+  } else {
+    static_assert(std::same_as<T, NemoType>, "unsupported native result");
+    return std::forward<R>(result);
+  }
+}
+
+template <typename... Args, size_t... I>
+void check(ScopeContext &ctx, int index, std::span<NemoType> args,
+           std::index_sequence<I...>) {
+  if (args.size() != sizeof...(Args)) [[unlikely]] {
+    arityError(ctx, index, sizeof...(Args));
+  }
+  (
+      [&] {
+        constexpr auto expected = Arg<Args>::type;
+        if constexpr (expected.has_value()) {
+          if (args[I].type != *expected) [[unlikely]] {
+            typeError(ctx, index, sizeof...(Args), I, *expected, args[I].type);
+          }
+        }
+      }(),
+      ...);
+}
+
+// Calls fn with the unboxed arguments, passing ctx first when fn wants it.
+template <bool WithContext, typename R, typename... Args, typename F,
+          size_t... I>
+NemoType invoke(F fn, ScopeContext &ctx, int index, std::span<NemoType> args,
+                std::index_sequence<I...>) {
+  auto call = [&]() -> decltype(auto) {
+    if constexpr (WithContext) {
+      return fn(ctx, Arg<Args>::get(args[I])...);
+    } else {
+      return fn(Arg<Args>::get(args[I])...);
+    }
+  };
+  if constexpr (std::is_void_v<R>) {
+    call();
+    return voidType();
+  } else {
+    return box(ctx, index, call());
+  }
+}
+
+template <bool WithContext, typename R, typename... Args>
+NemoType thunk(ScopeContext &ctx, int index, void (*native)(),
+               std::span<NemoType> args) {
+  using Indices = std::index_sequence_for<Args...>;
+  check<Args...>(ctx, index, args, Indices{});
+
+  if constexpr (WithContext) {
+    const auto fn = reinterpret_cast<R (*)(ScopeContext &, Args...)>(native);
+    return invoke<true, R, Args...>(fn, ctx, index, args, Indices{});
+  } else {
+    const auto fn = reinterpret_cast<R (*)(Args...)>(native);
+    return invoke<false, R, Args...>(fn, ctx, index, args, Indices{});
+  }
+}
+
+template <typename Signature> struct Traits;
+
+template <typename R, typename... Args> struct Traits<R(Args...)> {
+  using Pointer = R (*)(Args...);
+  static constexpr ScopeContext::Thunk thunk =
+      &native::thunk<false, R, Args...>;
+};
+
+template <typename R, typename... Args>
+struct Traits<R(ScopeContext &, Args...)> {
+  using Pointer = R (*)(ScopeContext &, Args...);
+  static constexpr ScopeContext::Thunk thunk =
+      &native::thunk<true, R, Args...>;
+};
+
+// The thunk and erased function pointer for a builtin of the given
+// signature. fn may be any function or captureless lambda convertible to it.
+template <typename Signature>
+std::pair<ScopeContext::Thunk, void (*)()>
+erase(typename Traits<Signature>::Pointer fn) {
+  return {Traits<Signature>::thunk, reinterpret_cast<void (*)()>(fn)};
+}
+
+template <typename Signature>
+void registerNative(ScopeContext &ctx, std::string name,
+                    typename Traits<Signature>::Pointer fn) {
+  const auto [thunk, native] = erase<Signature>(fn);
+  ctx.registerNative(std::move(name), thunk, native);
+}
+
+} // namespace nemo::native
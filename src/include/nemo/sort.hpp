@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Sorting kernels of the sort, sort_by, unique and top_k builtins.
+//
+// Numbers and chars are sorted by their bits. Chars are counted. Numbers, and
+// numbers packed with a row index, are radix sorted one byte at a time from
+// the lowest, skipping the bytes every key shares. Other keys are sorted by
+// pattern-defeating quicksort (pdqsort): quicksort with a median-of-3 or
+// ninther pivot, insertion sort for short ranges, heapsort once too many
+// partitions came out unbalanced and an early exit for ranges that turn out
+// to be sorted already. Strings are sorted as StringKeys holding their first
+// eight bytes, so most comparisons never read the strings.
+//
+// With more than one thread enabled, inputs of at least parallelThreshold
+// items are cut into one run per thread, the runs sorted by their kernel on
+// separate threads and then merged pairwise, each merge on its own thread.
+// Kernels only work in the buffers they are given, so worker threads never
+// allocate.
+namespace nemo::sort {
+
+// Threads a sort may use, set by nemo --threads.
+inline unsigned threads = 1;
+
+inline constexpr size_t parallelThreshold = 1 << 16;
+
+// Orders ints as unsigned keys by flipping their sign bit, and back.
+inline uint32_t numberKey(int value) {
+  return static_cast<uint32_t>(value) ^ 0x80000000u;
+}
+inline int numberOf(uint32_t key) {
+  return static_cast<int>(key ^ 0x80000000u);
+}
+
+// A number key in the high half and a row in the low half, so sorting the
+// keys sorts rows by number and keeps rows with equal numbers in order.
+inline uint64_t rowKey(int value, size_t row) {
+  return static_cast<uint64_t>(numberKey(value)) << 32 | row;
+}
+inline uint32_t rowOf(uint64_t key) { return static_cast<uint32_t>(key); }
+
+// Sorts n unsigned keys, using buffer as room for n more.
+template <typename Key> void radixSort(Key *keys, Key *buffer, size_t n) {
+  if (n < 2) {
+    return;
+  }
+
+  size_t counts[sizeof(Key)][256] = {};
+  for (size_t i = 0; i < n; i++) {
+    for (size_t digit = 0; digit < sizeof(Key); digit++) {
+      counts[digit][(keys[i] >> (8 * digit)) & 0xFF]++;
+    }
+  }
+
+  Key *from = keys;
+  Key *to = buffer;
+  for (size_t digit = 0; digit < sizeof(Key); digit++) {
+    auto &count = counts[digit];
+    const auto shift = 8 * digit;
+    if (count[(from[0] >> shift) & 0xFF] == n) {
+      continue;
+    }
+    size_t offset = 0;
+    for (auto &slot : count) {
+      const auto size = slot;
+      slot = offset;
+      offset += size;
+    }
+    for (size_t i = 0; i < n; i++) {
+      to[count[(from[i] >> shift) & 0xFF]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != keys) {
+    std::copy(from, from + n, keys);
+  }
+}
+
+// Sorts n chars by counting them. Chars are signed, as the < operator
+// compares them.
+inline void countingSort(char *chars, size_t n) {
+  size_t counts[256] = {};
+  for (size_t i = 0; i < n; i++) {
+    counts[static_cast<unsigned char>(chars[i]) ^ 0x80]++;
+  }
+  for (size_t byte = 0; byte < 256; byte++) {
+    chars = std::fill_n(chars, counts[byte], static_cast<char>(byte ^ 0x80));
+  }
+}
+
+// A string with its first eight bytes cached as a big-endian number, and its
+// position in the input. Keys order by bytes, as the < operator orders
+// strings, and equal strings by position.
+struct StringKey {
+  uint64_t prefix;
+  std::string_view text;
+  size_t index;
+
+  StringKey(std::string_view text, size_t index)
+      : prefix(0), text(text), index(index) {
+    for (size_t i = 0; i < 8; i++) {
+      prefix = prefix << 8 |
+               (i < text.size() ? static_cast<unsigned char>(text[i]) : 0);
+    }
+  }
+
+  friend bool operator<(const StringKey &a, const StringKey &b) {
+    if (a.prefix != b.prefix) {
+      return a.prefix < b.prefix;
+    }
+    const auto order = a.text.compare(b.text);
+    return order != 0 ? order < 0 : a.index < b.index;
+  }
+};
+
+namespace detail {
+
+inline constexpr ptrdiff_t insertionSortThreshold = 24;
+inline constexpr ptrdiff_t nintherThreshold = 128;
+inline constexpr ptrdiff_t partialInsertionSortLimit = 8;
+
+// Insertion sort. Unless guarded, first[-1] must not be greater than any item
+// of the range.
+template <bool guarded, typename T, typename Less>
+void insertionSort(T *first, T *last, Less less) {
+  if (first == last) {
+    return;
+  }
+  for (auto *current = first + 1; current != last; current++) {
+    auto *sift = current;
+    if (less(*sift, *(sift - 1))) {
+      T item = std::move(*sift);
+      do {
+        *sift = std::move(*(sift - 1));
+        sift--;
+      } while ((!guarded || sift != first) && less(item, *(sift - 1)));
+      *sift = std::move(item);
+    }
+  }
+}
+
+// Insertion sort that gives up after moving a few items, for ranges that are
+// probably sorted already. Returns whether the range was sorted.
+template <typename T, typename Less>
+bool partialInsertionSort(T *first, T *last, Less less) {
+  if (first == last) {
+    return true;
+  }
+  ptrdiff_t moves = 0;
+  for (auto *current = first + 1; current != last; current++) {
+    auto *sift = current;
+    if (less(*sift, *(sift - 1))) {
+      T item = std::move(*sift);
+      do {
+        *sift = std::move(*(sift - 1));
+        sift--;
+      } while (sift != first && less(item, *(sift - 1)));
+      *sift = std::move(item);
+      moves += current - sift;
+      if (moves > partialInsertionSortLimit) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <typename T, typename Less> void sort2(T *a, T *b, Less less) {
+  if (less(*b, *a)) {
+    std::iter_swap(a, b);
+  }
+}
+
+template <typename T, typename Less> void sort3(T *a, T *b, T *c, Less less) {
+  sort2(a, b, less);
+  sort2(b, c, less);
+  sort2(a, b, less);
+}
+
+// Partitions around the pivot *first, putting items equal to it on the
+// right. Returns where the pivot ended up and whether no items had to move.
+template <typename T, typename Less>
+std::pair<T *, bool> partitionRight(T *first, T *last, Less less) {
+  T pivot = std::move(*first);
+  auto *left = first;
+  auto *right = last;
+
+  while (less(*++left, pivot)) {
+  }
+  if (left - 1 == first) {
+    while (left < right && !less(*--right, pivot)) {
+    }
+  } else {
+    while (!less(*--right, pivot)) {
+    }
+  }
+
+  const bool partitioned = left >= right;
+  while (left < right) {
+    std::iter_swap(left, right);
+    while (less(*++left, pivot)) {
+    }
+    while (!less(*--right, pivot)) {
+    }
+  }
+
+  auto *pivotAt = left - 1;
+  *first = std::move(*pivotAt);
+  *pivotAt = std::move(pivot);
+  return {pivotAt, partitioned};
+}
+
+// Partitions around the pivot *first, putting items equal to it on the left.
+// Used when the pivot equals the item before the range, so the items equal
+// to it are already in place and need no further sorting.
+template <typename T, typename Less>
+T *partitionLeft(T *first, T *last, Less less) {
+  T pivot = std::move(*first);
+  auto *left = first;
+  auto *right = last;
+
+  while (less(pivot, *--right)) {
+  }
+  if (right + 1 == last) {
+    while (left < right && !less(pivot, *++left)) {
+    }
+  } else {
+    while (!less(pivot, *++left)) {
+    }
+  }
+
+  while (left < right) {
+    std::iter_swap(left, right);
+    while (less(pivot, *--right)) {
+    }
+    while (!less(pivot, *++left)) {
+    }
+  }
+
+  *first = std::move(*right);
+  *right = std::move(pivot);
+  return right;
+}
+
+template <typename T, typename Less>
+void pdqsort(T *first, T *last, Less less, int badPartitions, bool leftmost) {
+  while (true) {
+    const auto size = last - first;
+    if (size < insertionSortThreshold) {
+      if (leftmost) {
+        insertionSort<true>(first, last, less);
+      } else {
+        insertionSort<false>(first, last, less);
+      }
+      return;
+    }
+
+    // Moves the median of three, or of three medians of three, to first.
+    const auto half = size / 2;
+    if (size > nintherThreshold) {
+      sort3(first, first + half, last - 1, less);
+      sort3(first + 1, first + (half - 1), last - 2, less);
+      sort3(first + 2, first + (half + 1), last - 3, less);
+      sort3(first + (half - 1), first + half, first + (half + 1), less);
+      std::iter_swap(first, first + half);
+    } else {
+      sort3(first + half, first, last - 1, less);
+    }
+
+    if (!leftmost && !less(*(first - 1), *first)) {
+      first = partitionLeft(first, last, less) + 1;
+      continue;
+    }
+
+    const auto [pivot, partitioned] = partitionRight(first, last, less);
+    const auto leftSize = pivot - first;
+    const auto rightSize = last - (pivot + 1);
+
+    if (leftSize < size / 8 || rightSize < size / 8) {
+      if (--badPartitions == 0) {
+        std::make_heap(first, last, less);
+        std::sort_heap(first, last, less);
+        return;
+      }
+
+      // Shuffles a few items so a pattern does not pick a bad pivot again.
+      if (leftSize >= insertionSortThreshold) {
+        std::iter_swap(first, first + leftSize / 4);
+        std::iter_swap(pivot - 1, pivot - leftSize / 4);
+        if (leftSize > nintherThreshold) {
+          std::iter_swap(first + 1, first + (leftSize / 4 + 1));
+          std::iter_swap(first + 2, first + (leftSize / 4 + 2));
+          std::iter_swap(pivot - 2, pivot - (leftSize / 4 + 1));
+          std::iter_swap(pivot - 3, pivot - (leftSize / 4 + 2));
+        }
+      }
+      if (rightSize >= insertionSortThreshold) {
+        std::iter_swap(pivot + 1, pivot + (1 + rightSize / 4));
+        std::iter_swap(last - 1, last - rightSize / 4);
+        if (rightSize > nintherThreshold) {
+          std::iter_swap(pivot + 2, pivot + (2 + rightSize / 4));
+          std::iter_swap(pivot + 3, pivot + (3 + rightSize / 4));
+          std::iter_swap(last - 2, last - (1 + rightSize / 4));
+          std::iter_swap(last - 3, last - (2 + rightSize / 4));
+        }
+      }
+    } else if (partitioned && partialInsertionSort(first, pivot, less) &&
+               partialInsertionSort(pivot + 1, last, less)) {
+      return;
+    }
+
+    pdqsort(first, pivot, less, badPartitions, leftmost);
+    first = pivot + 1;
+    leftmost = false;
+  }
+}
+
+} // namespace detail
+
+template <typename T, typename Less>
+void pdqsort(T *first, T *last, Less less) {
+  if (last - first < 2) {
+    return;
+  }
+  int badPartitions = 0;
+  for (auto size = last - first; size > 1; size /= 2) {
+    badPartitions++;
+  }
+  detail::pdqsort(first, last, less, badPartitions, true);
+}
+
+// Sorts n items with sortRun(items, buffer, n), where buffer has room for n
+// more items. Large inputs are cut into runs sorted on separate threads and
+// merged through buffer.
+template <typename T, typename SortRun, typename Less>
+void parallelSort(T *items, T *buffer, size_t n, SortRun sortRun, Less less) {
+  const size_t runs = threads > 1 && n >= parallelThreshold ? threads : 1;
+  if (runs == 1) {
+    sortRun(items, buffer, n);
+    return;
+  }
+
+  std::vector<size_t> bounds;
+  for (size_t run = 0; run <= runs; run++) {
+    bounds.push_back(n * run / runs);
+  }
+  std::vector<std::thread> workers;
+  for (size_t run = 1; run < runs; run++) {
+    workers.emplace_back([&, run] {
+      sortRun(items + bounds[run], buffer + bounds[run],
+              bounds[run + 1] - bounds[run]);
+    });
+  }
+  sortRun(items, buffer, bounds[1]);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  // Merges neighbouring runs back and forth between items and buffer. An odd
+  // run out is copied over as it is.
+  T *from = items;
+  T *to = buffer;
+  while (bounds.size() > 2) {
+    std::vector<size_t> merged{0};
+    workers.clear();
+    for (size_t run = 0; run + 1 < bounds.size(); run += 2) {
+      const auto first = bounds[run];
+      const auto middle = bounds[run + 1];
+      const auto last = run + 2 < bounds.size() ? bounds[run + 2] : middle;
+      workers.emplace_back([=] {
+        std::merge(std::make_move_iterator(from + first),
+                   std::make_move_iterator(from + middle),
+                   std::make_move_iterator(from + middle),
+                   std::make_move_iterator(from + last), to + first, less);
+      });
+      merged.push_back(last);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    bounds = std::move(merged);
+    std::swap(from, to);
+  }
+  if (from != items) {
+    std::move(from, from + n, items);
+  }
+}
+
+// Moves the k greatest of n items to the front, greatest first. The k
+// greatest seen so far are kept in a heap with the least of them on top, so
+// each item is compared once with the top and only the items that beat it
+// go through the heap.
+template <typename T, typename Less>
+void topK(T *items, size_t n, size_t k, Less less) {
+  k = std::min(k, n);
+  if (k == 0) {
+    return;
+  }
+  const auto greater = [&](const T &a, const T &b) { return less(b, a); };
+  std::make_heap(items, items + k, greater);
+  for (size_t i = k; i < n; i++) {
+    if (less(items[0], items[i])) {
+      std::pop_heap(items, items + k, greater);
+      std::swap(items[k - 1], items[i]);
+      std::push_heap(items, items + k, greater);
+    }
+  }
+  std::sort_heap(items, items + k, greater);
+}
+
+} // namespace nemo::sort
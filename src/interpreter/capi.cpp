@@ -0,0 +1,306 @@
+#include "interpreter/capi.h"
+#include "interpreter/instance.h"
+
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+static_assert(sizeof(int) == sizeof(int32_t),
+              "Nemo numbers are exchanged as int32_t");
+
+namespace {
+
+// Forwards the VM's output to the host's write callback, or to stdout when
+// none is set.
+class OutputBuffer : public std::streambuf {
+public:
+  nemo_write_t write = nullptr;
+  void *user = nullptr;
+
+protected:
+  std::streamsize xsputn(const char *data, std::streamsize size) override {
+    emit(data, size);
+    return size;
+  }
+
+  int_type overflow(int_type c) override {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      const char ch = traits_type::to_char_type(c);
+      emit(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+private:
+  void emit(const char *data, size_t size) {
+    if (write != nullptr) {
+      write(user, data, size);
+    } else {
+      fwrite(data, 1, size, stdout);
+    }
+  }
+};
+
+} // namespace
+
+struct nemo_vm_t {
+  explicit nemo_vm_t(size_t memoryLimit)
+      : output(&buffer), interpreter(output, memoryLimit) {}
+
+  OutputBuffer buffer;
+  std::ostream output;
+  nemo::Interpreter interpreter;
+  std::vector<std::unique_ptr<nemo_script_t>> scripts;
+  // Error reported by the host function being called.
+  std::optional<std::string> raised;
+};
+
+struct nemo_script_t {
+  const nemo::ir::Program &program;
+};
+
+// A value's blocks point back to the accounting that charged them (see
+// nemo/heap.hpp), so a handle is freed without its VM.
+struct nemo_value_t {
+  NemoType value;
+  // Elements of a collection, copied the first time a view is requested.
+  std::vector<int32_t> numbers;
+  std::vector<char> chars;
+};
+
+// Wraps a value in a new handle, charging any allocation to the VM.
+template <typename Make>
+static nemo_value_t *newValue(nemo_vm_t *vm, Make make) {
+  nemo::memory::Use use(vm->interpreter.memory());
+  try {
+    return new nemo_value_t{make(), {}, {}};
+  } catch (const nemo::memory::LimitExceeded &) {
+    return nullptr;
+  }
+}
+
+// A host buffer is lent to the VM, not owned by it.
+static std::shared_ptr<const void> borrow(const void *data) {
+  return std::shared_ptr<const void>(std::shared_ptr<const void>(), data);
+}
+
+nemo_vm_t *nemo_vm_new(size_t memory_limit) {
+  try {
+    return new nemo_vm_t(memory_limit);
+  } catch (const std::exception &) {
+    return nullptr;
+  }
+}
+
+void nemo_vm_delete(nemo_vm_t *vm) { delete vm; }
+
+void nemo_vm_set_output(nemo_vm_t *vm, nemo_write_t write, void *user) {
+  vm->buffer.write = write;
+  vm->buffer.user = user;
+}
+
+nemo_script_t *nemo_compile(nemo_vm_t *vm, const char *name,
+                            const char *source) {
+  const auto *program = vm->interpreter.compile(name, source);
+  if (program == nullptr) {
+    return nullptr;
+  }
+  vm->scripts.push_back(std::make_unique<nemo_script_t>(*program));
+  return vm->scripts.back().get();
+}
+
+int nemo_run(nemo_vm_t *vm, const nemo_script_t *script) {
+  return vm->interpreter.run(script->program);
+}
+
+int nemo_exit_code(nemo_vm_t *vm, int *code) {
+  const auto exitCode = vm->interpreter.exitCode();
+  if (!exitCode) {
+    return 0;
+  }
+  *code = *exitCode;
+  return 1;
+}
+
+void nemo_register(nemo_vm_t *vm, const char *name, nemo_function_t function,
+                   void *user) {
+  vm->interpreter.registerFunction(name, [vm, function,
+                                          user](std::vector<NemoType> args) {
+    std::vector<nemo_value_t> values;
+    std::vector<nemo_value_t *> pointers;
+    values.reserve(args.size());
+    for (auto &arg : args) {
+      values.push_back(nemo_value_t{std::move(arg), {}, {}});
+      pointers.push_back(&values.back());
+    }
+
+    vm->raised.reset();
+    auto *result = function(vm, pointers.data(), pointers.size(), user);
+
+    auto value = voidType();
+    if (result != nullptr) {
+      value = std::move(result->value);
+      delete result;
+    }
+    if (vm->raised) {
+      throw std::runtime_error(*std::exchange(vm->raised, std::nullopt));
+    }
+    return value;
+  });
+}
+
+void nemo_raise(nemo_vm_t *vm, const char *message) { vm->raised = message; }
+
+void nemo_set_global(nemo_vm_t *vm, const char *name, nemo_value_t *value) {
+  vm->interpreter.setGlobal(name, std::move(value->value));
+  nemo_value_delete(value);
+}
+
+nemo_value_t *nemo_get_global(nemo_vm_t *vm, const char *name) {
+  auto value = vm->interpreter.global(name);
+  if (!value) {
+    return nullptr;
+  }
+  return newValue(vm, [&] { return std::move(*value); });
+}
+
+nemo_value_t *nemo_number(nemo_vm_t *vm, int32_t number) {
+  return newValue(vm, [&] { return numberType(number); });
+}
+
+nemo_value_t *nemo_char(nemo_vm_t *vm, char c) {
+  return newValue(vm, [&] { return charType(c); });
+}
+
+nemo_value_t *nemo_string(nemo_vm_t *vm, const char *data, size_t size) {
+  return newValue(vm, [&] { return stringType(std::string_view(data, size)); });
+}
+
+nemo_value_t *nemo_number_array(nemo_vm_t *vm, const int32_t *data,
+                                size_t count) {
+  return newValue(vm, [&] {
+    return arrayType(
+        NemoArray{NemoArray::Element::Number, borrow(data), count});
+  });
+}
+
+nemo_value_t *nemo_char_array(nemo_vm_t *vm, const char *data, size_t size) {
+  return newValue(vm, [&] {
+    return arrayType(NemoArray{NemoArray::Element::Char, borrow(data), size});
+  });
+}
+
+void nemo_value_delete(nemo_value_t *value) { delete value; }
+
+nemo_type_t nemo_value_type(const nemo_value_t *value) {
+  switch (value->value.type) {
+  case BuiltinType::INT:
+    return NEMO_NUMBER;
+  case BuiltinType::CHAR:
+    return NEMO_CHAR;
+  case BuiltinType::STRING:
+    return NEMO_STRING;
+  case BuiltinType::COLLECTION:
+    return NEMO_COLLECTION;
+  case BuiltinType::LAMBDA:
+    return NEMO_LAMBDA;
+  case BuiltinType::ARRAY:
+    return std::get<NemoArray>(value->value.value.value()).element ==
+                   NemoArray::Element::Number
+               ? NEMO_NUMBER_ARRAY
+               : NEMO_CHAR_ARRAY;
+  case BuiltinType::RECORD:
+    return NEMO_RECORD;
+  case BuiltinType::TABLE:
+    return NEMO_TABLE;
+  case BuiltinType::MAP:
+    return NEMO_MAP;
+  case BuiltinType::VOID:
+    return NEMO_VOID;
+  }
+  return NEMO_VOID;
+}
+
+int32_t nemo_value_number(const nemo_value_t *value) {
+  return value->value.type == BuiltinType::INT
+             ? std::get<int>(value->value.value.value())
+             : 0;
+}
+
+char nemo_value_char(const nemo_value_t *value) {
+  return value->value.type == BuiltinType::CHAR
+             ? std::get<char>(value->value.value.value())
+             : '\0';
+}
+
+// Copies the elements of a collection of kind into cache, unless one of them
+// is of another kind.
+template <typename T>
+static bool copyElements(const NemoCollection &collection, BuiltinType kind,
+                         std::vector<T> &cache) {
+  if (cache.size() == collection.size()) {
+    return true;
+  }
+  for (const auto &element : collection) {
+    if (element.type != kind) {
+      cache.clear();
+      return false;
+    }
+    cache.push_back(std::get<T>(element.value.value()));
+  }
+  return true;
+}
+
+const int32_t *nemo_value_numbers(nemo_value_t *value, size_t *count) {
+  static const int32_t empty = 0;
+  const auto &v = value->value;
+
+  if (v.type == BuiltinType::ARRAY) {
+    const auto &array = std::get<NemoArray>(v.value.value());
+    if (array.element != NemoArray::Element::Number) {
+      return nullptr;
+    }
+    *count = array.size;
+    return array.numbers();
+  }
+
+  if (v.type == BuiltinType::COLLECTION &&
+      copyElements(v.collection.value(), BuiltinType::INT, value->numbers)) {
+    *count = value->numbers.size();
+    return value->numbers.empty() ? &empty : value->numbers.data();
+  }
+
+  return nullptr;
+}
+
+const char *nemo_value_chars(nemo_value_t *value, size_t *size) {
+  const auto &v = value->value;
+
+  if (v.type == BuiltinType::STRING) {
+    const auto &string = std::get<NemoString>(v.value.value());
+    *size = string.size();
+    return string.data();
+  }
+
+  if (v.type == BuiltinType::ARRAY) {
+    const auto &array = std::get<NemoArray>(v.value.value());
+    if (array.element != NemoArray::Element::Char) {
+      return nullptr;
+    }
+    *size = array.size;
+    return array.chars();
+  }
+
+  if (v.type == BuiltinType::COLLECTION &&
+      copyElements(v.collection.value(), BuiltinType::CHAR, value->chars)) {
+    *size = value->chars.size();
+    return value->chars.empty() ? "" : value->chars.data();
+  }
+
+  return nullptr;
+}
@@ -0,0 +1,575 @@
+#include "interpreter/closure.h"
+#include "interpreter/operators.h"
+#include "interpreter/profiler.h"
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using nemo::ir::Binding;
+
+// Tree walker entry points the closures fall back to or share with it.
+NemoType eval_expression(const nemo::ir::Expression &expression,
+                         std::shared_ptr<ScopeContext> ctx,
+                         std::span<NemoType> args,
+                         nemo::ir::CallCache *cache);
+NemoType eval_variable(const nemo::ir::Identifier &identifier,
+                       std::shared_ptr<ScopeContext> ctx);
+NemoType eval_field(const nemo::ir::Field &field, NemoType &value,
+                    std::shared_ptr<ScopeContext> ctx);
+NemoType apply_lambda(const nemo::ir::Lambda &lambda,
+                      std::span<NemoType> args,
+                      std::shared_ptr<ScopeContext> ctx,
+                      nemo::ir::CallCache *cache);
+NemoType apply_builtin(const nemo::ir::Identifier &identifier, int row,
+                       std::span<NemoType> args,
+                       std::shared_ptr<ScopeContext> ctx);
+const nemo::ir::Lambda *calleeOf(const nemo::ir::Identifier &identifier,
+                                 nemo::ir::CallCache *cache,
+                                 std::shared_ptr<ScopeContext> ctx);
+NemoType apply_value(const nemo::ir::Identifier &identifier,
+                     const NemoType &argument,
+                     std::shared_ptr<ScopeContext> ctx);
+const char *stageName(const nemo::ir::Expression &expression);
+bool holds(const NemoType &condition, ScopeContext &ctx);
+bool matches(const nemo::ir::Arm &arm, const NemoType &value);
+
+namespace nemo::closure {
+
+namespace {
+
+// A body is compiled on this call; lambdas called once, such as a literal
+// piped into at the top level, are only walked.
+constexpr uint32_t hotCalls = 2;
+
+Statement statement(const nemo::ir::Statement &statement);
+Block sequence(const std::vector<nemo::ir::Statement> &statements, bool tail);
+Block conditional(const nemo::ir::If &conditional, bool tail);
+Block match(const nemo::ir::Match &match, bool tail);
+Value loop(const nemo::ir::Loop &loop);
+
+// A block evaluated outside tail position.
+Value valueOf(Block block) {
+  return [block = std::move(block)](const Context &ctx) {
+    const nemo::ir::Statement *tail = nullptr;
+    return block(ctx, tail);
+  };
+}
+
+Value value(const nemo::ir::Expression &expression) {
+  return std::visit(
+      [&](const auto &node) -> Value {
+        using Node = std::decay_t<decltype(node)>;
+
+        if constexpr (std::is_same_v<Node, nemo::ir::Identifier>) {
+          const auto index = node.binding.index;
+          if (node.binding.kind == Binding::Kind::Local) {
+            return [index](const Context &ctx) { return ctx->local(index); };
+          }
+          if (node.binding.kind == Binding::Kind::Global) {
+            return [index, &node](const Context &ctx) {
+              const auto &slot = ctx->global(index);
+              return slot.has_value() ? slot.value() : eval_variable(node, ctx);
+            };
+          }
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Number>) {
+          return [number = node.value](const Context &) {
+            return numberType(number);
+          };
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Character>) {
+          return [character = node.value](const Context &) {
+            return charType(character);
+          };
+        } else if constexpr (std::is_same_v<Node, nemo::ir::String>) {
+          return [&string = node.value](const Context &) {
+            return stringType(string);
+          };
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Collection>) {
+          std::vector<Value> elements;
+          for (const auto &element : node.elements) {
+            elements.push_back(value(element));
+          }
+          return [elements = std::move(elements)](const Context &ctx) {
+            NemoCollection collection;
+            collection.reserve(elements.size());
+            for (const auto &element : elements) {
+              collection.push_back(element(ctx));
+            }
+            return collectionType(std::move(collection));
+          };
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Lambda>) {
+          return [&node](const Context &) { return lambdaType(&node); };
+        } else if constexpr (std::is_same_v<Node, nemo::ir::If>) {
+          return valueOf(conditional(node, false));
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Match>) {
+          return valueOf(match(node, false));
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Loop>) {
+          return loop(node);
+        }
+
+        // Builtins called without arguments and misplaced fields are rare
+        // enough to stay walked.
+        return [&expression](const Context &ctx) {
+          return eval_expression(expression, ctx, {}, nullptr);
+        };
+      },
+      expression.value);
+}
+
+// An operator stage. On operands specialize() proved to be numbers it
+// updates the running result in place, reading a literal or local operand
+// directly; otherwise numbers still take that path after a tag check and
+// anything else goes through the operator table.
+template <nemo::operators::Kind op>
+Step operation(const nemo::ir::Stage &stage) {
+  const auto &target = stage.target;
+
+  if (stage.operands == nemo::ir::BuiltinType::Number) {
+    if (const auto *number = std::get_if<nemo::ir::Number>(&target.value)) {
+      return [b = number->value](NemoType &result, const Context &) {
+        auto &a = *std::get_if<int>(&*result.value);
+        a = nemo::operators::apply(op, a, b);
+      };
+    }
+
+    const auto *identifier = std::get_if<nemo::ir::Identifier>(&target.value);
+    if (identifier != nullptr &&
+        identifier->binding.kind == Binding::Kind::Local) {
+      return [index = identifier->binding.index](NemoType &result,
+                                                 const Context &ctx) {
+        auto &a = *std::get_if<int>(&*result.value);
+        a = nemo::operators::apply(
+            op, a, *std::get_if<int>(&*ctx->local(index).value));
+      };
+    }
+
+    return [operand = value(target)](NemoType &result, const Context &ctx) {
+      const auto b = operand(ctx);
+      auto &a = *std::get_if<int>(&*result.value);
+      a = nemo::operators::apply(op, a, *std::get_if<int>(&*b.value));
+    };
+  }
+
+  return [operand = value(target)](NemoType &result, const Context &ctx) {
+    const auto b = operand(ctx);
+    if (result.type == BuiltinType::INT && b.type == BuiltinType::INT) {
+      auto &a = *std::get_if<int>(&*result.value);
+      a = nemo::operators::apply(op, a, *std::get_if<int>(&*b.value));
+    } else {
+      nemo::operators::apply(op, result, b, *ctx);
+    }
+  };
+}
+
+// Picks the instance of operation for the stage's operator.
+template <size_t... kinds>
+Step operation(const nemo::ir::Stage &stage, std::index_sequence<kinds...>) {
+  using Factory = Step (*)(const nemo::ir::Stage &);
+  static constexpr Factory factories[] = {
+      operation<static_cast<nemo::operators::Kind>(kinds)>...};
+  return factories[static_cast<size_t>(stage.op.kind)](stage);
+}
+
+void functionNotFound(NemoType &result, const Context &ctx) {
+  ctx->output() << "Function not found" << std::endl;
+  result = voidType();
+}
+
+// A `|>` stage. The running result is the argument and may be moved from.
+Step call(const nemo::ir::Stage &stage) {
+  const auto &target = stage.target;
+  auto *cache = &stage.cache;
+
+  if (const auto *field = std::get_if<nemo::ir::Field>(&target.value)) {
+    return [field](NemoType &result, const Context &ctx) {
+      result = eval_field(*field, result, ctx);
+    };
+  }
+
+  if (const auto *lambda = std::get_if<nemo::ir::Lambda>(&target.value)) {
+    return [lambda, cache](NemoType &result, const Context &ctx) {
+      result = apply_lambda(*lambda, std::span(&result, 1), ctx, cache);
+    };
+  }
+
+  const auto *identifier = std::get_if<nemo::ir::Identifier>(&target.value);
+  if (identifier == nullptr) {
+    return functionNotFound;
+  }
+
+  if (identifier->binding.kind == Binding::Kind::Builtin) {
+    return [identifier, row = target.location.row](NemoType &result,
+                                                   const Context &ctx) {
+      result = apply_builtin(*identifier, row, std::span(&result, 1), ctx);
+    };
+  }
+
+  return [identifier, cache](NemoType &result, const Context &ctx) {
+    const auto *lambda = calleeOf(*identifier, cache, ctx);
+    if (lambda == nullptr) {
+      result = apply_value(*identifier, result, ctx);
+      return;
+    }
+    result = apply_lambda(*lambda, std::span(&result, 1), ctx, cache);
+  };
+}
+
+// The local a number stage reads, -1 for any other operand.
+int localOperand(const nemo::ir::Stage &stage) {
+  const auto *identifier =
+      std::get_if<nemo::ir::Identifier>(&stage.target.value);
+  return identifier != nullptr &&
+                 identifier->binding.kind == Binding::Kind::Local
+             ? identifier->binding.index
+             : -1;
+}
+
+// The stages of `let x <= x op a op b ...` when every operand is a literal
+// or a variable other than x. They can update x in place rather than a copy
+// assigned back, the way operators update the running result. Empty
+// otherwise.
+std::vector<Step> update(const nemo::ir::Assignment &assignment) {
+  const auto &pipeline = assignment.value;
+  const auto *head = std::get_if<nemo::ir::Identifier>(&pipeline.head.value);
+  const auto &variable = assignment.variable.binding;
+  if (head == nullptr || head->binding.kind != variable.kind ||
+      head->binding.index != variable.index || pipeline.stages.empty()) {
+    return {};
+  }
+
+  std::vector<Step> steps;
+  for (const auto &stage : pipeline.stages) {
+    if (stage.kind != nemo::ir::Stage::Kind::Operator) {
+      return {};
+    }
+    const auto &target = stage.target.value;
+    const auto *identifier = std::get_if<nemo::ir::Identifier>(&target);
+    const auto literal = std::holds_alternative<nemo::ir::Number>(target) ||
+                         std::holds_alternative<nemo::ir::Character>(target) ||
+                         std::holds_alternative<nemo::ir::String>(target);
+    const auto other =
+        identifier != nullptr &&
+        (identifier->binding.kind == Binding::Kind::Local ||
+         identifier->binding.kind == Binding::Kind::Global) &&
+        (identifier->binding.kind != variable.kind ||
+         identifier->binding.index != variable.index);
+    if (!literal && !other) {
+      return {};
+    }
+    steps.push_back(operation(
+        stage, std::make_index_sequence<nemo::ir::Operator::kindCount>{}));
+  }
+  return steps;
+}
+
+Statement statement(const nemo::ir::Statement &statement) {
+  const auto row = statement.location.row;
+
+  if (const auto *assignment =
+          std::get_if<nemo::ir::Assignment>(&statement.statement)) {
+    const auto index = assignment->variable.binding.index;
+    auto steps = update(*assignment);
+    if (assignment->variable.binding.kind == Binding::Kind::Local) {
+      if (!steps.empty()) {
+        return [steps = std::move(steps), index, row](const Context &ctx) {
+          nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                      nullptr, row);
+          auto &local = ctx->local(index);
+          for (const auto &step : steps) {
+            step(local, ctx);
+          }
+          return voidType();
+        };
+      }
+      return [pipeline = Pipeline(assignment->value), index,
+              row](const Context &ctx) {
+        nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                    nullptr, row);
+        ctx->local(index) = pipeline.run(ctx);
+        return voidType();
+      };
+    }
+    // A global is only updated in place while it holds a value other than
+    // a lambda, whose replacement must go through assign(). Globals are
+    // sized up to the last one the operands read first, so reading them
+    // cannot move the one updated.
+    auto last = index;
+    for (const auto &stage : assignment->value.stages) {
+      const auto *identifier =
+          std::get_if<nemo::ir::Identifier>(&stage.target.value);
+      if (identifier != nullptr &&
+          identifier->binding.kind == Binding::Kind::Global) {
+        last = std::max(last, identifier->binding.index);
+      }
+    }
+    return [pipeline = Pipeline(assignment->value), steps = std::move(steps),
+            index, last, row](const Context &ctx) {
+      nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                  nullptr, row);
+      ctx->global(last);
+      auto &global = ctx->global(index);
+      if (!steps.empty() && global.has_value() &&
+          global->type != BuiltinType::LAMBDA) {
+        for (const auto &step : steps) {
+          step(*global, ctx);
+        }
+      } else {
+        ctx->assign(index, pipeline.run(ctx));
+      }
+      return voidType();
+    };
+  }
+
+  if (const auto *pipeline =
+          std::get_if<nemo::ir::Pipeline>(&statement.statement)) {
+    return [pipeline = Pipeline(*pipeline), row](const Context &ctx) {
+      nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                  nullptr, row);
+      return pipeline.run(ctx);
+    };
+  }
+
+  // Type definitions take effect when the program is compiled.
+  return [](const Context &) { return voidType(); };
+}
+
+// Opens the profiler frame of a statement around a block.
+Block framed(Block block, int row) {
+  return [block = std::move(block), row](const Context &ctx,
+                                         const nemo::ir::Statement *&tail) {
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement, nullptr,
+                                row);
+    return block(ctx, tail);
+  };
+}
+
+// The last statement of a block in tail position.
+Block tailStatement(const nemo::ir::Statement &statement) {
+  const auto row = statement.location.row;
+
+  if (const auto *pipeline = tailPipeline(statement)) {
+    return [pipeline = Pipeline(*pipeline),
+            count = pipeline->stages.size() - 1, &statement,
+            row](const Context &ctx, const nemo::ir::Statement *&tail) {
+      nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                  nullptr, row);
+      tail = &statement;
+      return pipeline.run(ctx, count);
+    };
+  }
+
+  const auto *pipeline = std::get_if<nemo::ir::Pipeline>(&statement.statement);
+  if (pipeline != nullptr && pipeline->stages.empty()) {
+    const auto &head = pipeline->head.value;
+    if (const auto *node = std::get_if<nemo::ir::If>(&head)) {
+      return framed(conditional(*node, true), row);
+    }
+    if (const auto *node = std::get_if<nemo::ir::Match>(&head)) {
+      return framed(match(*node, true), row);
+    }
+  }
+
+  return [code = closure::statement(statement)](
+             const Context &ctx, const nemo::ir::Statement *&) {
+    return code(ctx);
+  };
+}
+
+Block sequence(const std::vector<nemo::ir::Statement> &statements, bool tail) {
+  if (statements.empty()) {
+    return [](const Context &, const nemo::ir::Statement *&) {
+      return voidType();
+    };
+  }
+
+  std::vector<Statement> leading;
+  leading.reserve(statements.size() - 1);
+  for (size_t i = 0; i + 1 < statements.size(); i++) {
+    leading.push_back(statement(statements[i]));
+  }
+  auto last = tail ? tailStatement(statements.back())
+                   : [code = statement(statements.back())](
+                         const Context &ctx, const nemo::ir::Statement *&) {
+                       return code(ctx);
+                     };
+  if (leading.empty()) {
+    return last;
+  }
+
+  return [leading = std::move(leading), last = std::move(last)](
+             const Context &ctx, const nemo::ir::Statement *&tail) {
+    for (const auto &statement : leading) {
+      statement(ctx);
+    }
+    return last(ctx, tail);
+  };
+}
+
+// Whether the condition of an if or loop holds.
+using Test = std::function<bool(const Context &ctx)>;
+
+// A comparison `x op a` of a local and a literal or local that specialize()
+// proved to be on numbers is made on the ints, so the branch is taken
+// without building a value. Any other condition is evaluated and must give
+// a nonzero number.
+Test test(const std::vector<nemo::ir::Statement> &condition) {
+  const auto &statement = condition.front();
+  const auto row = statement.location.row;
+  const auto *pipeline = std::get_if<nemo::ir::Pipeline>(&statement.statement);
+  const auto *head =
+      pipeline != nullptr
+          ? std::get_if<nemo::ir::Identifier>(&pipeline->head.value)
+          : nullptr;
+
+  if (head != nullptr && head->binding.kind == Binding::Kind::Local &&
+      pipeline->stages.size() == 1 &&
+      pipeline->stages[0].kind == nemo::ir::Stage::Kind::Operator &&
+      pipeline->stages[0].operands == nemo::ir::BuiltinType::Number) {
+    const auto &stage = pipeline->stages[0];
+    const auto op = stage.op.kind;
+    const auto x = head->binding.index;
+    if (const auto *number =
+            std::get_if<nemo::ir::Number>(&stage.target.value)) {
+      return [op, x, a = number->value, row](const Context &ctx) {
+        nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                    nullptr, row);
+        return nemo::operators::apply(
+                   op, *std::get_if<int>(&*ctx->local(x).value), a) != 0;
+      };
+    }
+    if (const auto a = localOperand(stage); a >= 0) {
+      return [op, x, a, row](const Context &ctx) {
+        nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement,
+                                    nullptr, row);
+        return nemo::operators::apply(
+                   op, *std::get_if<int>(&*ctx->local(x).value),
+                   *std::get_if<int>(&*ctx->local(a).value)) != 0;
+      };
+    }
+  }
+
+  return [code = closure::statement(statement)](const Context &ctx) {
+    return holds(code(ctx), *ctx);
+  };
+}
+
+Block conditional(const nemo::ir::If &conditional, bool tail) {
+  return [condition = test(conditional.condition),
+          then = sequence(conditional.then, tail),
+          otherwise = sequence(conditional.otherwise, tail)](
+             const Context &ctx, const nemo::ir::Statement *&tail) {
+    return condition(ctx) ? then(ctx, tail) : otherwise(ctx, tail);
+  };
+}
+
+Block match(const nemo::ir::Match &match, bool tail) {
+  struct Arm {
+    const nemo::ir::Arm *arm;
+    Block body;
+  };
+
+  std::vector<Arm> arms;
+  for (const auto &arm : match.arms) {
+    arms.push_back(Arm{&arm, sequence(arm.body, tail)});
+  }
+  return [subject = statement(match.subject.front()), arms = std::move(arms)](
+             const Context &ctx, const nemo::ir::Statement *&tail) {
+    const auto value = subject(ctx);
+    for (const auto &arm : arms) {
+      if (matches(*arm.arm, value)) {
+        return arm.body(ctx, tail);
+      }
+    }
+    return voidType();
+  };
+}
+
+// Each iteration runs the condition and the body closures in place; nothing
+// is materialized per iteration.
+Value loop(const nemo::ir::Loop &loop) {
+  return [condition = test(loop.condition),
+          body = sequence(loop.body, false)](const Context &ctx) {
+    const nemo::ir::Statement *tail = nullptr;
+    while (condition(ctx)) {
+      body(ctx, tail);
+    }
+    return voidType();
+  };
+}
+
+} // namespace
+
+Pipeline::Pipeline(const nemo::ir::Pipeline &pipeline)
+    : head(value(pipeline.head)), headName(stageName(pipeline.head)),
+      headRow(pipeline.head.location.row) {
+  stages.reserve(pipeline.stages.size());
+  for (const auto &stage : pipeline.stages) {
+    if (stage.kind == nemo::ir::Stage::Kind::Operator) {
+      const auto step = operation(
+          stage, std::make_index_sequence<nemo::ir::Operator::kindCount>{});
+      stages.push_back(
+          Stage{step, stage.op.symbol.c_str(), stage.target.location.row});
+    } else {
+      stages.push_back(Stage{call(stage), stageName(stage.target),
+                             stage.target.location.row});
+    }
+  }
+}
+
+NemoType Pipeline::run(const Context &ctx, size_t count) const {
+  NemoType result = [&]() {
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Stage, headName,
+                                headRow, 0);
+    return head(ctx);
+  }();
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto &stage = stages[i];
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Stage, stage.name,
+                                stage.row, i + 1);
+    stage.step(result, ctx);
+  }
+
+  return result;
+}
+
+Body::Body(const nemo::ir::Lambda &lambda)
+    : code(sequence(lambda.body, true)) {}
+
+Body::Body(const nemo::ir::Loop &loop)
+    : code([loop = closure::loop(loop)](const Context &ctx,
+                                        const nemo::ir::Statement *&) {
+        return loop(ctx);
+      }) {}
+
+const Body *compiled(const nemo::ir::Lambda &lambda, ScopeContext &ctx) {
+  auto &slot = lambda.compiled;
+  if (slot.body == nullptr && ++slot.calls == hotCalls) {
+    slot.body = &ctx.adopt(std::make_shared<const Body>(lambda));
+  }
+  return slot.body;
+}
+
+const Body *compiled(const nemo::ir::Loop &loop, ScopeContext &ctx) {
+  auto &slot = loop.compiled;
+  if (slot.body == nullptr && ++slot.calls == hotCalls) {
+    slot.body = &ctx.adopt(std::make_shared<const Body>(loop));
+  }
+  return slot.body;
+}
+
+const nemo::ir::Pipeline *tailPipeline(const nemo::ir::Statement &statement) {
+  const auto *pipeline = std::get_if<nemo::ir::Pipeline>(&statement.statement);
+  if (pipeline == nullptr || pipeline->stages.empty() ||
+      pipeline->stages.back().kind != nemo::ir::Stage::Kind::Pipe) {
+    return nullptr;
+  }
+  return pipeline;
+}
+
+} // namespace nemo::closure
@@ -0,0 +1,124 @@
+#ifndef nemo_capi_h
+#define nemo_capi_h
+
+/*
+** C API for embedding Nemo.
+**
+** A nemo_vm_t is an isolated session (see nemo::Interpreter): separate VMs
+** may be used from separate threads, one VM from one thread at a time.
+** Scripts are compiled once with nemo_compile and run any number of times
+** with nemo_run; the VM's globals keep their values between runs, so hosts
+** pass inputs and read results through globals.
+**
+** Number and char collections cross the boundary as typed arrays. An array
+** made with nemo_number_array or nemo_char_array borrows the host's buffer,
+** and scripts read it in place. nemo_value_numbers and nemo_value_chars
+** return pointers into the VM's own storage for strings and arrays. Only a
+** collection built by a script has to be copied, once per value handle.
+**
+** Functions returning int return 1 on success and 0 on failure, as in mpc.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NEMO_CAPI_VERSION 1
+
+typedef struct nemo_vm_t nemo_vm_t;
+typedef struct nemo_script_t nemo_script_t;
+typedef struct nemo_value_t nemo_value_t;
+
+typedef enum {
+  NEMO_VOID,
+  NEMO_NUMBER,
+  NEMO_CHAR,
+  NEMO_STRING,
+  NEMO_COLLECTION,
+  NEMO_LAMBDA,
+  NEMO_NUMBER_ARRAY,
+  NEMO_CHAR_ARRAY,
+  NEMO_RECORD,
+  NEMO_TABLE,
+  NEMO_MAP
+} nemo_type_t;
+
+/* Receives everything a script prints. */
+typedef void (*nemo_write_t)(void *user, const char *data, size_t size);
+
+/*
+** A host function. args are owned by the VM and valid during the call. The
+** function returns a new value (or NULL for void) which the VM takes over,
+** and may report an error with nemo_raise.
+*/
+typedef nemo_value_t *(*nemo_function_t)(nemo_vm_t *vm, nemo_value_t **args,
+                                         size_t count, void *user);
+
+/*
+** VMs. memory_limit caps the bytes held by the VM's values, 0 for no limit.
+** Output goes to stdout until nemo_vm_set_output is called.
+*/
+nemo_vm_t *nemo_vm_new(size_t memory_limit);
+void nemo_vm_delete(nemo_vm_t *vm);
+void nemo_vm_set_output(nemo_vm_t *vm, nemo_write_t write, void *user);
+
+/*
+** Scripts. Errors are written to the output. Scripts belong to the VM and
+** are freed with it.
+*/
+nemo_script_t *nemo_compile(nemo_vm_t *vm, const char *name,
+                            const char *source);
+int nemo_run(nemo_vm_t *vm, const nemo_script_t *script);
+/* Returns 1 and stores the status if the last run called exit. */
+int nemo_exit_code(nemo_vm_t *vm, int *code);
+
+/*
+** Host functions. A script can only call functions registered before it is
+** compiled.
+*/
+void nemo_register(nemo_vm_t *vm, const char *name, nemo_function_t function,
+                   void *user);
+void nemo_raise(nemo_vm_t *vm, const char *message);
+
+/* Globals. nemo_set_global takes over value; nemo_get_global returns a new
+** value, or NULL if the global was never assigned. */
+void nemo_set_global(nemo_vm_t *vm, const char *name, nemo_value_t *value);
+nemo_value_t *nemo_get_global(nemo_vm_t *vm, const char *name);
+
+/*
+** Values. Array values borrow data: the buffer must stay valid and unchanged
+** until every value and global referring to it is gone.
+**
+** A value may outlive its VM and may be deleted from any thread, even while
+** the VM runs on another. Its bytes stay charged to the VM until then. A
+** lambda, record or table value refers to the VM's scripts, so it can only
+** be passed back to the VM it came from.
+*/
+nemo_value_t *nemo_number(nemo_vm_t *vm, int32_t number);
+nemo_value_t *nemo_char(nemo_vm_t *vm, char c);
+nemo_value_t *nemo_string(nemo_vm_t *vm, const char *data, size_t size);
+nemo_value_t *nemo_number_array(nemo_vm_t *vm, const int32_t *data,
+                                size_t count);
+nemo_value_t *nemo_char_array(nemo_vm_t *vm, const char *data, size_t size);
+void nemo_value_delete(nemo_value_t *value);
+
+nemo_type_t nemo_value_type(const nemo_value_t *value);
+int32_t nemo_value_number(const nemo_value_t *value);
+char nemo_value_char(const nemo_value_t *value);
+
+/*
+** Typed views of a value, valid until the value is deleted. Number arrays
+** and collections of numbers give numbers; strings, char arrays and
+** collections of chars give chars. Returns NULL for any other value.
+*/
+const int32_t *nemo_value_numbers(nemo_value_t *value, size_t *count);
+const char *nemo_value_chars(nemo_value_t *value, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ir/ir.h"
+#include "nemo/common.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Closure compiler, the tier between walking the IR and a VM.
+//
+// A lambda body that keeps being called is compiled once into a tree of
+// pre-bound closures. What the tree walker works out on every evaluation
+// (the kind of each node, how an identifier is bound, which operator a
+// stage applies and, in specialized bodies, the operand types) is decided
+// when the closures are built, so running the body is a chain of indirect
+// calls that never looks at a variant tag or an operator string.
+//
+// Top-level statements run once and keep being walked; so does a body until
+// its second call. A loop the walker runs is compiled on its second
+// iteration, so a hot loop at the top level or in a cold body runs compiled
+// too. Branches and loops become closures choosing which closure runs next,
+// the closure tree's jumps. Closures refer to the IR they were compiled
+// from, which the session owns, and never hold Nemo values.
+namespace nemo::closure {
+
+using Context = std::shared_ptr<ScopeContext>;
+// Evaluates an expression that is not called.
+using Value = std::function<NemoType(const Context &ctx)>;
+// Applies a pipeline stage to the running result in place.
+using Step = std::function<void(NemoType &result, const Context &ctx)>;
+using Statement = std::function<NemoType(const Context &ctx)>;
+// Runs statements, the last one in tail position, see Body::run.
+using Block = std::function<NemoType(const Context &ctx,
+                                     const nemo::ir::Statement *&tail)>;
+
+class Pipeline {
+public:
+  explicit Pipeline(const nemo::ir::Pipeline &pipeline);
+
+  // Evaluates the head and the first count stages.
+  NemoType run(const Context &ctx, size_t count) const;
+  NemoType run(const Context &ctx) const { return run(ctx, stages.size()); }
+
+private:
+  struct Stage {
+    Step step;
+    // Profiler frame of the stage.
+    const char *name;
+    int row;
+  };
+
+  Value head;
+  const char *headName;
+  int headRow;
+  std::vector<Stage> stages;
+};
+
+// A compiled lambda body, or a loop compiled on its own.
+class Body {
+public:
+  explicit Body(const nemo::ir::Lambda &lambda);
+  explicit Body(const nemo::ir::Loop &loop);
+
+  // Runs the body and gives the value of its last statement. When that
+  // statement, or the last one of the branch a conditional ending the body
+  // takes, pipes into a call, the pipeline runs up to the call, tail is set
+  // to the statement and the call's argument returned: the caller makes the
+  // call, as a tail call.
+  NemoType run(const Context &ctx, const nemo::ir::Statement *&tail) const {
+    return code(ctx, tail);
+  }
+
+private:
+  Block code;
+};
+
+// The compiled body of lambda, compiling it on its second call; null while
+// it is walked.
+const Body *compiled(const nemo::ir::Lambda &lambda, ScopeContext &ctx);
+// The compiled loop, compiling it on its second iteration.
+const Body *compiled(const nemo::ir::Loop &loop, ScopeContext &ctx);
+
+// The pipeline of a statement whose last stage pipes into a call, null for
+// any other statement.
+const nemo::ir::Pipeline *tailPipeline(const nemo::ir::Statement &statement);
+
+} // namespace nemo::closure
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "grammar/grammar.h"
+#include "ir/ir.h"
+#include "nemo/common.hpp"
+#include "nemo/memory.hpp"
+#include "nemo/native.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace nemo {
+
+// A self-contained Nemo session for embedding. Every instance owns its
+// parsers, global context, output stream and memory accounting, so separate
+// instances can run on separate threads without sharing mutable state. One
+// instance must only be used by one thread at a time.
+//
+// The exit builtin ends the current run() instead of the process. The
+// --stats and --profile diagnostics are process-wide and must stay disabled
+// while instances run concurrently.
+class Interpreter {
+public:
+  // Throws std::runtime_error if the grammar cannot be loaded. A memoryLimit
+  // of 0 leaves the instance unlimited.
+  explicit Interpreter(std::ostream &output = std::cout,
+                       size_t memoryLimit = 0);
+  ~Interpreter();
+
+  Interpreter(const Interpreter &) = delete;
+  Interpreter &operator=(const Interpreter &) = delete;
+
+  // Parses, compiles and evaluates source against the session's globals.
+  // Errors are written to the output; returns false if source did not run to
+  // the end.
+  bool run(const std::string &name, const std::string &source);
+
+  // Parses and compiles source without running it. The program is owned by
+  // the session; returns nullptr after writing the error to the output.
+  const ir::Program *compile(const std::string &name,
+                             const std::string &source);
+
+  // Evaluates a program compiled by this instance. Can be repeated; globals
+  // keep their values between runs.
+  bool run(const ir::Program &program);
+
+  // Adds a builtin. Only programs compiled afterwards can call it.
+  void registerFunction(const std::string &name, ScopeContext::Function func);
+
+  // Adds a builtin with a typed signature, see nemo/native.hpp.
+  template <typename Signature>
+  void registerNative(const std::string &name,
+                      typename native::Traits<Signature>::Pointer fn) {
+    native::registerNative<Signature>(*globals, name, fn);
+  }
+
+  void setGlobal(const std::string &name, NemoType value);
+  std::optional<NemoType> global(const std::string &name);
+
+  // Status passed to the exit builtin during the last run(), if any.
+  std::optional<int> exitCode() const { return exited; }
+
+  const memory::Accounting &memory() const { return accounting; }
+  memory::Accounting &memory() { return accounting; }
+
+private:
+  NemoGrammar *grammar;
+  memory::Accounting accounting;
+  std::shared_ptr<ScopeContext> globals;
+  std::optional<int> exited;
+};
+
+} // namespace nemo
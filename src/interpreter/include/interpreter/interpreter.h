@@ -1,6 +1,19 @@
 #pragma once
 
+#include "ir/ir.h"
 #include "mpc/mpc.h"
 #include "nemo/common.hpp"
 
-bool evaluate(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx);
\ No newline at end of file
+// Creates the global context of a session with the builtins registered.
+// Every program evaluated in a session is compiled against its symbol table,
+// so builtins are registered once and globals keep their slots.
+std::shared_ptr<ScopeContext> createGlobalContext();
+
+// Compiles a parsed Nemo program against the context's symbol table. The
+// program is owned by the context; returns nullptr on a compile error.
+const nemo::ir::Program *compile(const mpc_ast_t *ast,
+                                 std::shared_ptr<ScopeContext> ctx);
+
+bool evaluate(const nemo::ir::Program &program,
+              std::shared_ptr<ScopeContext> ctx);
+bool evaluate(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ir/ir.h"
+#include "nemo/common.hpp"
+
+// Binary operators.
+//
+// The handler of an operator is found in a table indexed by the operator
+// and the types of both operands, so applying one is two loads and an
+// indirect call. Like a pipeline stage, it replaces the left operand, the
+// running result, in place. Operands of different types, and a zero divisor,
+// print an error and end the script; an operator a type does not define
+// gives None.
+//
+// + - * / % apply to numbers and chars, wrapping on overflow, and + also
+// concatenates strings and collections. Dividing the smallest number by -1
+// wraps to itself, with a remainder of 0. < <= >= > compare numbers, chars
+// and strings; = compares values of any type, collections, records and
+// tables element by element, maps key by key and lambdas by identity.
+// Comparisons give the number 1 or 0.
+namespace nemo::operators {
+
+using Kind = nemo::ir::Operator::Kind;
+
+// Thrown by / and % with a zero divisor. It passes through lambdas and
+// builtins; evaluate() reports it and ends the script.
+struct DivisionByZero {};
+
+void apply(Kind op, NemoType &a, const NemoType &b, ScopeContext &ctx);
+
+inline int divide(int a, int b) {
+  if (b == 0) [[unlikely]] {
+    throw DivisionByZero{};
+  }
+  return b == -1 ? static_cast<int>(0u - static_cast<unsigned>(a)) : a / b;
+}
+
+inline int remainder(int a, int b) {
+  if (b == 0) [[unlikely]] {
+    throw DivisionByZero{};
+  }
+  return b == -1 ? 0 : a % b;
+}
+
+// op on two numbers, for operands known to be numbers.
+inline int apply(Kind op, int a, int b) {
+  const auto x = static_cast<unsigned>(a);
+  const auto y = static_cast<unsigned>(b);
+  switch (op) {
+  case Kind::Add:
+    return static_cast<int>(x + y);
+  case Kind::Subtract:
+    return static_cast<int>(x - y);
+  case Kind::Multiply:
+    return static_cast<int>(x * y);
+  case Kind::Divide:
+    return divide(a, b);
+  case Kind::Modulo:
+    return remainder(a, b);
+  case Kind::Less:
+    return a < b;
+  case Kind::LessEqual:
+    return a <= b;
+  case Kind::Equal:
+    return a == b;
+  case Kind::GreaterEqual:
+    return a >= b;
+  case Kind::Greater:
+    return a > b;
+  }
+  return 0;
+}
+
+} // namespace nemo::operators
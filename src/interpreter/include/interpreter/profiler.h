@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+
+// Sampling profiler for Nemo scripts.
+//
+// The evaluator keeps a small stack of Nemo-level frames (statement, pipeline
+// stage, builtin) up to date while it runs. When profiling is enabled a
+// SIGPROF timer copies that stack into a preallocated sample buffer, and the
+// samples are turned into flamegraph-compatible folded stacks such as
+//
+//   script.nemo:3;stage 2 range;range 42
+//
+// Samples only hold pointers to names owned by the compiled program, so they
+// are resolved by collect() while the context that owns it is still alive.
+namespace nemo::profiler {
+
+enum class FrameKind { Statement, Stage, Builtin };
+
+struct Frame {
+  FrameKind kind;
+  const char *name;
+  int line;
+  int index;
+};
+
+extern bool enabled;
+
+void push(FrameKind kind, const char *name, int line, int index);
+void pop();
+
+// RAII helper used by the evaluator. Costs a single branch when profiling is
+// disabled.
+class Scope {
+public:
+  Scope(FrameKind kind, const char *name, int line, int index = 0)
+      : active(enabled) {
+    if (active) [[unlikely]] {
+      push(kind, name, line, index);
+    }
+  }
+
+  ~Scope() {
+    if (active) [[unlikely]] {
+      pop();
+    }
+  }
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  bool active;
+};
+
+// Starts sampling at the given interval. Folded stacks are written to
+// outputPath by stop().
+bool start(const std::string &outputPath, int intervalUs = 1000);
+
+// Names the script whose statements are evaluated next.
+void setScript(const std::string &name);
+
+// Resolves pending samples to folded stacks. Must be called before the
+// context whose programs were being evaluated is destroyed.
+void collect();
+
+// Stops sampling, collects remaining samples and writes the output file.
+void stop();
+
+} // namespace nemo::profiler
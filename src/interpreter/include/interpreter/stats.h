@@ -0,0 +1,43 @@
+#pragma once
+
+#include "nemo/common.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Per-builtin call counters.
+//
+// Instrumentation is decided when builtins are registered: with stats
+// disabled the builtin is registered as is, so the call path is unchanged.
+// With stats enabled every builtin is wrapped in a closure that records
+// call count, latency, the bytes it allocated for Nemo values and element
+// counts. The dump also includes the per-kind totals of nemo::memory and
+// the chunk and pause counters of the session heap.
+namespace nemo::stats {
+
+struct BuiltinStats {
+  uint64_t calls = 0;
+  uint64_t totalNs = 0;
+  uint64_t maxNs = 0;
+  uint64_t bytesAllocated = 0;
+  uint64_t elementsIn = 0;
+  uint64_t elementsOut = 0;
+};
+
+using Builtin = std::function<NemoType(std::vector<NemoType>)>;
+
+extern bool enabled;
+
+// Returns func unchanged when stats are disabled, otherwise a wrapper that
+// records into the table entry for name.
+Builtin instrument(const std::string &name, Builtin func);
+
+const std::map<std::string, BuiltinStats> &builtins();
+
+void dumpJson(std::ostream &out);
+
+} // namespace nemo::stats
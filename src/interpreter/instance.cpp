@@ -0,0 +1,98 @@
+#include "interpreter/instance.h"
+#include "interpreter/interpreter.h"
+#include "mpc/mpc.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+namespace nemo {
+
+namespace {
+
+// Thrown by the exit builtin of an instance. It does not derive from
+// std::exception so that the evaluator's error handling lets it through.
+struct ExitRequest {
+  int code;
+};
+
+} // namespace
+
+Interpreter::Interpreter(std::ostream &output, size_t memoryLimit)
+    : grammar(grammar_new()) {
+  if (grammar == nullptr) {
+    throw std::runtime_error("could not load the Nemo grammar");
+  }
+  accounting.limit = memoryLimit;
+
+  memory::Use use(accounting);
+  globals = createGlobalContext();
+  globals->setOutput(output);
+  globals->setExitHandler([](int code) { throw ExitRequest{code}; });
+}
+
+Interpreter::~Interpreter() {
+  // Values held by the globals were charged to this instance.
+  memory::Use use(accounting);
+  globals.reset();
+  grammar_delete(grammar);
+}
+
+bool Interpreter::run(const std::string &name, const std::string &source) {
+  const auto *program = compile(name, source);
+  return program != nullptr && run(*program);
+}
+
+const ir::Program *Interpreter::compile(const std::string &name,
+                                        const std::string &source) {
+  memory::Use use(accounting);
+
+  mpc_result_t r;
+  if (!mpc_parse(name.c_str(), source.c_str(), grammar->nemo, &r)) {
+    char *message = mpc_err_string(r.error);
+    globals->output() << message;
+    free(message);
+    mpc_err_delete(r.error);
+    return nullptr;
+  }
+
+  const auto *program =
+      ::compile(static_cast<const mpc_ast_t *>(r.output), globals);
+  mpc_ast_delete(static_cast<mpc_ast_t *>(r.output));
+  return program;
+}
+
+bool Interpreter::run(const ir::Program &program) {
+  memory::Use use(accounting);
+  exited.reset();
+
+  try {
+    return evaluate(program, globals);
+  } catch (const ExitRequest &request) {
+    exited = request.code;
+    return true;
+  } catch (const std::exception &e) {
+    globals->output() << "Error: " << e.what() << std::endl;
+    return false;
+  }
+}
+
+void Interpreter::registerFunction(const std::string &name,
+                                   ScopeContext::Function func) {
+  globals->registerFunction(name, std::move(func));
+}
+
+void Interpreter::setGlobal(const std::string &name, NemoType value) {
+  memory::Use use(accounting);
+  globals->bind(name, std::move(value));
+}
+
+std::optional<NemoType> Interpreter::global(const std::string &name) {
+  memory::Use use(accounting);
+  const auto binding = globals->symbolTable().lookupGlobal(name);
+  if (binding.kind != ir::Binding::Kind::Global) {
+    return std::nullopt;
+  }
+  return globals->global(binding.index);
+}
+
+} // namespace nemo
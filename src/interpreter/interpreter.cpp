@@ -1,33 +1,125 @@
 #include "interpreter/interpreter.h"
+#include "interpreter/closure.h"
+#include "interpreter/operators.h"
+#include "interpreter/profiler.h"
+#include "interpreter/stats.h"
+#include "ir/ir.h"
 #include "mpc/mpc.h"
 #include "nemo/common.hpp"
+#include "nemo/native.hpp"
+#include "nemo/sort.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <span>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+using nemo::ir::Binding;
+
 void registerBuiltinFunctions(std::shared_ptr<ScopeContext> ctx);
-void eval(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx);
-void eval_assignment(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx);
-NemoType eval_pipeline(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx);
-NemoType eval_expression(const mpc_ast_t *ast,
+NemoType eval(const nemo::ir::Statement &statement,
+              std::shared_ptr<ScopeContext> ctx);
+void eval_assignment(const nemo::ir::Assignment &assignment,
+                     std::shared_ptr<ScopeContext> ctx);
+NemoType eval_pipeline(const nemo::ir::Pipeline &pipeline,
+                       std::shared_ptr<ScopeContext> ctx);
+NemoType eval_stages(const nemo::ir::Pipeline &pipeline, size_t count,
+                     std::shared_ptr<ScopeContext> ctx);
+NemoType eval_expression(const nemo::ir::Expression &expression,
                          std::shared_ptr<ScopeContext> ctx,
-                         std::vector<NemoType> args);
+                         std::span<NemoType> args,
+                         nemo::ir::CallCache *cache = nullptr);
+NemoType eval_block(const std::vector<nemo::ir::Statement> &statements,
+                    std::shared_ptr<ScopeContext> ctx,
+                    const nemo::ir::Statement **tail = nullptr);
+
+NemoType call_lambda(const nemo::ir::Lambda &lambda, std::span<NemoType> args,
+                     std::shared_ptr<ScopeContext> ctx,
+                     nemo::ir::CallCache *cache);
+NemoType apply_lambda(const nemo::ir::Lambda &lambda,
+                      std::span<NemoType> args,
+                      std::shared_ptr<ScopeContext> ctx,
+                      nemo::ir::CallCache *cache);
+NemoType apply_builtin(const nemo::ir::Identifier &identifier, int row,
+                       std::span<NemoType> args,
+                       std::shared_ptr<ScopeContext> ctx);
+
+void defineRecordType(std::shared_ptr<ScopeContext> ctx,
+                      const nemo::ir::TypeDefinition &definition);
+
+// Thrown by a lambda call nested deeper than ScopeContext::maxCallDepth. It
+// passes through lambdas and builtins; evaluate() reports it and stops.
+struct CallDepthExceeded {};
+
+std::shared_ptr<ScopeContext> createGlobalContext() {
+  auto ctx = std::make_shared<ScopeContext>();
+  registerBuiltinFunctions(ctx);
+  return ctx;
+}
 
-NemoType eval_operator(const NemoType &op1, const NemoType &op2,
-                       const std::string &op);
+const nemo::ir::Program *compile(const mpc_ast_t *ast,
+                                 std::shared_ptr<ScopeContext> ctx) {
+  try {
+    nemo::ir::Parser parser(ctx->symbolTable());
+    const auto &program = ctx->adopt(parser.parse(ast));
+    // Record layouts are fixed here, before any statement of the program
+    // runs.
+    for (const auto &statement : program.statements) {
+      if (const auto *definition =
+              std::get_if<nemo::ir::TypeDefinition>(&statement.statement)) {
+        defineRecordType(ctx, *definition);
+      }
+    }
+    return &program;
+  } catch (const std::exception &e) {
+    ctx->output() << "Error: " << e.what() << std::endl;
+    return nullptr;
+  }
+}
 
-bool evaluate(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx) {
+bool evaluate(const nemo::ir::Program &program,
+              std::shared_ptr<ScopeContext> ctx) {
+  try {
+    for (const auto &statement : program.statements) {
+      eval(statement, ctx);
+      // Between statements only live values hold heap blocks.
+      nemo::memory::collect();
+    }
+  } catch (const nemo::memory::LimitExceeded &e) {
+    nemo::profiler::collect();
+    ctx->output() << "Error: " << e.what() << std::endl;
+    return false;
+  } catch (const CallDepthExceeded &) {
+    nemo::profiler::collect();
+    ctx->output() << "Error: maximum call depth of "
+                  << ScopeContext::maxCallDepth << " exceeded" << std::endl;
+    return false;
+  } catch (const nemo::operators::DivisionByZero &) {
+    nemo::profiler::collect();
+    ctx->output() << "Division by zero" << std::endl;
+    ctx->exit(0);
+    return false;
+  }
 
-  registerBuiltinFunctions(ctx);
+  nemo::profiler::collect();
 
-  for (int i = 0; i < ast->children_num; i++) {
-    eval(ast->children[i], ctx);
+  return true;
+}
+
+bool evaluate(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx) {
+  const auto *program = compile(ast, ctx);
+  if (program == nullptr) {
+    return false;
   }
 
-  return true;
+  return evaluate(*program, ctx);
 }
 
 std::string typeToString(BuiltinType type) {
@@ -42,6 +134,14 @@ std::string typeToString(BuiltinType type) {
     return "lambda";
   case BuiltinType::COLLECTION:
     return "collection";
+  case BuiltinType::ARRAY:
+    return "array";
+  case BuiltinType::RECORD:
+    return "record";
+  case BuiltinType::TABLE:
+    return "table";
+  case BuiltinType::MAP:
+    return "map";
   case BuiltinType::VOID:
     return "void";
   default:
@@ -49,367 +149,1633 @@ std::string typeToString(BuiltinType type) {
   }
 }
 
-void registerBuiltinFunctions(std::shared_ptr<ScopeContext> ctx) {
-  ctx->registerFunction("print", [](std::vector<NemoType> args) {
-    for (const auto &arg : args) {
-      arg.print();
-    }
+void registerBuiltin(std::shared_ptr<ScopeContext> ctx, const std::string &name,
+                     nemo::stats::Builtin func) {
+  ctx->registerFunction(name, nemo::stats::instrument(name, std::move(func)));
+}
 
-    return voidType();
+// Registers a builtin with a typed signature, see nemo/native.hpp. With stats
+// enabled it is boxed like the others so that it can be instrumented.
+template <typename Signature>
+void registerBuiltin(std::shared_ptr<ScopeContext> ctx, const std::string &name,
+                     typename nemo::native::Traits<Signature>::Pointer fn) {
+  if (!nemo::stats::enabled) {
+    nemo::native::registerNative<Signature>(*ctx, name, fn);
+    return;
+  }
+
+  const auto [thunk, native] = nemo::native::erase<Signature>(fn);
+  const auto index = ctx->symbolTable().declareBuiltin(name);
+  auto *context = ctx.get();
+  registerBuiltin(ctx, name, [=](std::vector<NemoType> args) {
+    return thunk(*context, index, native, args);
   });
+}
 
-  ctx->registerFunction("println", [](std::vector<NemoType> args) {
-    for (const auto &arg : args) {
-      arg.print();
+// Builds the map a builtin returns. The first key decides whether the map
+// has number, char or string keys, and every later key must be of the same
+// kind.
+class MapBuilder {
+public:
+  explicit MapBuilder(std::string function) : function(std::move(function)) {}
+
+  // Checks that a key of type fits the map, creating the map for the first
+  // key.
+  NemoHashMap &check(BuiltinType type) {
+    NemoHashMap::Keys kind;
+    switch (type) {
+    case BuiltinType::INT:
+      kind = NemoHashMap::Keys::Number;
+      break;
+    case BuiltinType::CHAR:
+      kind = NemoHashMap::Keys::Char;
+      break;
+    case BuiltinType::STRING:
+      kind = NemoHashMap::Keys::String;
+      break;
+    default:
+      throw std::runtime_error(function +
+                               " function takes number, char or string keys, "
+                               "but got " +
+                               typeToString(type));
     }
-    std::cout << std::endl;
-    return voidType();
-  });
 
-  ctx->registerFunction("exit", [](std::vector<NemoType> args) {
-    if (args.size() != 1) {
-      throw std::runtime_error("exit function takes exactly one argument");
+    if (map == nullptr) {
+      map = std::make_shared<NemoHashMap>(kind);
+    } else if (map->keys() != kind) {
+      throw std::runtime_error(function +
+                               " function takes keys of one type, but got " +
+                               typeToString(type) + " among other keys");
     }
+    return *map;
+  }
 
-    const auto &arg = args[0];
+  // The value of key, and whether the key is new.
+  std::pair<NemoType &, bool> emplace(const NemoType &key) {
+    auto &table = check(key.type);
+    switch (key.type) {
+    case BuiltinType::INT:
+      return table.emplace(std::get<int>(key.value.value()));
+    case BuiltinType::CHAR:
+      return table.emplace(std::get<char>(key.value.value()));
+    default:
+      const auto &string = std::get<NemoString>(key.value.value());
+      return table.emplace(std::string_view(string.data(), string.size()));
+    }
+  }
 
-    if (arg.type != BuiltinType::INT) {
-      throw std::runtime_error(
-          "exit function takes an integer argument, but got " +
-          typeToString(arg.type));
+  NemoType build() {
+    if (map == nullptr) {
+      map = std::make_shared<NemoHashMap>(NemoHashMap::Keys::Number);
+    }
+    return mapType(NemoMap{std::move(map)});
+  }
+
+private:
+  std::string function;
+  std::shared_ptr<NemoHashMap> map;
+};
+
+// The key and value of an element of a collection of [key value] pairs.
+NemoCollection &pairOf(NemoType &element, const std::string &function) {
+  if (element.type != BuiltinType::COLLECTION ||
+      element.collection.value().size() != 2) {
+    throw std::runtime_error(function +
+                             " function takes a collection of [key value] "
+                             "pairs, but got " +
+                             typeToString(element.type) + " in it");
+  }
+  return element.collection.value();
+}
+
+void count(std::pair<NemoType &, bool> entry) {
+  if (entry.second) {
+    entry.first = numberType(1);
+  } else {
+    ++*std::get_if<int>(&*entry.first.value);
+  }
+}
+
+// The value of key in map, null when the map has no such key.
+const NemoType *lookupKey(const NemoHashMap &map, const NemoType &key) {
+  switch (key.type) {
+  case BuiltinType::INT:
+    return map.keys() == NemoHashMap::Keys::Number
+               ? map.find(std::get<int>(key.value.value()))
+               : nullptr;
+  case BuiltinType::CHAR:
+    return map.keys() == NemoHashMap::Keys::Char
+               ? map.find(std::get<char>(key.value.value()))
+               : nullptr;
+  case BuiltinType::STRING: {
+    const auto &string = std::get<NemoString>(key.value.value());
+    return map.keys() == NemoHashMap::Keys::String
+               ? map.find(std::string_view(string.data(), string.size()))
+               : nullptr;
+  }
+  default:
+    return nullptr;
+  }
+}
+
+// Scratch space of the sorting builtins, charged to collections.
+template <typename T>
+using SortBuffer =
+    std::vector<T, nemo::memory::Allocator<T, nemo::memory::Kind::Collection>>;
+
+std::string_view textOf(const NemoType &value) {
+  const auto &string = std::get<NemoString>(value.value.value());
+  return std::string_view(string.data(), string.size());
+}
+
+// The type of elements of type `type`, VOID for none, once an element of type
+// `element` joins them. Throws unless they are all numbers, all chars or all
+// strings.
+BuiltinType joinElement(BuiltinType type, BuiltinType element,
+                        const std::string &function) {
+  if (element != BuiltinType::INT && element != BuiltinType::CHAR &&
+      element != BuiltinType::STRING) {
+    throw std::runtime_error(function +
+                             " function takes numbers, chars or strings, but "
+                             "got " +
+                             typeToString(element));
+  }
+  if (type != BuiltinType::VOID && type != element) {
+    throw std::runtime_error(function +
+                             " function takes elements of one type, but got " +
+                             typeToString(element) + " among other elements");
+  }
+  return element;
+}
+
+// The type of the elements of values from first on.
+BuiltinType elementType(const NemoCollection &values, size_t first,
+                        const std::string &function) {
+  auto type = BuiltinType::VOID;
+  for (size_t i = first; i < values.size(); i++) {
+    type = joinElement(type, values[i].type, function);
+  }
+  return type;
+}
+
+// Sorts numbers by radix sort.
+void sortNumbers(int *numbers, size_t n) {
+  SortBuffer<uint32_t> keys(2 * n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = nemo::sort::numberKey(numbers[i]);
+  }
+  nemo::sort::parallelSort(keys.data(), keys.data() + n, n,
+                           nemo::sort::radixSort<uint32_t>, std::less<>());
+  for (size_t i = 0; i < n; i++) {
+    numbers[i] = nemo::sort::numberOf(keys[i]);
+  }
+}
+
+// The order of n rows sorted by numberOf(row), keeping rows with equal numbers
+// in order. The numbers are radix sorted together with their rows.
+template <typename NumberOf>
+SortBuffer<size_t> orderByNumbers(size_t n, NumberOf numberOf) {
+  SortBuffer<uint64_t> keys(2 * n);
+  for (size_t row = 0; row < n; row++) {
+    keys[row] = nemo::sort::rowKey(numberOf(row), row);
+  }
+  nemo::sort::parallelSort(keys.data(), keys.data() + n, n,
+                           nemo::sort::radixSort<uint64_t>, std::less<>());
+  SortBuffer<size_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = nemo::sort::rowOf(keys[i]);
+  }
+  return order;
+}
+
+// The order of n rows sorted by textOf(row), keeping rows with equal strings in
+// order.
+template <typename TextOf>
+SortBuffer<size_t> orderByStrings(size_t n, TextOf textOf) {
+  SortBuffer<nemo::sort::StringKey> keys;
+  keys.reserve(n);
+  for (size_t row = 0; row < n; row++) {
+    keys.emplace_back(textOf(row), row);
+  }
+  auto buffer = keys;
+  nemo::sort::parallelSort(
+      keys.data(), buffer.data(), n,
+      [](nemo::sort::StringKey *items, nemo::sort::StringKey *, size_t count) {
+        nemo::sort::pdqsort(items, items + count, std::less<>());
+      },
+      std::less<>());
+  SortBuffer<size_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = keys[i].index;
+  }
+  return order;
+}
+
+// The order of n rows sorted by keyOf(row), a number, char or string of the
+// given type.
+template <typename KeyOf>
+SortBuffer<size_t> orderRows(size_t n, BuiltinType type, KeyOf keyOf) {
+  switch (type) {
+  case BuiltinType::INT:
+    return orderByNumbers(n, [&](size_t row) {
+      return std::get<int>(keyOf(row).value.value());
+    });
+  case BuiltinType::CHAR:
+    return orderByNumbers(n, [&](size_t row) {
+      return std::get<char>(keyOf(row).value.value());
+    });
+  case BuiltinType::STRING:
+    return orderByStrings(n, [&](size_t row) { return textOf(keyOf(row)); });
+  default:
+    return SortBuffer<size_t>();
+  }
+}
+
+NemoCollection gather(NemoCollection &values, const SortBuffer<size_t> &order) {
+  NemoCollection sorted;
+  sorted.reserve(order.size());
+  for (const auto index : order) {
+    sorted.push_back(std::move(values[index]));
+  }
+  return sorted;
+}
+
+// The field a row of sort_by is sorted by.
+const NemoType &firstOf(const NemoType &row) {
+  if ((row.type != BuiltinType::COLLECTION &&
+       row.type != BuiltinType::RECORD) ||
+      row.collection.value().empty()) {
+    throw std::runtime_error(
+        "sort_by function takes rows that are non-empty collections or "
+        "records, but got " +
+        typeToString(row.type) + " in it");
+  }
+  return row.collection.value()[0];
+}
+
+// A table with the rows of table sorted by its first field.
+NemoTable sortTable(const NemoTable &table) {
+  const auto &columns = *table.columns;
+  const auto order = std::visit(
+      [&](const auto &column) {
+        using Column = std::decay_t<decltype(column)>;
+        if constexpr (std::is_same_v<Column, NemoCollection>) {
+          return orderRows(table.rows, elementType(column, 0, "sort_by"),
+                           [&](size_t row) -> const NemoType & {
+                             return column[row];
+                           });
+        } else {
+          return orderByNumbers(table.rows, [&](size_t row) {
+            return static_cast<int>(column[row]);
+          });
+        }
+      },
+      columns[0]);
+
+  auto sorted = std::make_shared<std::vector<NemoColumn>>();
+  sorted->reserve(columns.size());
+  for (const auto &column : columns) {
+    sorted->push_back(std::visit(
+        [&](const auto &values) -> NemoColumn {
+          std::decay_t<decltype(values)> column;
+          column.reserve(order.size());
+          for (const auto row : order) {
+            column.push_back(values[row]);
+          }
+          return column;
+        },
+        column));
+  }
+  return NemoTable{table.type, table.rows, std::move(sorted)};
+}
+
+// Remembers the numbers, chars or strings unique has seen.
+class Seen {
+  using Set = nemo::map::HashMap<char>;
+
+public:
+  explicit Seen(BuiltinType type)
+      : keys(type == BuiltinType::STRING ? Set::Keys::String
+                                         : Set::Keys::Number) {}
+
+  // Whether key is seen for the first time.
+  bool first(int key) { return keys.emplace(key).second; }
+  bool first(char key) {
+    return !std::exchange(chars[static_cast<unsigned char>(key)], true);
+  }
+  bool first(std::string_view key) { return keys.emplace(key).second; }
+  bool first(const NemoType &key) {
+    switch (key.type) {
+    case BuiltinType::INT:
+      return first(std::get<int>(key.value.value()));
+    case BuiltinType::CHAR:
+      return first(std::get<char>(key.value.value()));
+    default:
+      return first(textOf(key));
+    }
+  }
+
+private:
+  Set keys;
+  std::array<bool, 256> chars{};
+};
+
+void registerBuiltinFunctions(std::shared_ptr<ScopeContext> ctx) {
+  // The context owns its builtins, so they refer back to it by plain pointer.
+  auto *context = ctx.get();
+
+  registerBuiltin(ctx, "print", [context](std::vector<NemoType> args) {
+    for (const auto &arg : args) {
+      arg.print(context->output());
     }
 
-    const auto exitCode = std::get<int>(arg.value.value());
-    exit(exitCode);
     return voidType();
   });
 
-  ctx->registerFunction("len", [](std::vector<NemoType> args) {
-    if (args.size() != 1) {
-      throw std::runtime_error("len function takes exactly one argument");
+  registerBuiltin(ctx, "println", [context](std::vector<NemoType> args) {
+    for (const auto &arg : args) {
+      arg.print(context->output());
     }
+    context->output() << std::endl;
+    return voidType();
+  });
 
-    const auto &arg = args[0];
+  registerBuiltin<void(ScopeContext &, int)>(
+      ctx, "exit",
+      [](ScopeContext &context, int exitCode) { context.exit(exitCode); });
 
-    if (arg.type != BuiltinType::COLLECTION &&
-        arg.type != BuiltinType::STRING) {
+  registerBuiltin<int(const NemoType &)>(ctx, "len", [](const NemoType &arg) {
+    switch (arg.type) {
+    case BuiltinType::COLLECTION:
+      return static_cast<int>(arg.collection.value().size());
+    case BuiltinType::STRING:
+      return static_cast<int>(std::get<NemoString>(arg.value.value()).size());
+    case BuiltinType::ARRAY:
+      return static_cast<int>(std::get<NemoArray>(arg.value.value()).size);
+    case BuiltinType::TABLE:
+      return static_cast<int>(std::get<NemoTable>(arg.value.value()).rows);
+    case BuiltinType::MAP:
+      return static_cast<int>(
+          std::get<NemoMap>(arg.value.value()).table->size());
+    default:
       throw std::runtime_error(
           "len function takes a collection or string argument, but got " +
           typeToString(arg.type));
     }
+  });
 
-    return [&]() {
-      if (arg.type == BuiltinType::COLLECTION) {
-        return numberType(arg.collection.value().size());
-      } else {
-        return numberType(std::get<std::string>(arg.value.value()).size());
+  registerBuiltin<int(const NemoType &)>(ctx, "sum", [](const NemoType &arg) {
+    if (arg.type == BuiltinType::ARRAY) {
+      const auto &array = std::get<NemoArray>(arg.value.value());
+      if (array.element != NemoArray::Element::Number) {
+        throw std::runtime_error("sum function takes an array of numbers");
       }
-    }();
-  });
 
-  ctx->registerFunction("sum", [](std::vector<NemoType> args) {
-    if (args.size() != 1) {
-      throw std::runtime_error("sum function takes exactly one argument");
+      int partialSum = 0;
+      for (size_t i = 0; i < array.size; i++) {
+        partialSum += array.numbers()[i];
+      }
+      return partialSum;
     }
 
-    if (args[0].type != BuiltinType::COLLECTION) {
+    if (arg.type != BuiltinType::COLLECTION) {
       throw std::runtime_error(
           "sum function takes a collection argument, but got " +
-          typeToString(args[0].type));
+          typeToString(arg.type));
     }
 
     int partialSum = 0;
-    for (const auto &arg : args[0].collection.value()) {
-      if (arg.type != BuiltinType::INT) {
-        voidType();
-      }
-
-      partialSum += std::get<int>(arg.value.value());
+    for (const auto &element : arg.collection.value()) {
+      partialSum += std::get<int>(element.value.value());
     }
 
-    return numberType(partialSum);
+    return partialSum;
   });
 
-  ctx->registerFunction("to_string", [](std::vector<NemoType> args) {
-    if (args.size() != 1) {
-      throw std::runtime_error("to_string function takes exactly one argument");
-    }
+  registerBuiltin<NemoType(const NemoType &)>(
+      ctx, "to_string", [](const NemoType &arg) {
+        switch (arg.type) {
+        case BuiltinType::INT:
+          return stringType(std::to_string(std::get<int>(arg.value.value())));
+        case BuiltinType::CHAR:
+          return stringType(std::string(1, std::get<char>(arg.value.value())));
+        case BuiltinType::STRING:
+          return arg;
+        default:
+          return voidType();
+        }
+      });
+
+  // joins collection of characters into a string
+  registerBuiltin<NemoType(const NemoType &)>(
+      ctx, "join", [](const NemoType &arg) {
+        if (arg.type == BuiltinType::ARRAY) {
+          const auto &array = std::get<NemoArray>(arg.value.value());
+          if (array.element != NemoArray::Element::Char) {
+            throw std::runtime_error("join function takes an array of chars");
+          }
+          return stringType(std::string_view(array.chars(), array.size));
+        }
+
+        if (arg.type != BuiltinType::COLLECTION) {
+          throw std::runtime_error(
+              "join function takes a collection argument, but got " +
+              typeToString(arg.type));
+        }
+
+        NemoString result;
+        for (const auto &element : arg.collection.value()) {
+          result += std::get<char>(element.value.value());
+        }
 
-    const auto &arg = args[0];
+        return stringType(std::move(result));
+      });
 
+  registerBuiltin<NemoCollection(const NemoCollection &)>(
+      ctx, "range", [](const NemoCollection &bounds) {
+        if (bounds.size() == 0 || bounds.size() > 3) {
+          throw std::runtime_error(
+              "range function takes a collection of size 1, 2 or 3");
+        }
+        for (const auto &bound : bounds) {
+          if (bound.type != BuiltinType::INT) {
+            throw std::runtime_error(
+                "range function takes a collection of integers");
+          }
+        }
+
+        auto start = 0;
+        auto end = 0;
+        auto step = 1;
+
+        if (bounds.size() == 1) {
+          end = std::get<int>(bounds[0].value.value());
+        } else {
+          start = std::get<int>(bounds[0].value.value());
+          end = std::get<int>(bounds[1].value.value());
+          if (bounds.size() == 3) {
+            step = std::get<int>(bounds[2].value.value());
+          }
+        }
+
+        // generate range from start end and step
+        NemoCollection range;
+        for (auto i = start; i < end; i += step) {
+          range.push_back(numberType(i));
+        }
+
+        return range;
+      });
+
+  // Counts how many times each key occurs in a collection, array or string.
+  registerBuiltin<NemoType(const NemoType &)>(
+      ctx, "count_by", [](const NemoType &keys) {
+        MapBuilder counts("count_by");
+        if (keys.type == BuiltinType::ARRAY) {
+          const auto &array = std::get<NemoArray>(keys.value.value());
+          if (array.element == NemoArray::Element::Number) {
+            auto &table = counts.check(BuiltinType::INT);
+            for (size_t i = 0; i < array.size; i++) {
+              count(table.emplace(array.numbers()[i]));
+            }
+          } else {
+            auto &table = counts.check(BuiltinType::CHAR);
+            for (size_t i = 0; i < array.size; i++) {
+              count(table.emplace(array.chars()[i]));
+            }
+          }
+        } else if (keys.type == BuiltinType::STRING) {
+          auto &table = counts.check(BuiltinType::CHAR);
+          for (const auto c : std::get<NemoString>(keys.value.value())) {
+            count(table.emplace(c));
+          }
+        } else if (keys.type == BuiltinType::COLLECTION) {
+          for (const auto &key : keys.collection.value()) {
+            count(counts.emplace(key));
+          }
+        } else {
+          throw std::runtime_error(
+              "count_by function takes a collection, array or string, but "
+              "got " +
+              typeToString(keys.type));
+        }
+        return counts.build();
+      });
+
+  // Collects the values of [key value] pairs by key.
+  registerBuiltin<NemoType(NemoCollection)>(
+      ctx, "group_by", [](NemoCollection pairs) {
+        MapBuilder groups("group_by");
+        for (auto &element : pairs) {
+          auto &pair = pairOf(element, "group_by");
+          auto [group, added] = groups.emplace(pair[0]);
+          if (added) {
+            group = collectionType(NemoCollection{});
+          }
+          group.collection.value().push_back(std::move(pair[1]));
+        }
+        return groups.build();
+      });
+
+  // A map of [key value] pairs, to look keys up in by piping them into it. A
+  // key given twice keeps its last value.
+  registerBuiltin<NemoType(NemoCollection)>(
+      ctx, "lookup", [](NemoCollection pairs) {
+        MapBuilder entries("lookup");
+        for (auto &element : pairs) {
+          auto &pair = pairOf(element, "lookup");
+          entries.emplace(pair[0]).first = std::move(pair[1]);
+        }
+        return entries.build();
+      });
+
+  registerBuiltin<NemoCollection(const NemoType &)>(
+      ctx, "keys", [](const NemoType &arg) {
+        if (arg.type != BuiltinType::MAP) {
+          throw std::runtime_error("keys function takes a map, but got " +
+                                   typeToString(arg.type));
+        }
+        const auto &map = *std::get<NemoMap>(arg.value.value()).table;
+        NemoCollection keys;
+        keys.reserve(map.size());
+        for (size_t i = 0; i < map.size(); i++) {
+          switch (map.keys()) {
+          case NemoHashMap::Keys::Number:
+            keys.push_back(numberType(map.numberKey(i)));
+            break;
+          case NemoHashMap::Keys::Char:
+            keys.push_back(charType(static_cast<char>(map.numberKey(i))));
+            break;
+          case NemoHashMap::Keys::String:
+            keys.push_back(stringType(map.stringKey(i)));
+            break;
+          }
+        }
+        return keys;
+      });
+
+  registerBuiltin<NemoCollection(const NemoType &)>(
+      ctx, "values", [](const NemoType &arg) {
+        if (arg.type != BuiltinType::MAP) {
+          throw std::runtime_error("values function takes a map, but got " +
+                                   typeToString(arg.type));
+        }
+        const auto &map = *std::get<NemoMap>(arg.value.value()).table;
+        NemoCollection values;
+        values.reserve(map.size());
+        for (size_t i = 0; i < map.size(); i++) {
+          values.push_back(map.value(i));
+        }
+        return values;
+      });
+
+  // Sorts the numbers, chars or strings of a collection, array or string.
+  registerBuiltin<NemoType(NemoType)>(ctx, "sort", [](NemoType arg) {
     switch (arg.type) {
-    case BuiltinType::INT:
-      return stringType(std::to_string(std::get<int>(arg.value.value())));
-    case BuiltinType::CHAR:
-      return stringType(std::string(1, std::get<char>(arg.value.value())));
-    case BuiltinType::STRING:
+    case BuiltinType::ARRAY: {
+      const auto &array = std::get<NemoArray>(arg.value.value());
+      if (array.element == NemoArray::Element::Number) {
+        auto numbers = std::make_shared<NemoNumbers>(
+            array.numbers(), array.numbers() + array.size);
+        sortNumbers(numbers->data(), numbers->size());
+        return arrayType(NemoArray{
+            array.element,
+            std::shared_ptr<const void>(numbers, numbers->data()),
+            numbers->size()});
+      }
+      auto chars = std::make_shared<NemoChars>(array.chars(),
+                                               array.chars() + array.size);
+      nemo::sort::countingSort(chars->data(), chars->size());
+      return arrayType(NemoArray{
+          array.element, std::shared_ptr<const void>(chars, chars->data()),
+          chars->size()});
+    }
+    case BuiltinType::STRING: {
+      auto &string = std::get<NemoString>(arg.value.value());
+      nemo::sort::countingSort(string.data(), string.size());
       return arg;
+    }
+    case BuiltinType::COLLECTION: {
+      auto &values = arg.collection.value();
+      switch (elementType(values, 0, "sort")) {
+      case BuiltinType::INT: {
+        SortBuffer<int> numbers;
+        numbers.reserve(values.size());
+        for (const auto &value : values) {
+          numbers.push_back(std::get<int>(value.value.value()));
+        }
+        sortNumbers(numbers.data(), numbers.size());
+        for (size_t i = 0; i < values.size(); i++) {
+          values[i].value = numbers[i];
+        }
+        return arg;
+      }
+      case BuiltinType::CHAR: {
+        SortBuffer<char> chars;
+        chars.reserve(values.size());
+        for (const auto &value : values) {
+          chars.push_back(std::get<char>(value.value.value()));
+        }
+        nemo::sort::countingSort(chars.data(), chars.size());
+        for (size_t i = 0; i < values.size(); i++) {
+          values[i].value = chars[i];
+        }
+        return arg;
+      }
+      case BuiltinType::STRING:
+        return collectionType(
+            gather(values, orderByStrings(values.size(), [&](size_t i) {
+                     return textOf(values[i]);
+                   })));
+      default:
+        return arg;
+      }
+    }
     default:
-      return voidType();
+      throw std::runtime_error(
+          "sort function takes a collection, array or string, but got " +
+          typeToString(arg.type));
     }
   });
 
-  ctx->registerFunction("join", [](std::vector<NemoType> args) {
-    // joins collection of characters into a string
-    if (args.size() != 1) {
-      throw std::runtime_error("join function takes exactly one argument");
+  // Sorts rows, collections or records, by their first element, or the rows
+  // of a table by its first field. Rows with equal keys keep their order.
+  registerBuiltin<NemoType(NemoType)>(ctx, "sort_by", [](NemoType arg) {
+    if (arg.type == BuiltinType::TABLE) {
+      return tableType(sortTable(std::get<NemoTable>(arg.value.value())));
     }
-
-    if (args[0].type != BuiltinType::COLLECTION) {
+    if (arg.type != BuiltinType::COLLECTION) {
       throw std::runtime_error(
-          "join function takes a collection argument, but got " +
-          typeToString(args[0].type));
+          "sort_by function takes a collection of rows or a table, but got " +
+          typeToString(arg.type));
     }
 
-    std::string result;
-    for (const auto &arg : args[0].collection.value()) {
-      if (arg.type != BuiltinType::CHAR) {
-        voidType();
-      }
-
-      result += std::get<char>(arg.value.value());
+    auto &rows = arg.collection.value();
+    auto type = BuiltinType::VOID;
+    for (const auto &row : rows) {
+      type = joinElement(type, firstOf(row).type, "sort_by");
     }
-
-    return stringType(result);
+    return collectionType(gather(
+        rows, orderRows(rows.size(), type,
+                        [&](size_t row) -> const NemoType & {
+                          return firstOf(rows[row]);
+                        })));
   });
 
-  ctx->registerFunction("range", [](std::vector<NemoType> args) {
-    if (args.size() != 1) {
-      throw std::runtime_error("range function takes exactly one argument");
+  // Keeps the first of equal numbers, chars or strings of a collection, array
+  // or string.
+  registerBuiltin<NemoType(NemoType)>(ctx, "unique", [](NemoType arg) {
+    switch (arg.type) {
+    case BuiltinType::ARRAY: {
+      const auto &array = std::get<NemoArray>(arg.value.value());
+      if (array.element == NemoArray::Element::Number) {
+        Seen seen(BuiltinType::INT);
+        auto numbers = std::make_shared<NemoNumbers>();
+        for (size_t i = 0; i < array.size; i++) {
+          if (seen.first(array.numbers()[i])) {
+            numbers->push_back(array.numbers()[i]);
+          }
+        }
+        return arrayType(NemoArray{
+            array.element,
+            std::shared_ptr<const void>(numbers, numbers->data()),
+            numbers->size()});
+      }
+      Seen seen(BuiltinType::CHAR);
+      auto chars = std::make_shared<NemoChars>();
+      for (size_t i = 0; i < array.size; i++) {
+        if (seen.first(array.chars()[i])) {
+          chars->push_back(array.chars()[i]);
+        }
+      }
+      return arrayType(NemoArray{
+          array.element, std::shared_ptr<const void>(chars, chars->data()),
+          chars->size()});
     }
-
-    if (args[0].type != BuiltinType::COLLECTION) {
-      throw std::runtime_error(
-          "range function takes a collection argument, but got " +
-          typeToString(args[0].type));
+    case BuiltinType::STRING: {
+      auto &string = std::get<NemoString>(arg.value.value());
+      Seen seen(BuiltinType::CHAR);
+      size_t kept = 0;
+      for (const auto c : string) {
+        if (seen.first(c)) {
+          string[kept++] = c;
+        }
+      }
+      string.resize(kept);
+      return arg;
     }
-
-    if (args[0].collection.value().size() == 0 ||
-        args[0].collection.value().size() > 3) {
+    case BuiltinType::COLLECTION: {
+      auto &values = arg.collection.value();
+      Seen seen(elementType(values, 0, "unique"));
+      size_t kept = 0;
+      for (size_t i = 0; i < values.size(); i++) {
+        if (seen.first(values[i])) {
+          if (kept != i) {
+            values[kept] = std::move(values[i]);
+          }
+          kept++;
+        }
+      }
+      values.erase(values.begin() + kept, values.end());
+      return arg;
+    }
+    default:
       throw std::runtime_error(
-          "range function takes a collection of size 1, 2 or 3");
+          "unique function takes a collection, array or string, but got " +
+          typeToString(arg.type));
     }
+  });
 
-    auto start = 0;
-    auto end = 0;
-    auto step = 1;
+  // The k greatest of the numbers, chars or strings following k, greatest
+  // first: [3 5 1 4 2] |> top_k gives [5 4 2].
+  registerBuiltin<NemoCollection(NemoCollection)>(
+      ctx, "top_k", [](NemoCollection values) {
+        if (values.empty() || values[0].type != BuiltinType::INT) {
+          throw std::runtime_error(
+              "top_k function takes a count followed by the elements to "
+              "rank, but got " +
+              (values.empty() ? std::string("an empty collection")
+                              : typeToString(values[0].type) + " first"));
+        }
+        const auto count = std::get<int>(values[0].value.value());
+        if (count < 0) {
+          throw std::runtime_error(
+              "top_k function takes a count of 0 or more, but got " +
+              std::to_string(count));
+        }
 
-    if (args[0].collection.value().size() == 1) {
-      if (args[0].collection.value()[0].type != BuiltinType::INT) {
-        throw std::runtime_error(
-            "range function takes a collection of integers");
-      }
+        const auto n = values.size() - 1;
+        const auto k = std::min<size_t>(count, n);
+        NemoCollection top;
+        top.reserve(k);
+        switch (elementType(values, 1, "top_k")) {
+        case BuiltinType::INT: {
+          SortBuffer<int> numbers;
+          numbers.reserve(n);
+          for (size_t i = 1; i < values.size(); i++) {
+            numbers.push_back(std::get<int>(values[i].value.value()));
+          }
+          nemo::sort::topK(numbers.data(), n, k, std::less<>());
+          for (size_t i = 0; i < k; i++) {
+            top.push_back(numberType(numbers[i]));
+          }
+          break;
+        }
+        case BuiltinType::CHAR: {
+          SortBuffer<char> chars;
+          chars.reserve(n);
+          for (size_t i = 1; i < values.size(); i++) {
+            chars.push_back(std::get<char>(values[i].value.value()));
+          }
+          nemo::sort::topK(chars.data(), n, k, std::less<>());
+          for (size_t i = 0; i < k; i++) {
+            top.push_back(charType(chars[i]));
+          }
+          break;
+        }
+        case BuiltinType::STRING: {
+          SortBuffer<nemo::sort::StringKey> keys;
+          keys.reserve(n);
+          for (size_t i = 1; i < values.size(); i++) {
+            keys.emplace_back(textOf(values[i]), i);
+          }
+          nemo::sort::topK(keys.data(), n, k, std::less<>());
+          for (size_t i = 0; i < k; i++) {
+            top.push_back(std::move(values[keys[i].index]));
+          }
+          break;
+        }
+        default:
+          break;
+        }
+        return top;
+      });
+}
 
-      end = std::get<int>(args[0].collection.value()[0].value.value());
-    } else if (args[0].collection.value().size() == 2) {
-      if (args[0].collection.value()[0].type != BuiltinType::INT ||
-          args[0].collection.value()[1].type != BuiltinType::INT) {
-        throw std::runtime_error(
-            "range function takes a collection of integers");
-      }
+// Whether value may be stored in a field declared as field.
+bool fieldAccepts(const nemo::ir::Parameter &field, const NemoType &value) {
+  switch (field.type) {
+  case nemo::ir::BuiltinType::Number:
+    return value.type == BuiltinType::INT;
+  case nemo::ir::BuiltinType::Character:
+    return value.type == BuiltinType::CHAR;
+  case nemo::ir::BuiltinType::String:
+    return value.type == BuiltinType::STRING;
+  case nemo::ir::BuiltinType::Collection:
+    return value.type == BuiltinType::COLLECTION ||
+           value.type == BuiltinType::ARRAY || value.type == BuiltinType::TABLE;
+  case nemo::ir::BuiltinType::Lambda:
+    return value.type == BuiltinType::LAMBDA;
+  case nemo::ir::BuiltinType::Custom:
+    return value.type == BuiltinType::RECORD &&
+           std::get<const RecordType *>(value.value.value())->name ==
+               field.annotation;
+  case nemo::ir::BuiltinType::Void:
+    return value.type == BuiltinType::VOID;
+  case nemo::ir::BuiltinType::Any:
+    return true;
+  }
+  return false;
+}
 
-      start = std::get<int>(args[0].collection.value()[0].value.value());
-      end = std::get<int>(args[0].collection.value()[1].value.value());
-    } else {
-      if (args[0].collection.value()[0].type != BuiltinType::INT ||
-          args[0].collection.value()[1].type != BuiltinType::INT ||
-          args[0].collection.value()[2].type != BuiltinType::INT) {
-        throw std::runtime_error(
-            "range function takes a collection of integers");
-      }
+NemoType construct(const RecordType &type, NemoType arg);
+
+void checkFieldCount(const RecordType &type, size_t count) {
+  if (count != type.fields.size()) {
+    throw std::runtime_error(type.name + " takes " +
+                             std::to_string(type.fields.size()) +
+                             " fields, but got " + std::to_string(count));
+  }
+}
 
-      start = std::get<int>(args[0].collection.value()[0].value.value());
-      end = std::get<int>(args[0].collection.value()[1].value.value());
-      step = std::get<int>(args[0].collection.value()[2].value.value());
+// Checks the value of field i. A field of a record type also takes the
+// record's field values, since collection literals only hold literals.
+void setField(const RecordType &type, size_t i, NemoType &value) {
+  const auto &field = type.fields[i];
+  if (type.fieldTypes[i] != nullptr &&
+      value.type == BuiltinType::COLLECTION) {
+    value = construct(*type.fieldTypes[i], std::move(value));
+  }
+  if (!fieldAccepts(field, value)) {
+    throw std::runtime_error(type.name + " field " + field.name + " takes " +
+                             field.annotation + ", but got " +
+                             typeToString(value.type));
+  }
+}
+
+// Transposes rows of field values into one column per field.
+NemoTable makeTable(const RecordType &type, NemoCollection &rows) {
+  auto columns = std::make_shared<std::vector<NemoColumn>>();
+  columns->reserve(type.fields.size());
+  for (const auto &field : type.fields) {
+    switch (field.type) {
+    case nemo::ir::BuiltinType::Number:
+      columns->emplace_back(NemoNumbers());
+      break;
+    case nemo::ir::BuiltinType::Character:
+      columns->emplace_back(NemoChars());
+      break;
+    default:
+      columns->emplace_back(NemoCollection());
+      break;
     }
+    std::visit([&](auto &column) { column.reserve(rows.size()); },
+               columns->back());
+  }
 
-    // generate range from start end and step
-    std::vector<NemoType> range;
-    for (auto i = start; i < end; i += step) {
-      range.push_back(numberType(i));
+  for (auto &row : rows) {
+    if (row.type != BuiltinType::COLLECTION) {
+      throw std::runtime_error(type.name +
+                               " rows must be collections, but got " +
+                               typeToString(row.type));
     }
+    auto &values = row.collection.value();
+    checkFieldCount(type, values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+      setField(type, i, values[i]);
+      std::visit(
+          [&](auto &column) {
+            using Column = std::decay_t<decltype(column)>;
+            if constexpr (std::is_same_v<Column, NemoNumbers>) {
+              column.push_back(std::get<int>(values[i].value.value()));
+            } else if constexpr (std::is_same_v<Column, NemoChars>) {
+              column.push_back(std::get<char>(values[i].value.value()));
+            } else {
+              column.push_back(std::move(values[i]));
+            }
+          },
+          (*columns)[i]);
+    }
+  }
 
-    return collectionType(range);
-  });
+  return NemoTable{&type, rows.size(), std::move(columns)};
 }
 
-void eval(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx) {
-  const auto tag = std::string(ast->tag);
-  if (tag.find("assignment") != std::string::npos) {
-    eval_assignment(ast, ctx);
+// Builds a record from a collection of its field values, or a table from a
+// collection of rows when the first element is a collection the first field
+// cannot take.
+NemoType construct(const RecordType &type, NemoType arg) {
+  if (arg.type != BuiltinType::COLLECTION) {
+    throw std::runtime_error(type.name +
+                             " takes a collection of fields or rows, but got " +
+                             typeToString(arg.type));
   }
-  if (tag.find("pipeline") != std::string::npos) {
-    eval_pipeline(ast, ctx);
+
+  auto &values = arg.collection.value();
+  if (!values.empty() && values[0].type == BuiltinType::COLLECTION &&
+      type.fieldTypes[0] == nullptr &&
+      !fieldAccepts(type.fields[0], values[0])) {
+    return tableType(makeTable(type, values));
+  }
+
+  checkFieldCount(type, values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    setField(type, i, values[i]);
   }
+  return recordType(&type, std::move(values));
 }
 
-void eval_assignment(const mpc_ast_t *ast, std::shared_ptr<ScopeContext> ctx) {
-  // const auto bindType = std::string(ast->children[0]->contents);
-  const auto identifier = std::string(ast->children[1]->contents);
+// Fixes the layout of a record type and registers its constructor under the
+// type's name.
+void defineRecordType(std::shared_ptr<ScopeContext> ctx,
+                      const nemo::ir::TypeDefinition &definition) {
+  RecordType type{definition.name.name, definition.fields, {}, {}};
+  for (const auto &field : definition.fields) {
+    type.fieldTypes.push_back(field.type == nemo::ir::BuiltinType::Custom
+                                  ? ctx->findRecordType(field.annotation)
+                                  : nullptr);
+  }
+  for (size_t i = 0; i < definition.fieldIds.size(); i++) {
+    const auto id = definition.fieldIds[i];
+    if (id >= static_cast<int>(type.offsets.size())) {
+      type.offsets.resize(id + 1, -1);
+    }
+    type.offsets[id] = static_cast<int>(i);
+  }
+
+  const auto *layout = &ctx->defineRecordType(std::move(type));
+  registerBuiltin(ctx, layout->name, [layout](std::vector<NemoType> args) {
+    if (args.size() != 1) {
+      throw std::runtime_error(layout->name +
+                               " function takes exactly one argument");
+    }
+    return construct(*layout, std::move(args[0]));
+  });
+}
+
+// Reads a field of a record through its offset, or a whole column of a
+// table. Number and char columns are returned as arrays sharing the table's
+// storage. The record is the running result, so its field is moved out.
+NemoType eval_field(const nemo::ir::Field &field, NemoType &value,
+                    std::shared_ptr<ScopeContext> ctx) {
+  const RecordType *type = nullptr;
+  if (value.type == BuiltinType::RECORD) {
+    type = std::get<const RecordType *>(value.value.value());
+  } else if (value.type == BuiltinType::TABLE) {
+    type = std::get<NemoTable>(value.value.value()).type;
+  } else {
+    ctx->output() << "Field ." << field.name << " needs a record, but got "
+                  << typeToString(value.type) << std::endl;
+    return voidType();
+  }
 
-  const auto pipelineResult = eval_pipeline(ast->children[3], ctx);
+  const auto offset = type->offset(field.id);
+  if (offset < 0) {
+    ctx->output() << type->name << " has no field " << field.name
+                  << std::endl;
+    return voidType();
+  }
+
+  if (value.type == BuiltinType::RECORD) {
+    return std::move(value.collection.value()[offset]);
+  }
 
-  ctx->bind(identifier, pipelineResult);
+  const auto &table = std::get<NemoTable>(value.value.value());
+  return std::visit(
+      [&](const auto &column) {
+        using Column = std::decay_t<decltype(column)>;
+        if constexpr (std::is_same_v<Column, NemoCollection>) {
+          return collectionType(column);
+        } else {
+          const auto element = std::is_same_v<Column, NemoNumbers>
+                                   ? NemoArray::Element::Number
+                                   : NemoArray::Element::Char;
+          return arrayType(
+              NemoArray{element,
+                        std::shared_ptr<const void>(table.columns,
+                                                    column.data()),
+                        column.size()});
+        }
+      },
+      (*table.columns)[offset]);
 }
 
-NemoType eval_pipeline(const mpc_ast_t *ast,
-                       std::shared_ptr<ScopeContext> ctx) {
-  const auto tag = std::string(ast->tag);
+// Name shown for a pipeline stage in profiles.
+const char *stageName(const nemo::ir::Expression &expression) {
+  return std::visit(
+      [](const auto &node) -> const char * {
+        using Node = std::decay_t<decltype(node)>;
+
+        if constexpr (std::is_same_v<Node, nemo::ir::Identifier>) {
+          return node.name.c_str();
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Number>) {
+          return "number";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Character>) {
+          return "character";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::String>) {
+          return "str";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Collection>) {
+          return "collection";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Field>) {
+          return node.name.c_str();
+        } else if constexpr (std::is_same_v<Node, nemo::ir::If>) {
+          return "if";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Match>) {
+          return "match";
+        } else if constexpr (std::is_same_v<Node, nemo::ir::Loop>) {
+          return "while";
+        } else {
+          return "lambda";
+        }
+      },
+      expression.value);
+}
+
+// Returns the value of a pipeline statement, which is the result of a lambda
+// body when it is the last one.
+NemoType eval(const nemo::ir::Statement &statement,
+              std::shared_ptr<ScopeContext> ctx) {
+  nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement, nullptr,
+                              statement.location.row);
+
+  if (const auto *assignment =
+          std::get_if<nemo::ir::Assignment>(&statement.statement)) {
+    eval_assignment(*assignment, ctx);
+  } else if (const auto *pipeline =
+                 std::get_if<nemo::ir::Pipeline>(&statement.statement)) {
+    return eval_pipeline(*pipeline, ctx);
+  }
+  // Type definitions take effect when the program is compiled.
+  return voidType();
+}
 
-  //   mpc_ast_print(const_cast<mpc_ast_t *>(ast));
+void eval_assignment(const nemo::ir::Assignment &assignment,
+                     std::shared_ptr<ScopeContext> ctx) {
+  auto pipelineResult = eval_pipeline(assignment.value, ctx);
 
-  if (tag.find("expression") != std::string::npos) {
-    return eval_expression(ast, ctx, std::vector<NemoType>());
+  const auto &binding = assignment.variable.binding;
+  if (binding.kind == Binding::Kind::Local) {
+    ctx->local(binding.index) = std::move(pipelineResult);
   } else {
-    NemoType result = voidType();
-
-    for (int i = 0; i < ast->children_num; ++i) {
-      const auto args = [&]() {
-        if (i == 0)
-          return std::vector<NemoType>();
-        else
-          return std::vector<NemoType>({result});
-      }();
-
-      if (std::string(ast->children[i]->tag).find("operator") !=
-          std::string::npos) {
-        const auto nextOp =
-            eval_expression(ast->children[++i], ctx, std::vector<NemoType>());
-        result = eval_operator(result, nextOp,
-                               std::string(ast->children[i - 1]->contents));
-      } else {
+    ctx->assign(binding.index, std::move(pipelineResult));
+  }
+}
 
-        if (std::string(ast->children[i]->tag).find("string") !=
-            std::string::npos)
-          continue;
-        result = eval_expression(ast->children[i], ctx, args);
+NemoType eval_pipeline(const nemo::ir::Pipeline &pipeline,
+                       std::shared_ptr<ScopeContext> ctx) {
+  return eval_stages(pipeline, pipeline.stages.size(), ctx);
+}
+
+// Evaluates the head of pipeline and its first count stages.
+NemoType eval_stages(const nemo::ir::Pipeline &pipeline, size_t count,
+                     std::shared_ptr<ScopeContext> ctx) {
+  NemoType result = [&]() {
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Stage,
+                                stageName(pipeline.head),
+                                pipeline.head.location.row, 0);
+    return eval_expression(pipeline.head, ctx, {});
+  }();
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto &stage = pipeline.stages[i];
+
+    if (stage.kind == nemo::ir::Stage::Kind::Operator) {
+      nemo::profiler::Scope frame(nemo::profiler::FrameKind::Stage,
+                                  stage.op.symbol.c_str(),
+                                  stage.target.location.row, i + 1);
+      const auto nextOp = eval_expression(stage.target, ctx, {});
+      if (stage.operands == nemo::ir::BuiltinType::Number) {
+        // A specialized body proved both operands to be numbers.
+        auto &a = *std::get_if<int>(&*result.value);
+        a = nemo::operators::apply(stage.op.kind, a,
+                                   *std::get_if<int>(&*nextOp.value));
+      } else {
+        nemo::operators::apply(stage.op.kind, result, nextOp, *ctx);
       }
+    } else {
+      nemo::profiler::Scope frame(nemo::profiler::FrameKind::Stage,
+                                  stageName(stage.target),
+                                  stage.target.location.row, i + 1);
+      // The running result is the stage's argument and may be moved from.
+      result = eval_expression(stage.target, ctx, std::span(&result, 1),
+                               &stage.cache);
     }
-
-    return result;
   }
-}
 
-NemoType eval_expression(const mpc_ast_t *ast,
-                         std::shared_ptr<ScopeContext> ctx,
-                         std::vector<NemoType> args) {
-  if (args.size() == 0) {
+  return result;
+}
 
-    const auto tag = std::string(ast->tag);
+// Whether a condition holds: it is a nonzero number. Any other value prints
+// an error and does not hold.
+bool holds(const NemoType &condition, ScopeContext &ctx) {
+  if (condition.type == BuiltinType::INT) {
+    return *std::get_if<int>(&*condition.value) != 0;
+  }
+  ctx.output() << "Condition should be a number, but got "
+               << typeToString(condition.type) << std::endl;
+  return false;
+}
 
-    if (tag.find("ident") != std::string::npos) {
-      try {
-        return ctx->callFunction(std::string(ast->contents), args);
-      } catch (const std::exception &e) {
-        try {
-          return ctx->get(std::string(ast->contents));
-        } catch (const std::exception &e) {
-          std::cout << e.what() << std::endl;
-          return voidType();
+bool matches(const nemo::ir::Arm &arm, const NemoType &value) {
+  return std::visit(
+      [&](const auto &pattern) {
+        using Pattern = std::decay_t<decltype(pattern)>;
+
+        if constexpr (std::is_same_v<Pattern, nemo::ir::Number>) {
+          return value.type == BuiltinType::INT &&
+                 *std::get_if<int>(&*value.value) == pattern.value;
+        } else if constexpr (std::is_same_v<Pattern, nemo::ir::Character>) {
+          return value.type == BuiltinType::CHAR &&
+                 *std::get_if<char>(&*value.value) == pattern.value;
+        } else if constexpr (std::is_same_v<Pattern, nemo::ir::String>) {
+          return value.type == BuiltinType::STRING &&
+                 std::string_view(*std::get_if<NemoString>(&*value.value)) ==
+                     pattern.value;
+        } else {
+          return true;
         }
-      }
-    } else if (tag.find("number") != std::string::npos) {
-      return numberType(std::stoi(ast->contents));
-    } else if (tag.find("str") != std::string::npos) {
-      const auto tmp = std::string(ast->contents);
-      return stringType(tmp.substr(1, tmp.length() - 2));
-    } else if (tag.find("character") != std::string::npos) {
-      return charType(ast->contents[1]);
-    } else if (tag.find("collection") != std::string::npos) {
-      std::vector<NemoType> collection;
-      for (int i = 1; i < ast->children_num - 1; i++) {
-        collection.push_back(
-            eval_expression(ast->children[i], ctx, std::vector<NemoType>()));
-      }
+      },
+      arm.pattern);
+}
 
-      return collectionType(collection);
+// The statements of the branch a conditional takes.
+const std::vector<nemo::ir::Statement> &
+branchOf(const nemo::ir::If &conditional, std::shared_ptr<ScopeContext> ctx) {
+  return holds(eval_block(conditional.condition, ctx), *ctx)
+             ? conditional.then
+             : conditional.otherwise;
+}
 
-    } else if (tag.find("lambda") != std::string::npos) {
-      return lambdaType(ast);
-    } else {
-      std::cout << "Not implemented" << std::endl;
-      return voidType();
+// The arm a match takes, null if no pattern matches.
+const nemo::ir::Arm *armOf(const nemo::ir::Match &match,
+                           std::shared_ptr<ScopeContext> ctx) {
+  const auto subject = eval_block(match.subject, ctx);
+  for (const auto &arm : match.arms) {
+    if (matches(arm, subject)) {
+      return &arm;
     }
-  } else {
-    try {
+  }
+  return nullptr;
+}
 
-      return ctx->callFunction(std::string(ast->contents), args);
-    } catch (const std::exception &e) {
-      std::cout << e.what() << std::endl;
+// Runs a loop. The first iterations are walked; once the loop is hot, it
+// runs to the end compiled to closures.
+NemoType eval_loop(const nemo::ir::Loop &loop,
+                   std::shared_ptr<ScopeContext> ctx) {
+  while (true) {
+    if (const auto *code = nemo::closure::compiled(loop, *ctx)) {
+      const nemo::ir::Statement *tail = nullptr;
+      return code->run(ctx, tail);
+    }
+    if (!holds(eval_block(loop.condition, ctx), *ctx)) {
       return voidType();
     }
+    eval_block(loop.body, ctx);
   }
 }
 
-NemoType eval_operator(const NemoType &op1, const NemoType &op2,
-                       const std::string &op) {
-  if (op1.type != op2.type) {
-    std::cout << "Operator types should be equal but got types" +
-                     typeToString(op1.type) + " and " + typeToString(op2.type)
-              << std::endl;
-    exit(0);
-  }
-
-  switch (op1.type) {
-  case BuiltinType::INT: {
-    if (op.compare("+") == 0) {
-      return numberType(std::get<int>(op1.value.value()) +
-                        std::get<int>(op2.value.value()));
-    } else if (op.compare("-") == 0) {
-      return numberType(std::get<int>(op1.value.value()) -
-                        std::get<int>(op2.value.value()));
-    } else if (op.compare("*") == 0) {
-      return numberType(std::get<int>(op1.value.value()) *
-                        std::get<int>(op2.value.value()));
-    } else if (op.compare("/") == 0) {
-      return numberType(std::get<int>(op1.value.value()) /
-                        std::get<int>(op2.value.value()));
-    }
-
-  } break;
-  case BuiltinType::CHAR: {
-    if (op.compare("+") == 0) {
-      return charType(std::get<char>(op1.value.value()) +
-                      std::get<char>(op2.value.value()));
-    } else if (op.compare("-") == 0) {
-      return charType(std::get<char>(op1.value.value()) -
-                      std::get<char>(op2.value.value()));
-    } else if (op.compare("*") == 0) {
-      return charType(std::get<char>(op1.value.value()) *
-                      std::get<char>(op2.value.value()));
-    } else if (op.compare("/") == 0) {
-      return charType(std::get<char>(op1.value.value()) /
-                      std::get<char>(op2.value.value()));
-    }
-
-  } break;
-  case BuiltinType::STRING: {
-    if (op.compare("+") == 0) {
-      return stringType(std::get<std::string>(op1.value.value()) +
-                        std::get<std::string>(op2.value.value()));
+// Evaluates statements, giving the value of the last one or None without
+// one. With tail, the last statement is in tail position: when it pipes into
+// a call, its pipeline is evaluated up to the call, *tail set to it and the
+// call's argument returned for the caller to make the call. A conditional
+// or match in tail position passes it on to the branch taken.
+NemoType eval_block(const std::vector<nemo::ir::Statement> &statements,
+                    std::shared_ptr<ScopeContext> ctx,
+                    const nemo::ir::Statement **tail) {
+  if (statements.empty()) {
+    return voidType();
+  }
+  for (size_t i = 0; i + 1 < statements.size(); i++) {
+    eval(statements[i], ctx);
+  }
+
+  const auto &last = statements.back();
+  if (tail == nullptr) {
+    return eval(last, ctx);
+  }
+  if (const auto *pipeline = nemo::closure::tailPipeline(last)) {
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement, nullptr,
+                                last.location.row);
+    *tail = &last;
+    return eval_stages(*pipeline, pipeline->stages.size() - 1, ctx);
+  }
+
+  const auto *pipeline = std::get_if<nemo::ir::Pipeline>(&last.statement);
+  if (pipeline != nullptr && pipeline->stages.empty()) {
+    const auto &head = pipeline->head.value;
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Statement, nullptr,
+                                last.location.row);
+    if (const auto *conditional = std::get_if<nemo::ir::If>(&head)) {
+      return eval_block(branchOf(*conditional, ctx), ctx, tail);
+    }
+    if (const auto *match = std::get_if<nemo::ir::Match>(&head)) {
+      const auto *arm = armOf(*match, ctx);
+      return arm != nullptr ? eval_block(arm->body, ctx, tail) : voidType();
+    }
+  }
+  return eval(last, ctx);
+}
+
+NemoType eval_variable(const nemo::ir::Identifier &identifier,
+                       std::shared_ptr<ScopeContext> ctx) {
+  if (identifier.binding.kind == Binding::Kind::Local) {
+    return ctx->local(identifier.binding.index);
+  }
+
+  if (identifier.binding.kind == Binding::Kind::Global) {
+    const auto &slot = ctx->global(identifier.binding.index);
+    if (slot.has_value()) {
+      return slot.value();
+    }
+  }
+
+  try {
+    return ctx->get(identifier.name);
+  } catch (const std::exception &e) {
+    ctx->output() << e.what() << std::endl;
+    return voidType();
+  }
+}
+
+// The value of a variable, null if it has none.
+const NemoType *boundValue(const nemo::ir::Identifier &identifier,
+                           std::shared_ptr<ScopeContext> ctx) {
+  if (identifier.binding.kind == Binding::Kind::Local) {
+    return &ctx->local(identifier.binding.index);
+  }
+  if (identifier.binding.kind == Binding::Kind::Global) {
+    const auto &slot = ctx->global(identifier.binding.index);
+    return slot.has_value() ? &slot.value() : nullptr;
+  }
+  return nullptr;
+}
+
+// The lambda held by a variable, null if it holds anything else.
+const nemo::ir::Lambda *lambdaOf(const nemo::ir::Identifier &identifier,
+                                 std::shared_ptr<ScopeContext> ctx) {
+  const auto *value = boundValue(identifier, ctx);
+  if (value == nullptr || value->type != BuiltinType::LAMBDA) {
+    return nullptr;
+  }
+  return std::get<const nemo::ir::Lambda *>(value->value.value());
+}
+
+// Pipes the running result into a variable that does not hold a lambda. A
+// map looks the result up as a key and gives None when it has no such key.
+NemoType apply_value(const nemo::ir::Identifier &identifier,
+                     const NemoType &argument,
+                     std::shared_ptr<ScopeContext> ctx) {
+  const auto *value = boundValue(identifier, ctx);
+  if (value == nullptr || value->type != BuiltinType::MAP) {
+    ctx->output() << "Function not found" << std::endl;
+    return voidType();
+  }
+  const auto *found =
+      lookupKey(*std::get<NemoMap>(value->value.value()).table, argument);
+  return found != nullptr ? *found : voidType();
+}
+
+nemo::ir::BuiltinType staticType(BuiltinType type) {
+  switch (type) {
+  case BuiltinType::INT:
+    return nemo::ir::BuiltinType::Number;
+  case BuiltinType::CHAR:
+    return nemo::ir::BuiltinType::Character;
+  case BuiltinType::STRING:
+    return nemo::ir::BuiltinType::String;
+  case BuiltinType::COLLECTION:
+    return nemo::ir::BuiltinType::Collection;
+  case BuiltinType::LAMBDA:
+    return nemo::ir::BuiltinType::Lambda;
+  default:
+    return nemo::ir::BuiltinType::Any;
+  }
+}
+
+// Up to this many argument type combinations are specialized per lambda,
+// later ones use the generic body.
+constexpr size_t maxSpecializations = 4;
+
+// The body to run for the arguments in frame: the one specialized for their
+// types, compiled on the first call with those types. An argument that does
+// not match the annotation of its parameter selects the generic body.
+const nemo::ir::Lambda &selectBody(const nemo::ir::Lambda &lambda,
+                                   std::span<const NemoType> frame,
+                                   std::shared_ptr<ScopeContext> ctx) {
+  const auto &parameters = lambda.parameters;
+  for (size_t i = 0; i < parameters.size(); i++) {
+    const auto annotation = parameters[i].type;
+    if (annotation != nemo::ir::BuiltinType::Any &&
+        annotation != nemo::ir::BuiltinType::Custom &&
+        annotation != staticType(frame[i].type)) {
+      return lambda;
+    }
+  }
+
+  auto &specializations = ctx->specializations(&lambda);
+  for (const auto &specialization : specializations) {
+    size_t i = 0;
+    while (i < parameters.size() &&
+           specialization.arguments[i] == staticType(frame[i].type)) {
+      i++;
+    }
+    if (i == parameters.size()) {
+      return specialization.body ? *specialization.body : lambda;
+    }
+  }
+
+  if (specializations.size() >= maxSpecializations) {
+    return lambda;
+  }
+
+  std::vector<nemo::ir::BuiltinType> arguments;
+  for (size_t i = 0; i < parameters.size(); i++) {
+    arguments.push_back(staticType(frame[i].type));
+  }
+  auto body = nemo::ir::specialize(lambda, arguments);
+  specializations.push_back(
+      ScopeContext::Specialization{std::move(arguments), std::move(body)});
+  const auto &added = specializations.back();
+  return added.body ? *added.body : lambda;
+}
+
+// The lambda a call site calls. While no lambda binding changed since the
+// call site's cache was filled, a global callee is the one cached there.
+const nemo::ir::Lambda *calleeOf(const nemo::ir::Identifier &identifier,
+                                 nemo::ir::CallCache *cache,
+                                 std::shared_ptr<ScopeContext> ctx) {
+  if (cache != nullptr) {
+    if (cache->epoch != ctx->bindingsEpoch()) {
+      cache->epoch = ctx->bindingsEpoch();
+      cache->count = 0;
+    } else if (identifier.binding.kind == Binding::Kind::Global &&
+               cache->count > 0) {
+      return cache->entries[0].callee;
+    }
+  }
+  return lambdaOf(identifier, ctx);
+}
+
+// selectBody through the call site's cache. When the cache is full the last
+// entry is replaced.
+const nemo::ir::Lambda &cachedBody(const nemo::ir::Lambda &lambda,
+                                   std::span<const NemoType> frame,
+                                   nemo::ir::CallCache &cache,
+                                   std::shared_ptr<ScopeContext> ctx) {
+  using nemo::ir::CallCache;
+  const auto arity = lambda.parameters.size();
+  if (arity > CallCache::maxArity) {
+    return selectBody(lambda, frame, ctx);
+  }
+
+  std::array<nemo::ir::BuiltinType, CallCache::maxArity> arguments{};
+  for (size_t i = 0; i < arity; i++) {
+    arguments[i] = staticType(frame[i].type);
+  }
+  for (int i = 0; i < cache.count; i++) {
+    const auto &entry = cache.entries[i];
+    if (entry.callee == &lambda && entry.arguments == arguments) {
+      return *entry.body;
+    }
+  }
+
+  const auto &body = selectBody(lambda, frame, ctx);
+  auto &entry = cache.entries[cache.count < CallCache::size
+                                  ? cache.count++
+                                  : CallCache::size - 1];
+  entry = CallCache::Entry{&lambda, arguments, &body};
+  return body;
+}
+
+// Owns the frames of a lambda call on the context's frame stack. Releases
+// them and restores the caller's frame when the call returns or throws.
+// Counts the call towards the context's call depth.
+class FrameGuard {
+public:
+  explicit FrameGuard(ScopeContext &ctx)
+      : ctx(ctx), base(enter(ctx)), caller(ctx.enterFrame({})) {}
+  ~FrameGuard() {
+    ctx.frameStack().release(base);
+    ctx.enterFrame(caller);
+    ctx.callDepth()--;
+  }
+
+  // Replaces the call's frame with count fresh slots.
+  std::span<NemoType> enter(size_t count) {
+    ctx.frameStack().release(base);
+    const auto frame = ctx.frameStack().push(count);
+    ctx.enterFrame(frame);
+    return frame;
+  }
+
+private:
+  static FrameStack::Mark enter(ScopeContext &ctx) {
+    if (ctx.callDepth() == ScopeContext::maxCallDepth) [[unlikely]] {
+      throw CallDepthExceeded{};
+    }
+    ctx.callDepth()++;
+    return ctx.frameStack().mark();
+  }
+
+  ScopeContext &ctx;
+  FrameStack::Mark base;
+  std::span<NemoType> caller;
+};
+
+// Binds the parameters of lambda to argument in a frame of fresh locals. A
+// lambda with several parameters takes a collection holding one value per
+// parameter.
+void bindArguments(const nemo::ir::Lambda &lambda, NemoType argument,
+                   std::span<NemoType> frame) {
+  const auto arity = lambda.parameters.size();
+  if (arity > 1 && (argument.type != BuiltinType::COLLECTION ||
+                    argument.collection.value().size() != arity)) {
+    throw std::runtime_error("lambda takes a collection of " +
+                             std::to_string(arity) + " arguments, but got " +
+                             typeToString(argument.type));
+  }
+
+  if (arity == 1) {
+    frame[0] = std::move(argument);
+  } else if (arity > 1) {
+    auto &values = argument.collection.value();
+    std::move(values.begin(), values.end(), frame.begin());
+  }
+}
+
+// The lambda called by the last stage of a tail pipeline, null if it calls
+// a builtin or something that is not a lambda.
+const nemo::ir::Lambda *tailCallee(const nemo::ir::Stage &stage,
+                                   std::shared_ptr<ScopeContext> ctx) {
+  if (const auto *lambda = std::get_if<nemo::ir::Lambda>(&stage.target.value)) {
+    return lambda;
+  }
+  const auto *identifier =
+      std::get_if<nemo::ir::Identifier>(&stage.target.value);
+  if (identifier == nullptr ||
+      identifier->binding.kind == Binding::Kind::Builtin) {
+    return nullptr;
+  }
+  return calleeOf(*identifier, &stage.cache, ctx);
+}
+
+// Calls a lambda with the running result. The result is the value of the
+// body's last statement. When that statement pipes into another lambda, the
+// call is a tail call: the callee's locals replace the caller's in the same
+// frame and the loop runs its body, so tail recursion runs in constant stack.
+// So is a call ending the branch a conditional in tail position takes.
+// Hot bodies run compiled to closures, see interpreter/closure.h.
+NemoType call_lambda(const nemo::ir::Lambda &lambda, std::span<NemoType> args,
+                     std::shared_ptr<ScopeContext> ctx,
+                     nemo::ir::CallCache *cache) {
+  const auto *callee = &lambda;
+  NemoType argument = std::move(args[0]);
+  FrameGuard guard(*ctx);
+
+  while (true) {
+    const auto frame = guard.enter(callee->localCount);
+    bindArguments(*callee, std::move(argument), frame);
+    const auto &body = cache != nullptr
+                           ? cachedBody(*callee, frame, *cache, ctx)
+                           : selectBody(*callee, frame, ctx);
+    if (body.body.empty()) {
+      return voidType();
+    }
+
+    const nemo::ir::Statement *tail = nullptr;
+    NemoType result;
+    if (const auto *code = nemo::closure::compiled(body, *ctx)) {
+      result = code->run(ctx, tail);
     } else {
+      result = eval_block(body.body, ctx, &tail);
+    }
+    if (tail == nullptr) {
+      return result;
+    }
+
+    nemo::profiler::Scope statement(nemo::profiler::FrameKind::Statement,
+                                    nullptr, tail->location.row);
+    const auto &stage = nemo::closure::tailPipeline(*tail)->stages.back();
+    const auto *next = tailCallee(stage, ctx);
+    if (next == nullptr) {
+      return eval_expression(stage.target, ctx, std::span(&result, 1),
+                             &stage.cache);
     }
 
-  } break;
+    callee = next;
+    argument = std::move(result);
+    cache = &stage.cache;
+  }
+}
+
+// Calls a lambda stage, printing the error it fails with as its output.
+NemoType apply_lambda(const nemo::ir::Lambda &lambda,
+                      std::span<NemoType> args,
+                      std::shared_ptr<ScopeContext> ctx,
+                      nemo::ir::CallCache *cache) {
+  try {
+    return call_lambda(lambda, args, ctx, cache);
+  } catch (const nemo::memory::LimitExceeded &) {
+    throw;
+  } catch (const std::exception &e) {
+    ctx->output() << e.what() << std::endl;
+    return voidType();
+  }
+}
+
+// Calls a builtin stage, printing the error it fails with as its output.
+NemoType apply_builtin(const nemo::ir::Identifier &identifier, int row,
+                       std::span<NemoType> args,
+                       std::shared_ptr<ScopeContext> ctx) {
+  try {
+    nemo::profiler::Scope frame(nemo::profiler::FrameKind::Builtin,
+                                identifier.name.c_str(), row);
+    return ctx->callFunction(identifier.binding.index, args);
+  } catch (const nemo::memory::LimitExceeded &) {
+    throw;
+  } catch (const std::exception &e) {
+    ctx->output() << e.what() << std::endl;
+    return voidType();
+  }
+}
+
+NemoType eval_expression(const nemo::ir::Expression &expression,
+                         std::shared_ptr<ScopeContext> ctx,
+                         std::span<NemoType> args,
+                         nemo::ir::CallCache *cache) {
+  const auto *identifier =
+      std::get_if<nemo::ir::Identifier>(&expression.value);
+
+  if (args.size() == 0) {
+    if (identifier != nullptr) {
+      if (identifier->binding.kind != Binding::Kind::Builtin) {
+        return eval_variable(*identifier, ctx);
+      }
 
-  case BuiltinType::COLLECTION: {
-    if (op.compare("+") == 0) {
-      std::vector<NemoType> result;
-      for (const auto &elem : op1.collection.value()) {
-        result.push_back(elem);
+      try {
+        nemo::profiler::Scope frame(nemo::profiler::FrameKind::Builtin,
+                                    identifier->name.c_str(),
+                                    expression.location.row);
+        return ctx->callFunction(identifier->binding.index, args);
+      } catch (const nemo::memory::LimitExceeded &) {
+        throw;
+      } catch (const std::exception &e) {
+        // A builtin that rejects being called without arguments may still
+        // be shadowed by a variable of the same name.
+        return eval_variable(*identifier, ctx);
       }
-      for (const auto &elem : op2.collection.value()) {
-        result.push_back(elem);
+    }
+
+    return std::visit(
+        [&](const auto &node) -> NemoType {
+          using Node = std::decay_t<decltype(node)>;
+
+          if constexpr (std::is_same_v<Node, nemo::ir::Number>) {
+            return numberType(node.value);
+          } else if constexpr (std::is_same_v<Node, nemo::ir::String>) {
+            return stringType(node.value);
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Character>) {
+            return charType(node.value);
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Collection>) {
+            NemoCollection collection;
+            collection.reserve(node.elements.size());
+            for (const auto &element : node.elements) {
+              collection.push_back(eval_expression(element, ctx, {}));
+            }
+
+            return collectionType(std::move(collection));
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Lambda>) {
+            return lambdaType(&node);
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Field>) {
+            ctx->output() << "Field ." << node.name << " needs a record"
+                          << std::endl;
+            return voidType();
+          } else if constexpr (std::is_same_v<Node, nemo::ir::If>) {
+            return eval_block(branchOf(node, ctx), ctx);
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Match>) {
+            const auto *arm = armOf(node, ctx);
+            return arm != nullptr ? eval_block(arm->body, ctx) : voidType();
+          } else if constexpr (std::is_same_v<Node, nemo::ir::Loop>) {
+            return eval_loop(node, ctx);
+          } else {
+            ctx->output() << "Not implemented" << std::endl;
+            return voidType();
+          }
+        },
+        expression.value);
+  } else {
+    if (const auto *field = std::get_if<nemo::ir::Field>(&expression.value)) {
+      return eval_field(*field, args[0], ctx);
+    }
+
+    const auto *lambda = std::get_if<nemo::ir::Lambda>(&expression.value);
+    if (identifier != nullptr &&
+        identifier->binding.kind != Binding::Kind::Builtin) {
+      lambda = calleeOf(*identifier, cache, ctx);
+      if (lambda == nullptr) {
+        return apply_value(*identifier, args[0], ctx);
       }
-      return collectionType(result);
     }
-  } break;
-  case BuiltinType::LAMBDA: {
-    return voidType();
+    if (lambda != nullptr) {
+      return apply_lambda(*lambda, args, ctx, cache);
+    }
 
-  } break;
-  case BuiltinType::VOID: {
-    return voidType();
-  } break;
+    if (identifier == nullptr ||
+        identifier->binding.kind != Binding::Kind::Builtin) {
+      ctx->output() << "Function not found" << std::endl;
+      return voidType();
+    }
+
+    return apply_builtin(*identifier, expression.location.row, args, ctx);
   }
 }
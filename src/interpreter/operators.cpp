@@ -0,0 +1,221 @@
+#include "interpreter/operators.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+std::string typeToString(BuiltinType type);
+
+namespace nemo::operators {
+
+namespace {
+
+using Handler = void (*)(NemoType &a, const NemoType &b, ScopeContext &ctx);
+
+constexpr size_t typeCount = static_cast<size_t>(BuiltinType::VOID) + 1;
+
+using Table =
+    std::array<std::array<std::array<Handler, typeCount>, typeCount>,
+               nemo::ir::Operator::kindCount>;
+
+constexpr bool isComparison(Kind op) { return op >= Kind::Less; }
+
+void mismatch(NemoType &a, const NemoType &b, ScopeContext &ctx) {
+  ctx.output() << "Operator types should be equal but got types" +
+                      typeToString(a.type) + " and " + typeToString(b.type)
+               << std::endl;
+  ctx.exit(0);
+  a = voidType();
+}
+
+void undefined(NemoType &a, const NemoType &, ScopeContext &) {
+  a = voidType();
+}
+
+template <Kind op> void number(NemoType &a, const NemoType &b, ScopeContext &) {
+  auto &x = *std::get_if<int>(&*a.value);
+  x = apply(op, x, *std::get_if<int>(&*b.value));
+}
+
+template <Kind op>
+void character(NemoType &a, const NemoType &b, ScopeContext &) {
+  auto &x = *std::get_if<char>(&*a.value);
+  const int result = apply(op, x, *std::get_if<char>(&*b.value));
+  if constexpr (isComparison(op)) {
+    a = numberType(result);
+  } else {
+    x = static_cast<char>(result);
+  }
+}
+
+// Orders strings bytewise, as std::string::compare does.
+template <Kind op>
+void compareStrings(NemoType &a, const NemoType &b, ScopeContext &) {
+  const auto order = std::get<NemoString>(*a.value).compare(
+      std::get<NemoString>(*b.value));
+  a = numberType(apply(op, order, 0));
+}
+
+void concatStrings(NemoType &a, const NemoType &b, ScopeContext &) {
+  std::get<NemoString>(*a.value) += std::get<NemoString>(*b.value);
+}
+
+void concatCollections(NemoType &a, const NemoType &b, ScopeContext &) {
+  auto &first = *a.collection;
+  const auto &second = *b.collection;
+  first.insert(first.end(), second.begin(), second.end());
+}
+
+bool equal(const NemoType &a, const NemoType &b);
+
+bool equal(const NemoCollection &a, const NemoCollection &b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const auto &x, const auto &y) { return equal(x, y); });
+}
+
+bool equal(const NemoArray &a, const NemoArray &b) {
+  if (a.element != b.element || a.size != b.size) {
+    return false;
+  }
+  return a.element == NemoArray::Element::Number
+             ? std::equal(a.numbers(), a.numbers() + a.size, b.numbers())
+             : std::equal(a.chars(), a.chars() + a.size, b.chars());
+}
+
+// Number and char columns.
+template <typename Column> bool equal(const Column &a, const Column &b) {
+  return a == b;
+}
+
+bool equal(const NemoTable &a, const NemoTable &b) {
+  if (a.type != b.type || a.rows != b.rows) {
+    return false;
+  }
+  for (size_t i = 0; i < a.columns->size(); i++) {
+    const auto same = std::visit(
+        [&](const auto &column) {
+          using Column = std::decay_t<decltype(column)>;
+          return equal(column, std::get<Column>((*b.columns)[i]));
+        },
+        (*a.columns)[i]);
+    if (!same) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Maps are equal when they have the same keys with equal values, in any
+// order.
+bool equal(const NemoHashMap &a, const NemoHashMap &b) {
+  if (a.keys() != b.keys() || a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    const auto *value = a.keys() == NemoHashMap::Keys::String
+                            ? b.find(a.stringKey(i))
+                            : b.find(a.numberKey(i));
+    if (value == nullptr || !equal(a.value(i), *value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool equal(const NemoType &a, const NemoType &b) {
+  if (a.type != b.type) {
+    return false;
+  }
+
+  switch (a.type) {
+  case BuiltinType::INT:
+    return std::get<int>(a.value.value()) == std::get<int>(b.value.value());
+  case BuiltinType::CHAR:
+    return std::get<char>(a.value.value()) == std::get<char>(b.value.value());
+  case BuiltinType::STRING:
+    return std::get<NemoString>(a.value.value()) ==
+           std::get<NemoString>(b.value.value());
+  case BuiltinType::LAMBDA:
+    return std::get<const nemo::ir::Lambda *>(a.value.value()) ==
+           std::get<const nemo::ir::Lambda *>(b.value.value());
+  case BuiltinType::COLLECTION:
+    return equal(a.collection.value(), b.collection.value());
+  case BuiltinType::ARRAY:
+    return equal(std::get<NemoArray>(a.value.value()),
+                 std::get<NemoArray>(b.value.value()));
+  case BuiltinType::RECORD:
+    return std::get<const RecordType *>(a.value.value()) ==
+               std::get<const RecordType *>(b.value.value()) &&
+           equal(a.collection.value(), b.collection.value());
+  case BuiltinType::TABLE:
+    return equal(std::get<NemoTable>(a.value.value()),
+                 std::get<NemoTable>(b.value.value()));
+  case BuiltinType::MAP:
+    return equal(*std::get<NemoMap>(a.value.value()).table,
+                 *std::get<NemoMap>(b.value.value()).table);
+  case BuiltinType::VOID:
+    return true;
+  }
+  return false;
+}
+
+void equals(NemoType &a, const NemoType &b, ScopeContext &) {
+  a = numberType(equal(a, b));
+}
+
+void set(Table &table, Kind op, BuiltinType type, Handler handler) {
+  const auto index = static_cast<size_t>(type);
+  table[static_cast<size_t>(op)][index][index] = handler;
+}
+
+template <Kind op> void define(Table &table) {
+  set(table, op, BuiltinType::INT, number<op>);
+  set(table, op, BuiltinType::CHAR, character<op>);
+
+  if constexpr (op == Kind::Add) {
+    set(table, op, BuiltinType::STRING, concatStrings);
+    set(table, op, BuiltinType::COLLECTION, concatCollections);
+  } else if constexpr (isComparison(op)) {
+    set(table, op, BuiltinType::STRING, compareStrings<op>);
+  }
+
+  if constexpr (op == Kind::Equal) {
+    for (const auto type :
+         {BuiltinType::COLLECTION, BuiltinType::LAMBDA, BuiltinType::ARRAY,
+          BuiltinType::RECORD, BuiltinType::TABLE, BuiltinType::MAP,
+          BuiltinType::VOID}) {
+      set(table, op, type, equals);
+    }
+  }
+}
+
+Table makeTable() {
+  Table table;
+  for (auto &byLeft : table) {
+    for (size_t left = 0; left < typeCount; left++) {
+      for (size_t right = 0; right < typeCount; right++) {
+        byLeft[left][right] = left == right ? undefined : mismatch;
+      }
+    }
+  }
+
+  [&]<size_t... kinds>(std::index_sequence<kinds...>) {
+    (define<static_cast<Kind>(kinds)>(table), ...);
+  }(std::make_index_sequence<nemo::ir::Operator::kindCount>{});
+  return table;
+}
+
+const Table table = makeTable();
+
+} // namespace
+
+void apply(Kind op, NemoType &a, const NemoType &b, ScopeContext &ctx) {
+  table[static_cast<size_t>(op)][static_cast<size_t>(a.type)]
+       [static_cast<size_t>(b.type)](a, b, ctx);
+}
+
+} // namespace nemo::operators
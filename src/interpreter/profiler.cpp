@@ -0,0 +1,167 @@
+#include "interpreter/profiler.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+namespace nemo::profiler {
+
+bool enabled = false;
+
+namespace {
+
+constexpr int kMaxDepth = 64;
+constexpr int kMaxSampleDepth = 16;
+constexpr size_t kSampleCapacity = 1 << 16;
+
+struct Sample {
+  int depth;
+  Frame frames[kMaxSampleDepth];
+};
+
+// Written by the evaluator and read from the SIGPROF handler on the same
+// thread, so plain stores separated by signal fences are sufficient.
+Frame stack[kMaxDepth];
+volatile sig_atomic_t depth = 0;
+
+std::vector<Sample> samples;
+volatile sig_atomic_t sampleCount = 0;
+volatile sig_atomic_t dropped = 0;
+
+std::string script = "<stdin>";
+std::string output;
+std::map<std::string, unsigned long> folded;
+
+void onSample(int) {
+  if (static_cast<size_t>(sampleCount) >= samples.size()) {
+    dropped = dropped + 1;
+    return;
+  }
+
+  auto &sample = samples[sampleCount];
+  const int frames = depth < kMaxSampleDepth ? depth : kMaxSampleDepth;
+  for (int i = 0; i < frames; i++) {
+    sample.frames[i] = stack[i];
+  }
+  sample.depth = frames;
+  sampleCount = sampleCount + 1;
+}
+
+std::string frameName(const Frame &frame) {
+  switch (frame.kind) {
+  case FrameKind::Statement:
+    return script + ":" + std::to_string(frame.line + 1);
+  case FrameKind::Stage:
+    return "stage " + std::to_string(frame.index) + " " + frame.name;
+  case FrameKind::Builtin:
+    return frame.name;
+  }
+  return "?";
+}
+
+void setTimer(int intervalUs) {
+  itimerval timer{};
+  timer.it_interval.tv_sec = intervalUs / 1000000;
+  timer.it_interval.tv_usec = intervalUs % 1000000;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+} // namespace
+
+void push(FrameKind kind, const char *name, int line, int index) {
+  if (depth < kMaxDepth) {
+    stack[depth] = Frame{kind, name, line, index};
+  }
+  std::atomic_signal_fence(std::memory_order_release);
+  depth = depth + 1;
+}
+
+void pop() {
+  depth = depth - 1;
+  std::atomic_signal_fence(std::memory_order_release);
+}
+
+bool start(const std::string &outputPath, int intervalUs) {
+  samples.resize(kSampleCapacity);
+  output = outputPath;
+
+  struct sigaction action{};
+  action.sa_handler = onSample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    std::cerr << "Could not install profiler signal handler: "
+              << strerror(errno) << std::endl;
+    return false;
+  }
+
+  enabled = true;
+  setTimer(intervalUs);
+  return true;
+}
+
+void setScript(const std::string &name) { script = name; }
+
+void collect() {
+  if (!enabled) {
+    return;
+  }
+
+  sigset_t block, previous;
+  sigemptyset(&block);
+  sigaddset(&block, SIGPROF);
+  sigprocmask(SIG_BLOCK, &block, &previous);
+
+  for (sig_atomic_t i = 0; i < sampleCount; i++) {
+    const auto &sample = samples[i];
+    std::string stackName;
+    for (int f = 0; f < sample.depth; f++) {
+      if (f > 0) {
+        stackName += ";";
+      }
+      stackName += frameName(sample.frames[f]);
+    }
+    if (stackName.empty()) {
+      // Time spent outside evaluate(), which is almost entirely parsing.
+      stackName = script + ";(parse)";
+    }
+    folded[stackName]++;
+  }
+  sampleCount = 0;
+
+  sigprocmask(SIG_SETMASK, &previous, nullptr);
+}
+
+void stop() {
+  if (!enabled) {
+    return;
+  }
+
+  setTimer(0);
+  collect();
+  enabled = false;
+  signal(SIGPROF, SIG_DFL);
+
+  std::ofstream out(output);
+  if (!out) {
+    std::cerr << "Could not write profile to " << output << std::endl;
+    return;
+  }
+  for (const auto &[stackName, count] : folded) {
+    out << stackName << " " << count << "\n";
+  }
+
+  if (dropped > 0) {
+    std::cerr << "Profiler dropped " << dropped
+              << " samples, the sample buffer was full" << std::endl;
+  }
+}
+
+} // namespace nemo::profiler
@@ -0,0 +1,127 @@
+#include "interpreter/stats.h"
+#include "nemo/common.hpp"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nemo::stats {
+
+bool enabled = false;
+
+namespace {
+
+std::map<std::string, BuiltinStats> table;
+
+// Number of elements a value carries: collection, string, array, table or
+// map length or 1 for scalars.
+uint64_t elementCount(const NemoType &value) {
+  switch (value.type) {
+  case BuiltinType::COLLECTION:
+    return value.collection.value().size();
+  case BuiltinType::STRING:
+    return std::get<NemoString>(value.value.value()).size();
+  case BuiltinType::ARRAY:
+    return std::get<NemoArray>(value.value.value()).size;
+  case BuiltinType::TABLE:
+    return std::get<NemoTable>(value.value.value()).rows;
+  case BuiltinType::MAP:
+    return std::get<NemoMap>(value.value.value()).table->size();
+  case BuiltinType::VOID:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+} // namespace
+
+Builtin instrument(const std::string &name, Builtin func) {
+  if (!enabled) {
+    return func;
+  }
+
+  // std::map nodes are stable, so the wrapper can keep a pointer to its entry.
+  auto *entry = &table[name];
+
+  return [entry, func = std::move(func)](std::vector<NemoType> args) {
+    // Added by record(), so a builtin that never returns, such as exit,
+    // counts neither a call nor its inputs.
+    uint64_t elementsIn = 0;
+    for (const auto &arg : args) {
+      elementsIn += elementCount(arg);
+    }
+
+    const auto allocatedBefore = nemo::memory::current->total.allocated;
+    const auto start = std::chrono::steady_clock::now();
+    auto record = [&]() {
+      const uint64_t elapsed =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      entry->calls++;
+      entry->elementsIn += elementsIn;
+      entry->totalNs += elapsed;
+      entry->maxNs = std::max(entry->maxNs, elapsed);
+      entry->bytesAllocated +=
+          nemo::memory::current->total.allocated - allocatedBefore;
+    };
+
+    try {
+      auto result = func(std::move(args));
+      record();
+      entry->elementsOut += elementCount(result);
+      return result;
+    } catch (...) {
+      record();
+      throw;
+    }
+  };
+}
+
+const std::map<std::string, BuiltinStats> &builtins() { return table; }
+
+void dumpJson(std::ostream &out) {
+  out << "{\"builtins\":{";
+  bool first = true;
+  for (const auto &[name, entry] : table) {
+    if (!first) {
+      out << ",";
+    }
+    first = false;
+    out << "\"" << name << "\":{"
+        << "\"calls\":" << entry.calls << ",\"total_ns\":" << entry.totalNs
+        << ",\"max_ns\":" << entry.maxNs
+        << ",\"bytes_allocated\":" << entry.bytesAllocated
+        << ",\"elements_in\":" << entry.elementsIn
+        << ",\"elements_out\":" << entry.elementsOut << "}";
+  }
+  out << "},\"memory\":{";
+
+  const auto &accounting = nemo::memory::accounting;
+  auto usage = [&](const char *name, const nemo::memory::Usage &entry) {
+    out << "\"" << name << "\":{\"live\":" << entry.live
+        << ",\"peak\":" << entry.peak << ",\"allocated\":" << entry.allocated
+        << "}";
+  };
+  for (int kind = 0; kind < nemo::memory::kindCount; kind++) {
+    usage(nemo::memory::kindName(static_cast<nemo::memory::Kind>(kind)),
+          accounting.kinds[kind]);
+    out << ",";
+  }
+  usage("total", accounting.total);
+  out << ",\"limit\":" << accounting.limit << "}";
+
+  const auto &heap = accounting.heap.stats;
+  out << ",\"heap\":{\"chunks\":" << heap.chunks
+      << ",\"bumped_bytes\":" << heap.bumpedBytes
+      << ",\"reused\":" << heap.reused << ",\"large\":" << heap.large
+      << ",\"remote\":" << heap.remote
+      << ",\"collections\":" << heap.collections
+      << ",\"released_chunks\":" << heap.releasedChunks
+      << ",\"pause_ns\":{\"total\":" << heap.pauseNs
+      << ",\"max\":" << heap.maxPauseNs << "}}}" << std::endl;
+}
+
+} // namespace nemo::stats
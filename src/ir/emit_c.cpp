@@ -0,0 +1,566 @@
+#include "ir/ir.h"
+
+#include <cstdio>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace nemo::ir {
+
+namespace {
+
+// Runtime functions of the builtins a compiled program can call, see
+// runtime/nemo_rt.h.
+const std::unordered_map<std::string, std::string> runtimeBuiltins = {
+    {"print", "nemo_rt_print"},         {"println", "nemo_rt_println"},
+    {"exit", "nemo_rt_exit"},           {"len", "nemo_rt_len"},
+    {"sum", "nemo_rt_sum"},             {"to_string", "nemo_rt_to_string"},
+    {"join", "nemo_rt_join"},           {"range", "nemo_rt_range"},
+};
+
+// A C string literal holding text. Question marks are escaped so that no
+// trigraph can form.
+std::string literal(std::string_view text) {
+  std::string result = "\"";
+  for (const unsigned char c : text) {
+    if (c == '"' || c == '\\' || c == '?') {
+      result += '\\';
+      result += static_cast<char>(c);
+    } else if (c >= 0x20 && c < 0x7f) {
+      result += static_cast<char>(c);
+    } else {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\%03o", c);
+      result += escape;
+    }
+  }
+  return result + "\"";
+}
+
+// Source of a statement as a C comment.
+std::string comment(const Statement &statement) {
+  auto text = statement.to_string();
+  for (auto &c : text) {
+    if (c == '\n') {
+      c = ' ';
+    }
+  }
+  for (auto end = text.find("*/"); end != std::string::npos;
+       end = text.find("*/", end)) {
+    text.insert(end + 1, " ");
+  }
+  return "/* " + text + " */";
+}
+
+// Emits the C code of a program. Values live in C variables: globals in
+// `globals`, the locals of a lambda in its `locals` array. Each statement
+// runs its pipeline on a `result` variable, stage after stage, so that
+// stages print and fail in the interpreter's order. String and collection
+// literals are immutable once built and become `constants`, built before
+// the first statement. Each lambda becomes a C function, and the top-level
+// statements are split into functions of chunkSize statements since C
+// compilers take superlinear time over long functions.
+class Emitter {
+public:
+  static constexpr size_t chunkSize = 16;
+
+  explicit Emitter(const SymbolTable &symbols) : symbols(symbols) {}
+
+  void program(const Program &program) {
+    for (const auto &statement : program.statements) {
+      if (statements % chunkSize == 0) {
+        chunks.emplace_back();
+      }
+      statements++;
+      auto &code = chunks.back();
+      code << "  " << comment(statement) << "\n";
+      this->statement(statement, code, "  ", nullptr, Use::Discard);
+    }
+  }
+
+  void write(std::ostream &out) const {
+    out << "/* Generated by nemo --emit-c. */\n"
+        << "#include \"runtime/nemo_rt.h\"\n\n"
+        << "#include <stddef.h>\n\n";
+    if (symbols.globalCount() > 0) {
+      out << "static nemo_rt_value_t globals[" << symbols.globalCount()
+          << "];\n";
+    }
+    if (!constants.empty()) {
+      out << "static nemo_rt_value_t constants[" << constants.size()
+          << "];\n";
+    }
+    out << "\n";
+
+    for (size_t i = 0; i < lambdas.size(); i++) {
+      out << "static nemo_rt_value_t lambda_" << i
+          << "(nemo_rt_value_t argument, nemo_rt_tail_t *tail);\n";
+    }
+    for (size_t i = 0; i < lambdas.size(); i++) {
+      out << "static const nemo_rt_lambda_t lambda_" << i << "_value = {lambda_"
+          << i << ", " << literal(lambdas[i].source) << "};\n";
+    }
+    for (const auto &lambda : lambdas) {
+      out << "\n" << lambda.code;
+    }
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+      out << "\nstatic void statements_" << i << "(void) {\n"
+          << chunks[i].str() << "}\n";
+    }
+
+    out << "\nint main(void) {\n"
+        << "  nemo_rt_init();\n";
+    for (size_t i = 0; i < constants.size(); i++) {
+      out << "  constants[" << i << "] = " << constants[i] << ";\n";
+    }
+    for (size_t i = 0; i < chunks.size(); i++) {
+      out << "  statements_" << i << "();\n";
+    }
+    out << "  return 0;\n"
+        << "}\n";
+  }
+
+private:
+  struct Function {
+    std::string source;
+    std::string code;
+  };
+
+  // Where the value of a statement goes: dropped, stored in the C variable
+  // target, or, ending a lambda body, returned, through the tail call
+  // protocol when its last stage calls a lambda.
+  enum class Use { Discard, Store, Return };
+
+  void statement(const Statement &statement, std::ostream &code,
+                 const std::string &indent, const Lambda *lambda, Use use,
+                 const std::string &target = "") {
+    if (std::holds_alternative<TypeDefinition>(statement.statement)) {
+      throw std::runtime_error("record types cannot be compiled to C");
+    }
+
+    const auto *assignment = std::get_if<Assignment>(&statement.statement);
+    const auto &pipeline = assignment != nullptr
+                               ? assignment->value
+                               : std::get<Pipeline>(statement.statement);
+    const auto returns = use == Use::Return && assignment == nullptr;
+    const auto inner = indent + "  ";
+
+    // A conditional ending a lambda body returns from each of its branches,
+    // so calls ending them are tail calls too.
+    if (returns && pipeline.stages.empty() && branches(pipeline.head)) {
+      code << indent << "{\n";
+      control(pipeline.head, code, inner, lambda, use, target);
+      code << indent << "}\n";
+      return;
+    }
+
+    const auto tail = returns && !pipeline.stages.empty() &&
+                      tailCall(pipeline.stages.back());
+    const auto count = pipeline.stages.size() - (tail ? 1 : 0);
+
+    code << indent << "{\n";
+    const auto head = operand(pipeline.head, code, inner, lambda);
+    code << inner << "nemo_rt_value_t result = " << head << ";\n";
+    for (size_t i = 0; i < count; i++) {
+      stage(pipeline.stages[i], code, inner, lambda);
+    }
+
+    if (assignment != nullptr) {
+      code << inner << "nemo_rt_assign(&" << variable(assignment->variable)
+           << ", result);\n";
+      if (use == Use::Store) {
+        code << inner << target << " = nemo_rt_void();\n";
+      } else if (use == Use::Return) {
+        code << inner << "result = nemo_rt_void();\n";
+      }
+    } else if (use == Use::Discard) {
+      code << inner << "nemo_rt_release(result);\n";
+    } else if (use == Use::Store) {
+      code << inner << target << " = result;\n";
+    }
+    if (use != Use::Return) {
+      code << indent << "}\n";
+      return;
+    }
+
+    if (tail) {
+      code << inner << "const nemo_rt_value_t callee = "
+           << callee(pipeline.stages.back().target) << ";\n";
+    }
+    releaseLocals(*lambda, code, inner);
+    code << inner
+         << (tail ? "return nemo_rt_tail_call(tail, &callee, result);\n"
+                  : "return result;\n")
+         << indent << "}\n";
+  }
+
+  // Emits statements, the value of the last one, None without one, used as
+  // use says.
+  void block(const std::vector<Statement> &statements, std::ostream &code,
+             const std::string &indent, const Lambda *lambda, Use use,
+             const std::string &target) {
+    for (size_t i = 0; i < statements.size(); i++) {
+      this->statement(statements[i], code, indent, lambda,
+                      i + 1 == statements.size() ? use : Use::Discard, target);
+    }
+    if (!statements.empty()) {
+      return;
+    }
+    if (use == Use::Store) {
+      code << indent << target << " = nemo_rt_void();\n";
+    } else if (use == Use::Return) {
+      releaseLocals(*lambda, code, indent);
+      code << indent << "return nemo_rt_void();\n";
+    }
+  }
+
+  static bool branches(const Expression &expression) {
+    return std::holds_alternative<If>(expression.value) ||
+           std::holds_alternative<Match>(expression.value);
+  }
+
+  static bool controls(const Expression &expression) {
+    return branches(expression) ||
+           std::holds_alternative<Loop>(expression.value);
+  }
+
+  // A C variable name not used yet in the program.
+  std::string temporary(const std::string &name) {
+    return name + "_" + std::to_string(temporaries++);
+  }
+
+  // Emits an if, match or loop as C branches and loops, its value used as
+  // use says. Loops are never in tail position.
+  void control(const Expression &expression, std::ostream &code,
+               const std::string &indent, const Lambda *lambda, Use use,
+               const std::string &target) {
+    const auto inner = indent + "  ";
+
+    if (const auto *node = std::get_if<If>(&expression.value)) {
+      const auto condition = temporary("condition");
+      code << indent << "nemo_rt_value_t " << condition << ";\n";
+      block(node->condition, code, indent, lambda, Use::Store, condition);
+      code << indent << "if (nemo_rt_test(" << condition << ")) {\n";
+      block(node->then, code, inner, lambda, use, target);
+      code << indent << "} else {\n";
+      block(node->otherwise, code, inner, lambda, use, target);
+      code << indent << "}\n";
+    } else if (const auto *node = std::get_if<Match>(&expression.value)) {
+      // The arm is picked and the subject released before the arm runs,
+      // which may return.
+      const auto subject = temporary("subject");
+      const auto arm = temporary("arm");
+      code << indent << "nemo_rt_value_t " << subject << ";\n";
+      block(node->subject, code, indent, lambda, Use::Store, subject);
+      if (!node->arms.empty()) {
+        code << indent << "int " << arm << " = " << node->arms.size()
+             << ";\n";
+      }
+      for (size_t i = 0; i < node->arms.size(); i++) {
+        code << indent << (i > 0 ? "else if (" : "if (")
+             << pattern(node->arms[i], subject) << ") {\n"
+             << inner << arm << " = " << i << ";\n"
+             << indent << "}\n";
+      }
+      code << indent << "nemo_rt_release(" << subject << ");\n";
+      for (size_t i = 0; i < node->arms.size(); i++) {
+        code << indent << (i > 0 ? "} else if (" : "if (") << arm
+             << " == " << i << ") {\n";
+        block(node->arms[i].body, code, inner, lambda, use, target);
+      }
+      code << indent << (node->arms.empty() ? "{\n" : "} else {\n");
+      block({}, code, inner, lambda, use, target);
+      code << indent << "}\n";
+    } else {
+      const auto &loop = std::get<Loop>(expression.value);
+      const auto condition = temporary("condition");
+      code << indent << "for (;;) {\n"
+           << inner << "nemo_rt_value_t " << condition << ";\n";
+      block(loop.condition, code, inner, lambda, Use::Store, condition);
+      code << inner << "if (!nemo_rt_test(" << condition << ")) {\n"
+           << inner << "  break;\n"
+           << inner << "}\n";
+      block(loop.body, code, inner, lambda, Use::Discard, "");
+      code << indent << "}\n";
+      block({}, code, indent, lambda, use, target);
+    }
+  }
+
+  // Whether a match subject held by the C variable subject matches an arm.
+  std::string pattern(const Arm &arm, const std::string &subject) {
+    return std::visit(
+        [&](const auto &pattern) -> std::string {
+          using Pattern = std::decay_t<decltype(pattern)>;
+
+          if constexpr (std::is_same_v<Pattern, std::monostate>) {
+            return "1";
+          } else if constexpr (std::is_same_v<Pattern, Number>) {
+            return "nemo_rt_matches(" + subject + ", nemo_rt_number(" +
+                   std::to_string(pattern.value) + "))";
+          } else if constexpr (std::is_same_v<Pattern, Character>) {
+            return "nemo_rt_matches(" + subject + ", nemo_rt_char(" +
+                   std::to_string(static_cast<int>(pattern.value)) + "))";
+          } else {
+            return "nemo_rt_matches(" + subject + ", constants[" +
+                   std::to_string(constant(pattern)) + "])";
+          }
+        },
+        arm.pattern);
+  }
+
+  // The head of a pipeline or the operand of an operator. An if, match or
+  // loop is emitted before the line using its value.
+  std::string operand(const Expression &expression, std::ostream &code,
+                      const std::string &indent, const Lambda *lambda) {
+    if (!controls(expression)) {
+      return this->expression(expression);
+    }
+    const auto value = temporary("value");
+    code << indent << "nemo_rt_value_t " << value << ";\n";
+    control(expression, code, indent, lambda, Use::Store, value);
+    return value;
+  }
+
+  static void releaseLocals(const Lambda &lambda, std::ostream &code,
+                            const std::string &indent) {
+    if (lambda.localCount > 0) {
+      code << indent << "for (size_t i = 0; i < " << lambda.localCount
+           << "; i++) {\n"
+           << indent << "  nemo_rt_release(locals[i]);\n"
+           << indent << "}\n";
+    }
+  }
+
+  // Whether a stage ending a lambda body calls a lambda.
+  static bool tailCall(const Stage &stage) {
+    if (stage.kind != Stage::Kind::Pipe) {
+      return false;
+    }
+    if (std::holds_alternative<Lambda>(stage.target.value)) {
+      return true;
+    }
+    const auto *identifier = std::get_if<Identifier>(&stage.target.value);
+    return identifier != nullptr &&
+           (identifier->binding.kind == Binding::Kind::Local ||
+            identifier->binding.kind == Binding::Kind::Global);
+  }
+
+  // The callee of a tail call, copied before the locals are released.
+  std::string callee(const Expression &target) {
+    if (const auto *lambda = std::get_if<Lambda>(&target.value)) {
+      return "nemo_rt_lambda(&" + function(*lambda) + "_value)";
+    }
+    return variable(std::get<Identifier>(target.value));
+  }
+
+  std::string variable(const Identifier &identifier) const {
+    const auto index = std::to_string(identifier.binding.index);
+    return identifier.binding.kind == Binding::Kind::Local
+               ? "locals[" + index + "]"
+               : "globals[" + index + "]";
+  }
+
+  // Applies a stage to the running result held by the C variable result.
+  void stage(const Stage &stage, std::ostream &code, const std::string &indent,
+             const Lambda *lambda) {
+    if (stage.kind == Stage::Kind::Operator) {
+      // Indexed by Operator::Kind.
+      static const char *const operators[Operator::kindCount] = {
+          "add", "sub", "mul", "div", "mod", "lt", "le", "eq", "ge", "gt"};
+      const auto target = operand(stage.target, code, indent, lambda);
+      code << indent << "nemo_rt_" << operators[static_cast<int>(stage.op.kind)]
+           << "(&result, " << target << ");\n";
+      return;
+    }
+
+    code << indent << call(stage.target) << ";\n";
+  }
+
+  // A `|>` stage calling target with the running result.
+  std::string call(const Expression &target) {
+    return std::visit(
+        [&](const auto &node) -> std::string {
+          using Node = std::decay_t<decltype(node)>;
+
+          if constexpr (std::is_same_v<Node, Identifier>) {
+            if (node.binding.kind == Binding::Kind::Builtin) {
+              return builtin(node.name) + "(&result)";
+            }
+            return "nemo_rt_apply(&result, &" + variable(node) + ")";
+          } else if constexpr (std::is_same_v<Node, Lambda>) {
+            return "nemo_rt_call(&result, &" + function(node) + "_value)";
+          } else if constexpr (std::is_same_v<Node, Field>) {
+            return "nemo_rt_field(&result, " + literal(node.name) + ")";
+          } else {
+            return "nemo_rt_not_found(&result)";
+          }
+        },
+        target.value);
+  }
+
+  const std::string &builtin(const std::string &name) const {
+    const auto found = runtimeBuiltins.find(name);
+    if (found == runtimeBuiltins.end()) {
+      throw std::runtime_error("builtin " + name +
+                               " cannot be compiled to C");
+    }
+    return found->second;
+  }
+
+  // An expression evaluated without an argument, as the head of a pipeline
+  // or the right operand of an operator, other than an if, match or loop.
+  std::string expression(const Expression &expression) {
+    return std::visit(
+        [&](const auto &node) -> std::string {
+          using Node = std::decay_t<decltype(node)>;
+
+          if constexpr (std::is_same_v<Node, Identifier>) {
+            return read(node);
+          } else if constexpr (std::is_same_v<Node, Number>) {
+            return "nemo_rt_number(" + std::to_string(node.value) + ")";
+          } else if constexpr (std::is_same_v<Node, Character>) {
+            return "nemo_rt_char(" +
+                   std::to_string(static_cast<int>(node.value)) + ")";
+          } else if constexpr (std::is_same_v<Node, Lambda>) {
+            return "nemo_rt_lambda(&" + function(node) + "_value)";
+          } else if constexpr (std::is_same_v<Node, Field>) {
+            return "nemo_rt_error(" +
+                   literal("Field ." + node.name + " needs a record") + ")";
+          } else if constexpr (std::is_same_v<Node, String> ||
+                               std::is_same_v<Node, Collection>) {
+            return "nemo_rt_retain(constants[" +
+                   std::to_string(constant(node)) + "])";
+          } else {
+            throw std::logic_error("control expression as a value");
+          }
+        },
+        expression.value);
+  }
+
+  // Reads a variable. A builtin read without arguments is called with
+  // none; print and println accept that, the others fail and the
+  // interpreter reads a global of the same name instead.
+  std::string read(const Identifier &identifier) {
+    switch (identifier.binding.kind) {
+    case Binding::Kind::Local:
+      return "nemo_rt_retain(" + variable(identifier) + ")";
+    case Binding::Kind::Global:
+      return "nemo_rt_global(" + variable(identifier) + ")";
+    default:
+      break;
+    }
+
+    builtin(identifier.name);
+    if (identifier.name == "print") {
+      return "nemo_rt_void()";
+    }
+    if (identifier.name == "println") {
+      return "nemo_rt_newline()";
+    }
+    const auto global = symbols.lookupGlobal(identifier.name);
+    if (global.kind == Binding::Kind::Global) {
+      return "nemo_rt_global(globals[" + std::to_string(global.index) + "])";
+    }
+    return "nemo_rt_error(\"Variable not found\")";
+  }
+
+  // Index of the constant built from a string or collection literal.
+  int constant(const String &string) {
+    const auto found = strings.find(string.value);
+    if (found != strings.end()) {
+      return found->second;
+    }
+    constants.push_back("nemo_rt_string(" + literal(string.value) + ", " +
+                        std::to_string(string.value.size()) + ")");
+    strings.insert({string.value, static_cast<int>(constants.size()) - 1});
+    return constants.size() - 1;
+  }
+
+  int constant(const Collection &collection) {
+    if (collection.elements.empty()) {
+      constants.push_back("nemo_rt_collection(0, NULL)");
+      return constants.size() - 1;
+    }
+
+    std::string elements;
+    for (const auto &element : collection.elements) {
+      elements += (elements.empty() ? "" : ", ") + expression(element);
+    }
+    constants.push_back("nemo_rt_collection(" +
+                        std::to_string(collection.elements.size()) +
+                        ", (nemo_rt_value_t[]){" + elements + "})");
+    return constants.size() - 1;
+  }
+
+  // Name of the C function of a lambda, emitting it on first use.
+  std::string function(const Lambda &lambda) {
+    const auto found = functions.find(&lambda);
+    if (found != functions.end()) {
+      return found->second;
+    }
+
+    const auto index = lambdas.size();
+    const auto name = "lambda_" + std::to_string(index);
+    functions.insert({&lambda, name});
+    lambdas.push_back(Function{lambda.to_string(), ""});
+
+    std::ostringstream code;
+    code << "static nemo_rt_value_t " << name
+         << "(nemo_rt_value_t argument, nemo_rt_tail_t *tail) {\n";
+    if (lambda.localCount > 0) {
+      code << "  nemo_rt_value_t locals[" << lambda.localCount << "] = {";
+      for (int i = 0; i < lambda.localCount; i++) {
+        code << (i > 0 ? ", " : "") << "NEMO_RT_VOID_INIT";
+      }
+      code << "};\n";
+    }
+    code << "  (void)tail;\n";
+    code << "  if (!nemo_rt_bind(argument, " << lambda.parameters.size()
+         << ", " << (lambda.localCount > 0 ? "locals" : "NULL") << ")) {\n"
+         << "    return nemo_rt_void();\n"
+         << "  }\n";
+
+    if (lambda.body.empty()) {
+      releaseLocals(lambda, code, "  ");
+      code << "  return nemo_rt_void();\n";
+    }
+    for (size_t i = 0; i < lambda.body.size(); i++) {
+      code << "  " << comment(lambda.body[i]) << "\n";
+      statement(lambda.body[i], code, "  ", &lambda,
+                i + 1 == lambda.body.size() ? Use::Return : Use::Discard);
+    }
+    code << "}\n";
+
+    lambdas[index].code = code.str();
+    return name;
+  }
+
+  const SymbolTable &symbols;
+  std::vector<std::ostringstream> chunks;
+  size_t statements = 0;
+  std::vector<Function> lambdas;
+  std::unordered_map<const Lambda *, std::string> functions;
+  std::vector<std::string> constants;
+  std::unordered_map<std::string, int> strings;
+  int temporaries = 0;
+};
+
+} // namespace
+
+void emitC(const std::vector<const Program *> &programs,
+           const SymbolTable &symbols, std::ostream &out) {
+  Emitter emitter(symbols);
+  for (const auto *program : programs) {
+    emitter.program(*program);
+  }
+  emitter.write(out);
+}
+
+} // namespace nemo::ir
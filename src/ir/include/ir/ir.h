@@ -1,11 +1,19 @@
 #pragma once
 #include "mpc/mpc.h"
 
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <variant>
-#include <memory>
 #include <vector>
 
+namespace nemo::closure {
+class Body;
+}
+
 namespace nemo::ir {
 
 enum class BuiltinType {
@@ -19,110 +27,218 @@ enum class BuiltinType {
   Any,
 };
 
-// Forward declarations
-struct Statement;
-
+// Source position of a node, copied from the mpc state (0 based).
+struct Location {
+  int row = 0;
+  int col = 0;
+};
 
-// Base class for all primitives
-struct PrimitiveBase {
-  BuiltinType type;
+// Where an identifier lives at run time. Identifiers are resolved once when
+// a program is compiled against a SymbolTable.
+struct Binding {
+  enum class Kind {
+    Unresolved,
+    Builtin,
+    Global,
+    Local,
+  };
 
-  virtual std::string to_string() const;
+  Kind kind = Kind::Unresolved;
+  int index = -1;
 };
 
-struct Identifier: public PrimitiveBase {
+// Forward declarations
+struct Expression;
+struct Statement;
+struct Lambda;
+
+struct Identifier {
   std::string name;
+  Binding binding;
 
-  std::string to_string() const override {
-    return name;
-  }
+  std::string to_string() const { return name; }
 };
 
-struct Number: public PrimitiveBase {
+struct Number {
   int value;
 
-  std::string to_string() const override {
-    return "number: " + std::to_string(value);
-  }
+  std::string to_string() const { return std::to_string(value); }
 };
 
-struct Character: public PrimitiveBase {
+struct Character {
   char value;
 
-  std::string to_string() const override {
-    return "character: " + std::string(1, value);
-  }
+  std::string to_string() const { return "'" + std::string(1, value) + "'"; }
 };
 
-struct String: public PrimitiveBase {
+struct String {
   std::string value;
 
-  std::string to_string() const override {
-    return "string: " + value;
-  }
+  std::string to_string() const { return "\"" + value + "\""; }
 };
 
-struct Collection: public PrimitiveBase {
-  BuiltinType elementType;
-  std::vector<PrimitiveBase> elements;
+struct Collection {
+  std::vector<Expression> elements;
 
-  std::string to_string() const override {
-    std::string result = "collection: [";
-    for (const auto& element : elements) {
-      result += element.to_string() + ", ";
-    }
-    result.pop_back();
-    result.pop_back();
-    result += "]";
-    return result;
-  }
+  std::string to_string() const;
 };
 
-struct Lambda: public PrimitiveBase {
-  std::vector<Identifier> parameters;
-  BuiltinType returnType;
+struct Parameter {
+  std::string name;
+  BuiltinType type = BuiltinType::Any;
+  // Name of the annotation as written, empty when the parameter has none.
+  std::string annotation;
+};
+
+// `.name` access to a field of a record. Field names get session-wide ids
+// when compiled, so a record type maps the id straight to a field offset.
+struct Field {
+  std::string name;
+  int id = -1;
+
+  std::string to_string() const { return "." + name; }
+};
+
+// Closure-compiled form of a lambda body, see interpreter/closure.h. Runtime
+// state like CallCache, filled by the session calling the lambda once the
+// body is hot. A copy, such as a specialized body, starts cold.
+struct CompiledBody {
+  const nemo::closure::Body *body = nullptr;
+  uint32_t calls = 0;
+
+  CompiledBody() = default;
+  CompiledBody(const CompiledBody &) {}
+  CompiledBody &operator=(const CompiledBody &) { return *this; }
+};
+
+struct Lambda {
+  std::vector<Parameter> parameters;
+  BuiltinType returnType = BuiltinType::Any;
   std::vector<Statement> body;
+  // Number of local slots (parameters first) a call needs.
+  int localCount = 0;
+  mutable CompiledBody compiled;
 
-  std::string to_string() const override {
-    std::string result = "lambda";
-    return result;
-  }
+  std::string to_string() const;
 };
 
+// `if condition { ... } else { ... }`. A condition holds when it is a nonzero
+// number. Its value is the value of the last statement of the branch taken,
+// None without one. Branches run in the enclosing scope: assignments in them
+// bind the enclosing lambda's locals or globals.
+struct If {
+  // A single pipeline statement, in a vector as Statement is incomplete
+  // here. So are the subject of Match and the condition of Loop.
+  std::vector<Statement> condition;
+  std::vector<Statement> then;
+  // `else if` is an else branch holding a single If.
+  std::vector<Statement> otherwise;
+
+  std::string to_string() const;
+};
+
+// `pattern => { ... }`, matching a literal or, for `_`, anything.
+struct Arm {
+  std::variant<std::monostate, Number, Character, String> pattern;
+  std::vector<Statement> body;
+
+  std::string to_string() const;
+};
+
+// `match subject { arm ... }` runs the first arm whose pattern equals the
+// subject, values of different types being different. Its value is the
+// value of the arm's last statement, None when no arm matches.
+struct Match {
+  std::vector<Statement> subject;
+  std::vector<Arm> arms;
+
+  std::string to_string() const;
+};
+
+// `while condition { ... }` runs the body as long as the condition holds,
+// without materializing anything per iteration. Its value is None. A loop
+// the walker keeps iterating is compiled to closures like a hot lambda body.
+struct Loop {
+  std::vector<Statement> condition;
+  std::vector<Statement> body;
+  mutable CompiledBody compiled;
+
+  std::string to_string() const;
+};
+
+struct Expression {
+  std::variant<Identifier, Number, Character, String, Collection, Lambda,
+               Field, If, Match, Loop>
+      value;
+  Location location;
+
+  std::string to_string() const;
+};
+
+// A binary operator, decoded from its symbol when the program is compiled.
+// Comparisons give 1 or 0.
 struct Operator {
+  enum class Kind {
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Less,
+    LessEqual,
+    Equal,
+    GreaterEqual,
+    Greater,
+  };
+  static constexpr int kindCount = static_cast<int>(Kind::Greater) + 1;
+
+  Kind kind = Kind::Add;
   std::string symbol;
 };
 
-struct FunctionCall {
-  Identifier function;
-  std::vector<PrimitiveBase> arguments;
+// Inline cache of a pipe stage calling a lambda: the bodies selected for the
+// callees and argument types seen at the call site. It is runtime state
+// filled by the interpreter and only valid in the bindings epoch of the
+// session it was filled in; a new epoch empties it.
+struct CallCache {
+  static constexpr int size = 4;
+  static constexpr int maxArity = 4;
+
+  struct Entry {
+    const Lambda *callee = nullptr;
+    std::array<BuiltinType, maxArity> arguments{};
+    const Lambda *body = nullptr;
+  };
+
+  uint64_t epoch = 0;
+  int count = 0;
+  std::array<Entry, size> entries;
+};
+
+// One `|>` or operator step of a pipeline applied to the running result.
+struct Stage {
+  enum class Kind {
+    Pipe,
+    Operator,
+  };
+
+  Kind kind;
+  Operator op;
+  Expression target;
+  // Type both operands of an operator are known to have. Only set in lambda
+  // bodies produced by specialize(), where it lets the interpreter skip the
+  // run-time type checks.
+  BuiltinType operands = BuiltinType::Any;
+  mutable CallCache cache{};
+
+  std::string to_string() const;
 };
 
 struct Pipeline {
-  std::vector<std::variant<PrimitiveBase, Operator, std::string, FunctionCall>> elements;
-
-  std::string to_string() const {
-    std::string result;
-    for (const auto& element : elements) {
-      if (std::holds_alternative<PrimitiveBase>(element)) {
-        result += std::get<PrimitiveBase>(element).to_string();
-      } else if (std::holds_alternative<Operator>(element)) {
-        result += std::get<Operator>(element).symbol;
-      } else if (std::holds_alternative<std::string>(element)) {
-        result += std::get<std::string>(element);
-      } else {
-        result += std::get<FunctionCall>(element).function.name + "(";
-        for (const auto& argument : std::get<FunctionCall>(element).arguments) {
-          result += argument.to_string() + ", ";
-        }
-        result.pop_back();
-        result.pop_back();
-        result += ")";
-      }
-    }
-    return result;
-  
-  }
+  Expression head;
+  std::vector<Stage> stages;
+
+  std::string to_string() const;
 };
 
 enum class AssignmentType {
@@ -134,60 +250,118 @@ enum class AssignmentType {
 struct Assignment {
   AssignmentType type;
   Identifier variable;
-  std::variant<PrimitiveBase, Pipeline> value;
-
-  std::string to_string() const {
-    std::string result;
-    switch (type) {
-      case AssignmentType::Const:
-        result += "const ";
-        break;
-      case AssignmentType::Let:
-        result += "let ";
-        break;
-      case AssignmentType::Var:
-        result += "var ";
-        break;
-    }
-    result += variable.name + " = ";
-    if (std::holds_alternative<PrimitiveBase>(value)) {
-      result += std::get<PrimitiveBase>(value).to_string();
-    } else {
-      result += std::get<Pipeline>(value).to_string();
-    }
-    return result;
-  }
+  Pipeline value;
+
+  std::string to_string() const;
+};
+
+// `type Name = { field: type ... }`. The type name is declared as a builtin,
+// the record constructor registered by the interpreter.
+struct TypeDefinition {
+  Identifier name;
+  std::vector<Parameter> fields;
+  // Session-wide ids of the fields, in declaration order.
+  std::vector<int> fieldIds;
+
+  std::string to_string() const;
 };
 
 struct Statement {
-  std::variant<Assignment, Pipeline> statement;
-  std::string to_string() const {
-    if (std::holds_alternative<Assignment>(statement)) {
-      return std::get<Assignment>(statement).to_string();
-    }
-    return std::get<Pipeline>(statement).to_string();
-  }
-};  
+  std::variant<Assignment, Pipeline, TypeDefinition> statement;
+  Location location;
+
+  std::string to_string() const;
+};
 
 struct Program {
   std::vector<Statement> statements;
 
-  std::string to_string() const {
-    std::string result;
-    for (const auto& statement : statements) {
-      result += statement.to_string();
-    }
-    return result;
-  
+  std::string to_string() const;
+};
+
+// Names known to a session. Builtins are registered once, globals get a
+// slot the first time they are seen and keep it for the whole session, so
+// programs compiled incrementally (e.g. REPL lines) share their slots.
+class SymbolTable {
+public:
+  int declareBuiltin(const std::string &name);
+  int declareGlobal(const std::string &name);
+  int declareField(const std::string &name);
+
+  Binding lookupBuiltin(const std::string &name) const;
+  Binding lookupGlobal(const std::string &name) const;
+
+  int builtinCount() const { return builtins.size(); }
+  int globalCount() const { return globals.size(); }
+  int fieldCount() const { return fields.size(); }
+
+  const std::string &globalName(int index) const { return globalNames[index]; }
+  const std::string &builtinName(int index) const {
+    return builtinNames[index];
   }
+
+private:
+  std::unordered_map<std::string, int> builtins;
+  std::unordered_map<std::string, int> globals;
+  std::unordered_map<std::string, int> fields;
+  std::vector<std::string> builtinNames;
+  std::vector<std::string> globalNames;
 };
 
+// Lowers the mpc AST produced by the Nemo grammar into a Program, resolving
+// identifiers against the symbol table. New globals are declared in it.
+// Lowering, like evaluating the program, recurses once per level of the
+// syntax tree, so a tree nested deeper than maxDepth is rejected instead.
 class Parser {
 public:
-  Parser() = default;
+  static constexpr int maxDepth = 2000;
 
-  std::unique_ptr<Program> parse(mpc_ast_t* ast) {
-    return nullptr;
-  }
+  explicit Parser(SymbolTable &symbols) : symbols(symbols) {}
+
+  std::unique_ptr<Program> parse(const mpc_ast_t *ast);
+
+private:
+  struct Scope {
+    std::unordered_map<std::string, int> locals;
+    int localCount = 0;
+  };
+
+  Statement parseStatement(const mpc_ast_t *ast);
+  TypeDefinition parseTypeDefinition(const mpc_ast_t *ast);
+  Assignment parseAssignment(const mpc_ast_t *ast);
+  Pipeline parsePipeline(const mpc_ast_t *ast);
+  Expression parseExpression(const mpc_ast_t *ast);
+  Lambda parseLambda(const mpc_ast_t *ast);
+  If parseIf(const mpc_ast_t *ast);
+  Match parseMatch(const mpc_ast_t *ast);
+  Loop parseLoop(const mpc_ast_t *ast);
+  std::vector<Statement> parseBlock(const mpc_ast_t *ast);
+  // A pipeline as the single statement of a condition or match subject.
+  std::vector<Statement> parseCondition(const mpc_ast_t *ast);
+
+  Identifier resolve(const std::string &name);
+
+  SymbolTable &symbols;
+  std::vector<Scope> scopes;
 };
-}
\ No newline at end of file
+
+// Type-checks the body of lambda for arguments of the given types, one per
+// parameter (Any when unknown), inferring the types of its locals. Where
+// branches join, a local keeps its type if every branch agrees on it; in a
+// loop it keeps the type it has on entry if the body preserves it. Returns a
+// copy of the lambda whose operators on operands known to be numbers are
+// marked as such, or null if there is no such operator.
+std::unique_ptr<Lambda> specialize(const Lambda &lambda,
+                                   const std::vector<BuiltinType> &arguments);
+
+// Lowers programs, compiled in order against symbols, to one C translation
+// unit whose main runs their statements on the runtime in
+// runtime/nemo_rt.h. Throws std::runtime_error for what a compiled program
+// cannot do: record types and builtins the runtime does not provide.
+void emitC(const std::vector<const Program *> &programs,
+           const SymbolTable &symbols, std::ostream &out);
+
+BuiltinType typeFromName(const std::string &name);
+std::string typeToString(BuiltinType type);
+
+} // namespace nemo::ir
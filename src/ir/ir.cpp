@@ -2,11 +2,548 @@
 #include "mpc/mpc.h"
 
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace nemo::ir {
 
+namespace {
+
+bool hasTag(const mpc_ast_t *ast, const char *tag) {
+  return std::string(ast->tag).find(tag) != std::string::npos;
+}
+
+Location locationOf(const mpc_ast_t *ast) {
+  return Location{static_cast<int>(ast->state.row),
+                  static_cast<int>(ast->state.col)};
+}
+
+Operator parseOperator(const std::string &symbol) {
+  static const std::unordered_map<std::string, Operator::Kind> kinds = {
+      {"+", Operator::Kind::Add},
+      {"-", Operator::Kind::Subtract},
+      {"*", Operator::Kind::Multiply},
+      {"/", Operator::Kind::Divide},
+      {"%", Operator::Kind::Modulo},
+      {"<", Operator::Kind::Less},
+      {"<=", Operator::Kind::LessEqual},
+      {"=", Operator::Kind::Equal},
+      {">=", Operator::Kind::GreaterEqual},
+      {">", Operator::Kind::Greater},
+  };
+  const auto found = kinds.find(symbol);
+  if (found == kinds.end()) {
+    throw std::runtime_error("unknown operator " + symbol);
+  }
+  return Operator{found->second, symbol};
+}
+
+std::string blockString(const std::vector<Statement> &statements) {
+  std::string result = "{";
+  for (const auto &statement : statements) {
+    result += " " + statement.to_string();
+  }
+  return result + " }";
+}
+
+std::string conditionString(const std::vector<Statement> &condition) {
+  return condition.empty() ? "" : condition.front().to_string();
+}
+
+// Throws if a node of ast lies deeper than maxDepth, walking the tree on an
+// explicit stack so the check itself cannot overflow.
+void checkDepth(const mpc_ast_t *ast, int maxDepth) {
+  std::vector<std::pair<const mpc_ast_t *, int>> pending{{ast, 0}};
+  while (!pending.empty()) {
+    const auto [node, depth] = pending.back();
+    pending.pop_back();
+    if (depth > maxDepth) {
+      throw std::runtime_error(
+          "Nesting deeper than " + std::to_string(maxDepth) +
+          " levels at line " + std::to_string(node->state.row + 1));
+    }
+    for (int i = 0; i < node->children_num; i++) {
+      pending.emplace_back(node->children[i], depth + 1);
+    }
+  }
+}
+
+} // namespace
+
+BuiltinType typeFromName(const std::string &name) {
+  if (name == "number" || name == "int") {
+    return BuiltinType::Number;
+  } else if (name == "character" || name == "char") {
+    return BuiltinType::Character;
+  } else if (name == "string") {
+    return BuiltinType::String;
+  } else if (name == "collection") {
+    return BuiltinType::Collection;
+  } else if (name == "lambda") {
+    return BuiltinType::Lambda;
+  } else if (name == "void") {
+    return BuiltinType::Void;
+  } else if (name == "any") {
+    return BuiltinType::Any;
+  }
+  return BuiltinType::Custom;
+}
+
+std::string typeToString(BuiltinType type) {
+  switch (type) {
+  case BuiltinType::Number:
+    return "number";
+  case BuiltinType::Character:
+    return "character";
+  case BuiltinType::String:
+    return "string";
+  case BuiltinType::Collection:
+    return "collection";
+  case BuiltinType::Lambda:
+    return "lambda";
+  case BuiltinType::Custom:
+    return "custom";
+  case BuiltinType::Void:
+    return "void";
+  case BuiltinType::Any:
+    return "any";
+  }
+  return "unknown";
+}
+
+std::string Collection::to_string() const {
+  std::string result = "[";
+  for (const auto &element : elements) {
+    if (result.size() > 1) {
+      result += " ";
+    }
+    result += element.to_string();
+  }
+  return result + "]";
+}
+
+std::string Lambda::to_string() const {
+  std::string result = "(";
+  for (const auto &parameter : parameters) {
+    if (result.size() > 1) {
+      result += ", ";
+    }
+    result += parameter.name;
+    if (!parameter.annotation.empty()) {
+      result += ": " + parameter.annotation;
+    }
+  }
+  result += ") -> {";
+  for (const auto &statement : body) {
+    result += " " + statement.to_string();
+  }
+  return result + " }";
+}
+
+std::string If::to_string() const {
+  auto result = "if " + conditionString(condition) + " " + blockString(then);
+  if (otherwise.empty()) {
+    return result;
+  }
+  const auto *pipeline =
+      otherwise.size() == 1 ? std::get_if<Pipeline>(&otherwise[0].statement)
+                            : nullptr;
+  if (pipeline != nullptr && pipeline->stages.empty() &&
+      std::holds_alternative<If>(pipeline->head.value)) {
+    return result + " else " + pipeline->head.to_string();
+  }
+  return result + " else " + blockString(otherwise);
+}
+
+std::string Arm::to_string() const {
+  const auto literal = std::visit(
+      [](const auto &node) -> std::string {
+        if constexpr (std::is_same_v<std::decay_t<decltype(node)>,
+                                     std::monostate>) {
+          return "_";
+        } else {
+          return node.to_string();
+        }
+      },
+      pattern);
+  return literal + " => " + blockString(body);
+}
+
+std::string Match::to_string() const {
+  std::string result = "match " + conditionString(subject) + " {";
+  for (const auto &arm : arms) {
+    result += " " + arm.to_string();
+  }
+  return result + " }";
+}
+
+std::string Loop::to_string() const {
+  return "while " + conditionString(condition) + " " + blockString(body);
+}
+
+std::string Expression::to_string() const {
+  return std::visit([](const auto &node) { return node.to_string(); }, value);
+}
+
+std::string Stage::to_string() const {
+  if (kind == Kind::Operator) {
+    return " " + op.symbol + " " + target.to_string();
+  }
+  return " |> " + target.to_string();
+}
+
+std::string Pipeline::to_string() const {
+  std::string result = head.to_string();
+  for (const auto &stage : stages) {
+    result += stage.to_string();
+  }
+  return result;
+}
+
+std::string Assignment::to_string() const {
+  std::string result;
+  switch (type) {
+  case AssignmentType::Const:
+    result += "const ";
+    break;
+  case AssignmentType::Let:
+    result += "let ";
+    break;
+  case AssignmentType::Var:
+    result += "var ";
+    break;
+  }
+  return result + variable.name + " <= " + value.to_string();
+}
+
+std::string TypeDefinition::to_string() const {
+  std::string result = "type " + name.name + " = {";
+  for (const auto &field : fields) {
+    result += " " + field.name + ": " + field.annotation;
+  }
+  return result + " }";
+}
+
+std::string Statement::to_string() const {
+  return std::visit([](const auto &node) { return node.to_string(); },
+                    statement);
+}
+
+std::string Program::to_string() const {
+  std::string result;
+  for (const auto &statement : statements) {
+    result += statement.to_string() + "\n";
+  }
+  return result;
+}
+
+int SymbolTable::declareBuiltin(const std::string &name) {
+  const auto found = builtins.find(name);
+  if (found != builtins.end()) {
+    return found->second;
+  }
+  builtins.insert({name, static_cast<int>(builtinNames.size())});
+  builtinNames.push_back(name);
+  return builtinNames.size() - 1;
+}
+
+int SymbolTable::declareGlobal(const std::string &name) {
+  const auto found = globals.find(name);
+  if (found != globals.end()) {
+    return found->second;
+  }
+  globals.insert({name, static_cast<int>(globalNames.size())});
+  globalNames.push_back(name);
+  return globalNames.size() - 1;
+}
+
+int SymbolTable::declareField(const std::string &name) {
+  const auto found = fields.find(name);
+  if (found != fields.end()) {
+    return found->second;
+  }
+  const auto id = static_cast<int>(fields.size());
+  fields.insert({name, id});
+  return id;
+}
+
+Binding SymbolTable::lookupBuiltin(const std::string &name) const {
+  const auto found = builtins.find(name);
+  if (found == builtins.end()) {
+    return Binding{};
+  }
+  return Binding{Binding::Kind::Builtin, found->second};
+}
+
+Binding SymbolTable::lookupGlobal(const std::string &name) const {
+  const auto found = globals.find(name);
+  if (found == globals.end()) {
+    return Binding{};
+  }
+  return Binding{Binding::Kind::Global, found->second};
+}
+
+std::unique_ptr<Program> Parser::parse(const mpc_ast_t *ast) {
+  checkDepth(ast, maxDepth);
+  auto program = std::make_unique<Program>();
+
+  for (int i = 0; i < ast->children_num; i++) {
+    const auto *child = ast->children[i];
+    if (hasTag(child, "assignment") || hasTag(child, "pipeline")) {
+      program->statements.push_back(parseStatement(child));
+    } else if (hasTag(child, "type_definition")) {
+      program->statements.push_back(
+          Statement{parseTypeDefinition(child), locationOf(child)});
+    }
+  }
+
+  return program;
+}
+
+Statement Parser::parseStatement(const mpc_ast_t *ast) {
+  if (hasTag(ast, "assignment")) {
+    return Statement{parseAssignment(ast), locationOf(ast)};
+  }
+  return Statement{parsePipeline(ast), locationOf(ast)};
+}
+
+TypeDefinition Parser::parseTypeDefinition(const mpc_ast_t *ast) {
+  const auto name = std::string(ast->children[1]->contents);
+  TypeDefinition definition{
+      Identifier{name, Binding{Binding::Kind::Builtin,
+                               symbols.declareBuiltin(name)}},
+      {},
+      {}};
+
+  // children: "type" name "=" '{' (field ':' type)+ '}'
+  for (int i = 4; i + 2 < ast->children_num; i += 3) {
+    const auto field = std::string(ast->children[i]->contents);
+    const auto annotation = std::string(ast->children[i + 2]->contents);
+    for (const auto &existing : definition.fields) {
+      if (existing.name == field) {
+        throw std::runtime_error("Duplicate field " + field + " in type " +
+                                 name);
+      }
+    }
+    definition.fields.push_back(
+        Parameter{field, typeFromName(annotation), annotation});
+    definition.fieldIds.push_back(symbols.declareField(field));
+  }
+
+  return definition;
+}
+
+Assignment Parser::parseAssignment(const mpc_ast_t *ast) {
+  const auto bindType = std::string(ast->children[0]->contents);
+  const auto name = std::string(ast->children[1]->contents);
+
+  Assignment assignment{AssignmentType::Let, Identifier{name, Binding{}},
+                        parsePipeline(ast->children[3])};
+
+  if (bindType == "const") {
+    assignment.type = AssignmentType::Const;
+  } else if (bindType == "var") {
+    assignment.type = AssignmentType::Var;
+  }
+
+  // The target is declared after the value is parsed, so `let x <= x + 1`
+  // refers to the previous binding on the right hand side.
+  if (scopes.empty()) {
+    assignment.variable.binding =
+        Binding{Binding::Kind::Global, symbols.declareGlobal(name)};
+  } else {
+    auto &scope = scopes.back();
+    const auto found = scope.locals.find(name);
+    if (found != scope.locals.end()) {
+      assignment.variable.binding =
+          Binding{Binding::Kind::Local, found->second};
+    } else {
+      scope.locals.insert({name, scope.localCount});
+      assignment.variable.binding =
+          Binding{Binding::Kind::Local, scope.localCount++};
+    }
+  }
+
+  return assignment;
+}
+
+Pipeline Parser::parsePipeline(const mpc_ast_t *ast) {
+  if (hasTag(ast, "expression")) {
+    return Pipeline{parseExpression(ast), {}};
+  }
+
+  Pipeline pipeline{parseExpression(ast->children[0]), {}};
+
+  for (int i = 1; i + 1 < ast->children_num; i += 2) {
+    const auto *separator = ast->children[i];
+    const auto *target = ast->children[i + 1];
+
+    if (hasTag(separator, "operator")) {
+      pipeline.stages.push_back(Stage{Stage::Kind::Operator,
+                                      parseOperator(separator->contents),
+                                      parseExpression(target)});
+    } else {
+      // Pipe targets are called with the running result: a builtin, or a
+      // variable holding a lambda.
+      pipeline.stages.push_back(
+          Stage{Stage::Kind::Pipe, Operator{}, parseExpression(target)});
+    }
+  }
+
+  return pipeline;
+}
+
+Expression Parser::parseExpression(const mpc_ast_t *ast) {
+  const auto location = locationOf(ast);
+
+  if (hasTag(ast, "ident")) {
+    return Expression{resolve(ast->contents), location};
+  } else if (hasTag(ast, "number")) {
+    return Expression{Number{std::stoi(ast->contents)}, location};
+  } else if (hasTag(ast, "str")) {
+    const auto contents = std::string(ast->contents);
+    return Expression{String{contents.substr(1, contents.length() - 2)},
+                      location};
+  } else if (hasTag(ast, "character")) {
+    return Expression{Character{ast->contents[1]}, location};
+  } else if (hasTag(ast, "collection")) {
+    Collection collection;
+    for (int i = 1; i < ast->children_num - 1; i++) {
+      collection.elements.push_back(parseExpression(ast->children[i]));
+    }
+    return Expression{std::move(collection), location};
+  } else if (hasTag(ast, "lambda")) {
+    return Expression{parseLambda(ast), location};
+  } else if (hasTag(ast, "field")) {
+    const auto name = std::string(ast->children[1]->contents);
+    return Expression{Field{name, symbols.declareField(name)}, location};
+  } else if (hasTag(ast, "conditional")) {
+    return Expression{parseIf(ast), location};
+  } else if (hasTag(ast, "match")) {
+    return Expression{parseMatch(ast), location};
+  } else if (hasTag(ast, "loop")) {
+    return Expression{parseLoop(ast), location};
+  }
+
+  throw std::runtime_error("Unsupported expression " + std::string(ast->tag));
+}
+
+Lambda Parser::parseLambda(const mpc_ast_t *ast) {
+  Lambda lambda;
+  scopes.push_back(Scope{});
+
+  int i = 1;
+  for (; i < ast->children_num &&
+         std::string(ast->children[i]->contents) != ")";
+       i++) {
+    const auto *child = ast->children[i];
+    const auto contents = std::string(child->contents);
+    if (contents == ":") {
+      auto &parameter = lambda.parameters.back();
+      parameter.annotation = ast->children[++i]->contents;
+      parameter.type = typeFromName(parameter.annotation);
+    } else if (contents != ",") {
+      lambda.parameters.push_back(Parameter{contents, BuiltinType::Any, ""});
+      scopes.back().locals.insert({contents, scopes.back().localCount++});
+    }
+  }
+
+  for (; i < ast->children_num; i++) {
+    const auto *child = ast->children[i];
+    if (hasTag(child, "statement")) {
+      lambda.body.push_back(parseStatement(child));
+    }
+  }
+
+  lambda.localCount = scopes.back().localCount;
+  scopes.pop_back();
+  return lambda;
+}
+
+// children: "if" condition block ("else" (conditional | block))?
+If Parser::parseIf(const mpc_ast_t *ast) {
+  If conditional{parseCondition(ast->children[1]),
+                 parseBlock(ast->children[2]),
+                 {}};
+  if (ast->children_num > 4) {
+    const auto *otherwise = ast->children[4];
+    if (hasTag(otherwise, "conditional")) {
+      const auto location = locationOf(otherwise);
+      conditional.otherwise.push_back(Statement{
+          Pipeline{Expression{parseIf(otherwise), location}, {}}, location});
+    } else {
+      conditional.otherwise = parseBlock(otherwise);
+    }
+  }
+  return conditional;
+}
+
+// children: "match" subject '{' (pattern "=>" block)* '}'
+Match Parser::parseMatch(const mpc_ast_t *ast) {
+  Match match{parseCondition(ast->children[1]), {}};
+  for (int i = 3; i + 1 < ast->children_num; i++) {
+    const auto *arm = ast->children[i];
+    const auto *pattern = arm->children[0];
+    Arm parsed{std::monostate{}, parseBlock(arm->children[2])};
+    if (hasTag(pattern, "number")) {
+      parsed.pattern = Number{std::stoi(pattern->contents)};
+    } else if (hasTag(pattern, "character")) {
+      parsed.pattern = Character{pattern->contents[1]};
+    } else if (hasTag(pattern, "str")) {
+      const auto contents = std::string(pattern->contents);
+      parsed.pattern = String{contents.substr(1, contents.length() - 2)};
+    }
+    match.arms.push_back(std::move(parsed));
+  }
+  return match;
+}
+
+// children: "while" condition block
+Loop Parser::parseLoop(const mpc_ast_t *ast) {
+  Loop loop;
+  loop.condition = parseCondition(ast->children[1]);
+  loop.body = parseBlock(ast->children[2]);
+  return loop;
+}
+
+std::vector<Statement> Parser::parseBlock(const mpc_ast_t *ast) {
+  std::vector<Statement> statements;
+  for (int i = 0; i < ast->children_num; i++) {
+    const auto *child = ast->children[i];
+    if (hasTag(child, "statement")) {
+      statements.push_back(parseStatement(child));
+    }
+  }
+  return statements;
+}
+
+std::vector<Statement> Parser::parseCondition(const mpc_ast_t *ast) {
+  std::vector<Statement> condition;
+  condition.push_back(Statement{parsePipeline(ast), locationOf(ast)});
+  return condition;
+}
+
+Identifier Parser::resolve(const std::string &name) {
+  if (!scopes.empty()) {
+    const auto &locals = scopes.back().locals;
+    const auto found = locals.find(name);
+    if (found != locals.end()) {
+      return Identifier{name, Binding{Binding::Kind::Local, found->second}};
+    }
+  }
+
+  const auto builtin = symbols.lookupBuiltin(name);
+  if (builtin.kind != Binding::Kind::Unresolved) {
+    return Identifier{name, builtin};
+  }
+
+  return Identifier{
+      name, Binding{Binding::Kind::Global, symbols.declareGlobal(name)}};
+}
 
 } // namespace nemo::ir
@@ -0,0 +1,203 @@
+#include "ir/ir.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+namespace nemo::ir {
+
+namespace {
+
+// Infers the type of every expression of a lambda body from the types of
+// its locals. Between branches and loops the body is straight-line code, so
+// the type of a local at a use is the type of the value last assigned to it.
+// Where branches join, a local the branches disagree on becomes Any. A loop
+// is analyzed from the types its locals have on entry merged with those at
+// the end of its body until they no longer change; stages are only marked
+// on that last pass, when the types hold on every iteration.
+class Specializer {
+public:
+  explicit Specializer(std::vector<BuiltinType> locals)
+      : locals(std::move(locals)) {}
+
+  // The type of the statement's value.
+  BuiltinType statement(Statement &statement) {
+    if (auto *assignment = std::get_if<Assignment>(&statement.statement)) {
+      const auto type = pipeline(assignment->value);
+      if (assignment->variable.binding.kind == Binding::Kind::Local) {
+        locals[assignment->variable.binding.index] = type;
+      }
+    } else if (auto *value = std::get_if<Pipeline>(&statement.statement)) {
+      return pipeline(*value);
+    }
+    return BuiltinType::Void;
+  }
+
+  int specialized = 0;
+
+private:
+  using Types = std::vector<BuiltinType>;
+
+  static BuiltinType merge(BuiltinType a, BuiltinType b) {
+    return a == b ? a : BuiltinType::Any;
+  }
+
+  static void merge(Types &into, const Types &types) {
+    for (size_t i = 0; i < into.size(); i++) {
+      into[i] = merge(into[i], types[i]);
+    }
+  }
+
+  BuiltinType block(std::vector<Statement> &statements) {
+    auto type = BuiltinType::Void;
+    for (auto &statement : statements) {
+      type = this->statement(statement);
+    }
+    return type;
+  }
+
+  BuiltinType pipeline(Pipeline &pipeline) {
+    auto type = expression(pipeline.head);
+    for (auto &stage : pipeline.stages) {
+      if (stage.kind == Stage::Kind::Operator) {
+        const auto operand = expression(stage.target);
+        // Every operator on two numbers, comparisons included, gives a
+        // number.
+        if (type == BuiltinType::Number && operand == BuiltinType::Number) {
+          if (marking) {
+            stage.operands = BuiltinType::Number;
+            specialized++;
+          }
+        } else {
+          type = BuiltinType::Any;
+        }
+      } else {
+        // Calls are not type checked, their results may be anything.
+        type = BuiltinType::Any;
+      }
+    }
+    return type;
+  }
+
+  // Branches start from the locals after the condition and join after.
+  BuiltinType conditional(If &conditional) {
+    block(conditional.condition);
+    const auto entry = locals;
+    auto type = block(conditional.then);
+    auto joined = locals;
+    locals = entry;
+    type = merge(type, block(conditional.otherwise));
+    merge(locals, joined);
+    return type;
+  }
+
+  BuiltinType match(Match &match) {
+    block(match.subject);
+    const auto entry = locals;
+    auto joined = entry;
+    std::optional<BuiltinType> type;
+    bool exhaustive = false;
+    for (auto &arm : match.arms) {
+      locals = entry;
+      const auto armType = block(arm.body);
+      type = type ? merge(*type, armType) : armType;
+      merge(joined, locals);
+      exhaustive = std::holds_alternative<std::monostate>(arm.pattern);
+      if (exhaustive) {
+        break;
+      }
+    }
+    locals = std::move(joined);
+    if (!exhaustive) {
+      type = type ? merge(*type, BuiltinType::Void) : BuiltinType::Void;
+    }
+    return *type;
+  }
+
+  BuiltinType loop(Loop &loop) {
+    const auto outer = marking;
+    marking = false;
+    auto entry = locals;
+    while (true) {
+      block(loop.condition);
+      block(loop.body);
+      merge(locals, entry);
+      if (locals == entry) {
+        break;
+      }
+      entry = locals;
+    }
+    marking = outer;
+
+    locals = entry;
+    block(loop.condition);
+    const auto exit = locals;
+    block(loop.body);
+    locals = exit;
+    return BuiltinType::Void;
+  }
+
+  BuiltinType expression(Expression &expression) {
+    return std::visit(
+        [&](auto &node) {
+          using Node = std::decay_t<decltype(node)>;
+
+          if constexpr (std::is_same_v<Node, Identifier>) {
+            return node.binding.kind == Binding::Kind::Local
+                       ? locals[node.binding.index]
+                       : BuiltinType::Any;
+          } else if constexpr (std::is_same_v<Node, Number>) {
+            return BuiltinType::Number;
+          } else if constexpr (std::is_same_v<Node, Character>) {
+            return BuiltinType::Character;
+          } else if constexpr (std::is_same_v<Node, String>) {
+            return BuiltinType::String;
+          } else if constexpr (std::is_same_v<Node, Collection>) {
+            return BuiltinType::Collection;
+          } else if constexpr (std::is_same_v<Node, Lambda>) {
+            return BuiltinType::Lambda;
+          } else if constexpr (std::is_same_v<Node, If>) {
+            return conditional(node);
+          } else if constexpr (std::is_same_v<Node, Match>) {
+            return match(node);
+          } else if constexpr (std::is_same_v<Node, Loop>) {
+            return loop(node);
+          } else {
+            return BuiltinType::Any;
+          }
+        },
+        expression.value);
+  }
+
+  // Off while a loop body is analyzed from types that may not hold yet.
+  bool marking = true;
+  std::vector<BuiltinType> locals;
+};
+
+} // namespace
+
+std::unique_ptr<Lambda> specialize(const Lambda &lambda,
+                                   const std::vector<BuiltinType> &arguments) {
+  auto specialized = std::make_unique<Lambda>(lambda);
+
+  std::vector<BuiltinType> locals(lambda.localCount, BuiltinType::Any);
+  for (size_t i = 0; i < arguments.size(); i++) {
+    locals[i] = arguments[i];
+    specialized->parameters[i].type = arguments[i];
+  }
+
+  Specializer specializer(std::move(locals));
+  for (auto &statement : specialized->body) {
+    specializer.statement(statement);
+  }
+
+  if (specializer.specialized == 0) {
+    return nullptr;
+  }
+  return specialized;
+}
+
+} // namespace nemo::ir
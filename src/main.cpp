@@ -1,25 +1,268 @@
 #include <editline/history.h>
 #include <editline/readline.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "grammar/grammar.h"
 #include "interpreter/interpreter.h"
+#include "interpreter/profiler.h"
+#include "interpreter/stats.h"
 #include "ir/ir.h"
 #include "mpc/mpc.h"
 #include "nemo/common.hpp"
+#include "nemo/memory.hpp"
+#include "nemo/sort.hpp"
 #include "nemo/verinfo.h"
 
+static std::string statsOutput;
+
+// Compiles the scripts into one C translation unit written to output, or to
+// stdout when it is empty. Errors go to stderr.
+static int emitC(const std::vector<const char *> &scripts,
+                 const std::string &output) {
+  auto ctx = createGlobalContext();
+  ctx->setOutput(std::cerr);
+
+  std::vector<const nemo::ir::Program *> programs;
+  for (const auto *script : scripts) {
+    mpc_result_t r;
+    if (!mpc_parse_contents(script, Nemo, &r)) {
+      mpc_err_print_to(r.error, stderr);
+      mpc_err_delete(r.error);
+      return 1;
+    }
+    const auto *program =
+        compile(static_cast<const mpc_ast_t *>(r.output), ctx);
+    mpc_ast_delete(static_cast<mpc_ast_t *>(r.output));
+    if (program == nullptr) {
+      return 1;
+    }
+    programs.push_back(program);
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output);
+    if (!file) {
+      std::cerr << "Could not write " << output << std::endl;
+      return 1;
+    }
+  }
+  try {
+    nemo::ir::emitC(programs, ctx->symbolTable(),
+                    output.empty() ? std::cout : file);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// Registered with atexit so the numbers survive the exit builtin.
+static void dumpStats() {
+  if (statsOutput.empty()) {
+    nemo::stats::dumpJson(std::cerr);
+    return;
+  }
+
+  std::ofstream out(statsOutput);
+  if (!out) {
+    std::cerr << "Could not write stats to " << statsOutput << std::endl;
+    return;
+  }
+  nemo::stats::dumpJson(out);
+}
+
+// Parses sizes such as 4096, 64K, 512M or 2G.
+static std::optional<size_t> parseSize(std::string_view text) {
+  size_t multiplier = 1;
+  if (!text.empty()) {
+    switch (text.back()) {
+    case 'K':
+    case 'k':
+      multiplier = 1024;
+      break;
+    case 'M':
+    case 'm':
+      multiplier = 1024 * 1024;
+      break;
+    case 'G':
+    case 'g':
+      multiplier = 1024 * 1024 * 1024;
+      break;
+    }
+    if (multiplier != 1) {
+      text.remove_suffix(1);
+    }
+  }
+
+  size_t value = 0;
+  const auto [end, error] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (text.empty() || error != std::errc() ||
+      end != text.data() + text.size() ||
+      value > std::numeric_limits<size_t>::max() / multiplier) {
+    return std::nullopt;
+  }
+  return value * multiplier;
+}
+
+// Parses scripts on a pool of worker threads while the main thread evaluates
+// them in order. The grammar is never modified after define_grammar(), so the
+// workers share it; every parse has its own mpc input.
+class ParsePool {
+public:
+  struct Parsed {
+    bool success;
+    mpc_result_t result;
+  };
+
+  ParsePool(const std::vector<const char *> &scripts, unsigned jobs)
+      : scripts(scripts), promises(scripts.size()) {
+    for (auto &promise : promises) {
+      futures.push_back(promise.get_future());
+    }
+    for (unsigned i = 0; i < jobs; i++) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ParsePool() {
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Waits for the script at `index` to be parsed.
+  bool get(size_t index, mpc_result_t *r) {
+    const auto parsed = futures[index].get();
+    *r = parsed.result;
+    return parsed.success;
+  }
+
+private:
+  void work() {
+    for (size_t index = next++; index < scripts.size(); index = next++) {
+      Parsed parsed;
+      parsed.success = mpc_parse_contents(scripts[index], Nemo, &parsed.result);
+      promises[index].set_value(parsed);
+    }
+  }
+
+  const std::vector<const char *> &scripts;
+  std::vector<std::promise<Parsed>> promises;
+  std::vector<std::future<Parsed>> futures;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> next{0};
+};
+
 int main(int argc, char **argv) {
+  std::vector<const char *> scripts;
+  std::string profileOutput;
+  std::optional<std::string> emitOutput;
+  unsigned parseJobs = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const auto arg = std::string_view(argv[i]);
+    if (arg == "--profile") {
+      profileOutput = "nemo.folded";
+    } else if (arg.starts_with("--profile=")) {
+      profileOutput = arg.substr(arg.find('=') + 1);
+    } else if (arg.starts_with("--max-memory=")) {
+      const auto limit = parseSize(arg.substr(arg.find('=') + 1));
+      if (!limit) {
+        std::cerr << "Invalid memory limit: " << arg << std::endl;
+        return 1;
+      }
+      nemo::memory::accounting.limit = *limit;
+    } else if (arg == "--parallel-parse") {
+      parseJobs = std::max(1u, std::thread::hardware_concurrency());
+    } else if (arg.starts_with("--parallel-parse=")) {
+      const auto jobs = arg.substr(arg.find('=') + 1);
+      const auto [end, error] =
+          std::from_chars(jobs.data(), jobs.data() + jobs.size(), parseJobs);
+      if (jobs.empty() || error != std::errc() ||
+          end != jobs.data() + jobs.size() || parseJobs == 0) {
+        std::cerr << "Invalid parse job count: " << arg << std::endl;
+        return 1;
+      }
+    } else if (arg == "--threads") {
+      nemo::sort::threads = std::max(1u, std::thread::hardware_concurrency());
+    } else if (arg.starts_with("--threads=")) {
+      const auto count = arg.substr(arg.find('=') + 1);
+      unsigned threads = 0;
+      const auto [end, error] =
+          std::from_chars(count.data(), count.data() + count.size(), threads);
+      if (count.empty() || error != std::errc() ||
+          end != count.data() + count.size() || threads == 0) {
+        std::cerr << "Invalid thread count: " << arg << std::endl;
+        return 1;
+      }
+      nemo::sort::threads = threads;
+    } else if (arg == "--emit-c") {
+      emitOutput = "";
+    } else if (arg.starts_with("--emit-c=")) {
+      emitOutput = arg.substr(arg.find('=') + 1);
+    } else if (arg == "--stats" || arg.starts_with("--stats=")) {
+      nemo::stats::enabled = true;
+      if (arg.starts_with("--stats=")) {
+        statsOutput = arg.substr(arg.find('=') + 1);
+      }
+    } else {
+      scripts.push_back(argv[i]);
+    }
+  }
+
   create_parsers();
   define_grammar();
 
-  std::shared_ptr<ScopeContext> globalContext =
-      std::make_shared<ScopeContext>();
+  if (emitOutput) {
+    if (scripts.empty()) {
+      std::cerr << "--emit-c needs a script" << std::endl;
+      return 1;
+    }
+    const auto status = emitC(scripts, *emitOutput);
+    cleanup_parsers();
+    return status;
+  }
+
+  if (!profileOutput.empty()) {
+    nemo::profiler::start(profileOutput);
+    // Like the stats, the profile is written even if a script calls exit.
+    std::atexit(nemo::profiler::stop);
+  }
+
+  if (nemo::stats::enabled) {
+    std::atexit(dumpStats);
+  }
+
+  std::shared_ptr<ScopeContext> globalContext = createGlobalContext();
+
+  if (!scripts.empty()) {
+    std::optional<ParsePool> pool;
+    if (parseJobs > 0 && scripts.size() > 1) {
+      pool.emplace(scripts, std::min<unsigned>(parseJobs, scripts.size()));
+    }
+
+    for (size_t index = 0; index < scripts.size(); index++) {
+      const auto script = scripts[index];
+      nemo::profiler::setScript(script);
 
-  if (argc > 1) {
-    for (int i = 1; i < argc; i++) {
       mpc_result_t r;
-      if (mpc_parse_contents(argv[i], Nemo, &r)) {
+      const auto parsed = pool ? pool->get(index, &r)
+                               : mpc_parse_contents(script, Nemo, &r);
+      if (parsed) {
         const auto success =
             evaluate(static_cast<const mpc_ast_t *>(r.output), globalContext);
         if (success) {
@@ -32,6 +275,8 @@ int main(int argc, char **argv) {
         mpc_err_delete(r.error);
       }
     }
+    pool.reset();
+    nemo::profiler::stop();
     cleanup_parsers();
     return 0;
   }
@@ -42,6 +287,9 @@ int main(int argc, char **argv) {
   while (1) {
 
     char *input = readline("nemo> ");
+    if (input == nullptr) {
+      break;
+    }
     add_history(input);
 
     mpc_result_t r;
@@ -61,6 +309,7 @@ int main(int argc, char **argv) {
     free(input);
   }
 
+  nemo::profiler::stop();
   cleanup_parsers();
   return 0;
 }
@@ -71,6 +71,14 @@ int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
 
+enum {
+  MPC_PARSE_DEFAULT = 0,
+  MPC_PARSE_PACKRAT = 1
+};
+
+int mpc_parse_mode(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, int mode);
+int mpc_parse_contents_mode(const char *filename, mpc_parser_t *p, mpc_result_t *r, int mode);
+
 /*
 ** Function Types
 */
@@ -272,7 +280,8 @@ enum {
   MPC_RE_M         = 1,
   MPC_RE_S         = 2,
   MPC_RE_MULTILINE = 1,
-  MPC_RE_DOTALL    = 2
+  MPC_RE_DOTALL    = 2,
+  MPC_RE_NO_DFA    = 4
 };
 
 mpc_parser_t *mpc_re(const char *re);
@@ -1,5 +1,7 @@
 #include "mpc/mpc.h"
 
+#include <stdint.h>
+
 /*
 ** State Type
 */
@@ -67,13 +69,81 @@ enum {
   MPC_INPUT_MARKS_MIN = 32
 };
 
+/*
+** Input Memory
+**
+** Small allocations made while parsing come
+** from an arena owned by the input. The arena
+** grows in aligned chunks, each of which holds
+** blocks of a single size class, and freed
+** blocks go onto a free list per class. The
+** owning chunk of a pointer is found by masking
+** its address, so every operation is O(1).
+*/
+
+enum {
+  MPC_MEM_CHUNK_SIZE   = 8192,
+  MPC_MEM_CHUNK_HEADER = 16,
+  MPC_MEM_CLASS_MIN    = 16,
+  MPC_MEM_CLASSES      = 5,
+  MPC_MEM_CHUNKS_MIN   = 16
+};
+
+typedef struct mpc_mem_block_t {
+  struct mpc_mem_block_t *next;
+} mpc_mem_block_t;
+
+typedef struct {
+  int size_class;
+} mpc_mem_chunk_t;
+
+/*
+** Packrat Memo
+**
+** When parsing with `MPC_PARSE_PACKRAT` every
+** attempt of a named parser (a grammar rule) at
+** a given position is recorded, so trying the
+** same rule at the same place again under a
+** different alternative is answered from the
+** table instead of re-parsing the span.
+**
+** The first attempt only marks the entry as seen.
+** The result (error or a copy of the output) is
+** kept once the rule is tried there a second time
+** and answers every attempt after that, so spans
+** which are never re-parsed cost nothing but the
+** table entry. Outputs of named parsers are taken
+** to be `mpc_ast_t`, which is what every rule of
+** an `mpca_lang` grammar produces.
+*/
+
+enum {
+  MPC_MEMO_EMPTY   = 0,
+  MPC_MEMO_FAILURE = 1,
+  MPC_MEMO_SEEN    = 2,
+  MPC_MEMO_SUCCESS = 3
+};
+
 enum {
-  MPC_INPUT_MEM_NUM = 512
+  MPC_MEMO_SLOTS_MIN = 256
 };
 
 typedef struct {
-  char mem[64];
-} mpc_mem_t;
+  mpc_state_t state;
+  char last;
+  mpc_val_t *output;
+  mpc_err_t *error;
+} mpc_memo_result_t;
+
+typedef struct {
+  mpc_parser_t *parser;
+  long pos;
+  int status;
+  int suppressed;
+  mpc_memo_result_t *result;
+} mpc_memo_t;
+
+typedef struct mpc_frame_t mpc_frame_t;
 
 typedef struct {
 
@@ -94,12 +164,26 @@ typedef struct {
   char *lasts;
   char last;
 
-  size_t mem_index;
-  char mem_full[MPC_INPUT_MEM_NUM];
-  mpc_mem_t mem[MPC_INPUT_MEM_NUM];
+  mpc_mem_block_t *mem_free[MPC_MEM_CLASSES];
+  char *mem_next[MPC_MEM_CLASSES];
+  char *mem_end[MPC_MEM_CLASSES];
+  size_t mem_chunks_slots;
+  size_t mem_chunks_num;
+  char **mem_chunks;
+
+  size_t memo_slots;
+  size_t memo_num;
+  mpc_memo_t *memo;
+
+  size_t frames_slots;
+  size_t frames_num;
+  mpc_frame_t *frames;
 
 } mpc_input_t;
 
+static void mpc_input_memo_delete(mpc_input_t *i);
+static void mpc_input_mem_delete(mpc_input_t *i);
+
 static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -123,8 +207,20 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  memset(i->mem_free, 0, sizeof(i->mem_free));
+  memset(i->mem_next, 0, sizeof(i->mem_next));
+  memset(i->mem_end, 0, sizeof(i->mem_end));
+  i->mem_chunks_slots = 0;
+  i->mem_chunks_num = 0;
+  i->mem_chunks = NULL;
+
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo = NULL;
+
+  i->frames_slots = 0;
+  i->frames_num = 0;
+  i->frames = NULL;
 
   return i;
 }
@@ -153,8 +249,20 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  memset(i->mem_free, 0, sizeof(i->mem_free));
+  memset(i->mem_next, 0, sizeof(i->mem_next));
+  memset(i->mem_end, 0, sizeof(i->mem_end));
+  i->mem_chunks_slots = 0;
+  i->mem_chunks_num = 0;
+  i->mem_chunks = NULL;
+
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo = NULL;
+
+  i->frames_slots = 0;
+  i->frames_num = 0;
+  i->frames = NULL;
 
   return i;
 
@@ -182,8 +290,20 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  memset(i->mem_free, 0, sizeof(i->mem_free));
+  memset(i->mem_next, 0, sizeof(i->mem_next));
+  memset(i->mem_end, 0, sizeof(i->mem_end));
+  i->mem_chunks_slots = 0;
+  i->mem_chunks_num = 0;
+  i->mem_chunks = NULL;
+
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo = NULL;
+
+  i->frames_slots = 0;
+  i->frames_num = 0;
+  i->frames = NULL;
 
   return i;
 
@@ -210,8 +330,20 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  memset(i->mem_free, 0, sizeof(i->mem_free));
+  memset(i->mem_next, 0, sizeof(i->mem_next));
+  memset(i->mem_end, 0, sizeof(i->mem_end));
+  i->mem_chunks_slots = 0;
+  i->mem_chunks_num = 0;
+  i->mem_chunks = NULL;
+
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo = NULL;
+
+  i->frames_slots = 0;
+  i->frames_num = 0;
+  i->frames = NULL;
 
   return i;
 }
@@ -223,35 +355,116 @@ static void mpc_input_delete(mpc_input_t *i) {
   if (i->type == MPC_INPUT_STRING) { free(i->string); }
   if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
 
+  mpc_input_memo_delete(i);
+  mpc_input_mem_delete(i);
+
+  free(i->frames);
   free(i->marks);
   free(i->lasts);
   free(i);
 }
 
+static size_t mpc_mem_class_size(int c) {
+  return (size_t)MPC_MEM_CLASS_MIN << c;
+}
+
+static int mpc_mem_class(size_t n) {
+  int c;
+  for (c = 0; c < MPC_MEM_CLASSES; c++) {
+    if (n <= mpc_mem_class_size(c)) { return c; }
+  }
+  return -1;
+}
+
+static char *mpc_mem_chunk_of(void *p) {
+  return (char*)((uintptr_t)p & ~(uintptr_t)(MPC_MEM_CHUNK_SIZE - 1));
+}
+
+static size_t mpc_mem_chunk_hash(mpc_input_t *i, char *c) {
+  unsigned long long x = (unsigned long long)((uintptr_t)c / MPC_MEM_CHUNK_SIZE);
+  return (size_t)(x * 0x9E3779B97F4A7C15ULL >> 32) & (i->mem_chunks_slots - 1);
+}
+
 static int mpc_mem_ptr(mpc_input_t *i, void *p) {
-  return
-    (char*)p >= (char*)(i->mem) &&
-    (char*)p <  (char*)(i->mem) + (MPC_INPUT_MEM_NUM * sizeof(mpc_mem_t));
+  size_t j;
+  char *c = mpc_mem_chunk_of(p);
+  if (i->mem_chunks_num == 0) { return 0; }
+  j = mpc_mem_chunk_hash(i, c);
+  while (i->mem_chunks[j]) {
+    if (i->mem_chunks[j] == c) { return 1; }
+    j = (j + 1) & (i->mem_chunks_slots - 1);
+  }
+  return 0;
 }
 
-static void *mpc_malloc(mpc_input_t *i, size_t n) {
+static void mpc_mem_chunk_place(mpc_input_t *i, char *c) {
+  size_t j = mpc_mem_chunk_hash(i, c);
+  while (i->mem_chunks[j]) { j = (j + 1) & (i->mem_chunks_slots - 1); }
+  i->mem_chunks[j] = c;
+}
+
+static void mpc_mem_chunk_insert(mpc_input_t *i, char *c) {
+
+  size_t j, slots = i->mem_chunks_slots;
+  char **chunks = i->mem_chunks;
+
+  /* Keep the chunk table at most half full */
+  if ((i->mem_chunks_num + 1) * 2 > slots) {
+    i->mem_chunks_slots = slots ? slots * 2 : MPC_MEM_CHUNKS_MIN;
+    i->mem_chunks = calloc(i->mem_chunks_slots, sizeof(char*));
+    for (j = 0; j < slots; j++) {
+      if (chunks[j]) { mpc_mem_chunk_place(i, chunks[j]); }
+    }
+    free(chunks);
+  }
+
+  mpc_mem_chunk_place(i, c);
+  i->mem_chunks_num++;
+}
+
+static int mpc_mem_chunk_new(mpc_input_t *i, int c) {
+
+  size_t size = mpc_mem_class_size(c);
+  char *chunk = aligned_alloc(MPC_MEM_CHUNK_SIZE, MPC_MEM_CHUNK_SIZE);
+
+  if (chunk == NULL) { return 0; }
+
+  ((mpc_mem_chunk_t*)chunk)->size_class = c;
+  mpc_mem_chunk_insert(i, chunk);
+
+  i->mem_next[c] = chunk + MPC_MEM_CHUNK_HEADER;
+  i->mem_end[c] = i->mem_next[c]
+    + ((MPC_MEM_CHUNK_SIZE - MPC_MEM_CHUNK_HEADER) / size) * size;
+  return 1;
+}
+
+static void mpc_input_mem_delete(mpc_input_t *i) {
   size_t j;
+  for (j = 0; j < i->mem_chunks_slots; j++) { free(i->mem_chunks[j]); }
+  free(i->mem_chunks);
+}
+
+static void *mpc_malloc(mpc_input_t *i, size_t n) {
+
   char *p;
+  mpc_mem_block_t *b;
+  int c = mpc_mem_class(n);
 
-  if (n > sizeof(mpc_mem_t)) { return malloc(n); }
+  if (c < 0) { return malloc(n); }
 
-  j = i->mem_index;
-  do {
-    if (!i->mem_full[i->mem_index]) {
-      p = (void*)(i->mem + i->mem_index);
-      i->mem_full[i->mem_index] = 1;
-      i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-      return p;
-    }
-    i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-  } while (j != i->mem_index);
+  if (i->mem_free[c]) {
+    b = i->mem_free[c];
+    i->mem_free[c] = b->next;
+    return b;
+  }
+
+  if (i->mem_next[c] == i->mem_end[c] && !mpc_mem_chunk_new(i, c)) {
+    return malloc(n);
+  }
 
-  return malloc(n);
+  p = i->mem_next[c];
+  i->mem_next[c] += mpc_mem_class_size(c);
+  return p;
 }
 
 static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
@@ -260,34 +473,43 @@ static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
   return x;
 }
 
+static size_t mpc_mem_size(void *p) {
+  return mpc_mem_class_size(((mpc_mem_chunk_t*)mpc_mem_chunk_of(p))->size_class);
+}
+
 static void mpc_free(mpc_input_t *i, void *p) {
-  size_t j;
+  mpc_mem_block_t *b = p;
+  int c;
   if (!mpc_mem_ptr(i, p)) { free(p); return; }
-  j = ((size_t)(((char*)p) - ((char*)i->mem))) / sizeof(mpc_mem_t);
-  i->mem_full[j] = 0;
+  c = ((mpc_mem_chunk_t*)mpc_mem_chunk_of(p))->size_class;
+  b->next = i->mem_free[c];
+  i->mem_free[c] = b;
 }
 
 static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
 
   char *q = NULL;
+  size_t size;
 
+  if (p == NULL) { return mpc_malloc(i, n); }
   if (!mpc_mem_ptr(i, p)) { return realloc(p, n); }
 
-  if (n > sizeof(mpc_mem_t)) {
-    q = malloc(n);
-    memcpy(q, p, sizeof(mpc_mem_t));
-    mpc_free(i, p);
-    return q;
-  }
+  size = mpc_mem_size(p);
+  if (n <= size) { return p; }
 
-  return p;
+  q = mpc_malloc(i, n);
+  memcpy(q, p, size);
+  mpc_free(i, p);
+  return q;
 }
 
 static void *mpc_export(mpc_input_t *i, void *p) {
   char *q = NULL;
+  size_t size;
   if (!mpc_mem_ptr(i, p)) { return p; }
-  q = malloc(sizeof(mpc_mem_t));
-  memcpy(q, p, sizeof(mpc_mem_t));
+  size = mpc_mem_size(p);
+  q = malloc(size);
+  memcpy(q, p, size);
   mpc_free(i, p);
   return q;
 }
@@ -878,6 +1100,138 @@ static mpc_err_t *mpc_err_merge(mpc_input_t *i, mpc_err_t *x, mpc_err_t *y) {
   return mpc_err_or(i, errs, 2);
 }
 
+static mpc_err_t *mpc_err_copy(mpc_err_t *x) {
+  int j;
+  mpc_err_t *y;
+  if (x == NULL) { return NULL; }
+  y = malloc(sizeof(mpc_err_t));
+  y->state = x->state;
+  y->received = x->received;
+  y->filename = malloc(strlen(x->filename) + 1);
+  strcpy(y->filename, x->filename);
+  y->failure = NULL;
+  if (x->failure) {
+    y->failure = malloc(strlen(x->failure) + 1);
+    strcpy(y->failure, x->failure);
+  }
+  y->expected_num = x->expected_num;
+  y->expected = NULL;
+  if (x->expected_num > 0) {
+    y->expected = malloc(sizeof(char*) * x->expected_num);
+    for (j = 0; j < x->expected_num; j++) {
+      y->expected[j] = malloc(strlen(x->expected[j]) + 1);
+      strcpy(y->expected[j], x->expected[j]);
+    }
+  }
+  return y;
+}
+
+/*
+** Packrat Memo Table
+*/
+
+static mpc_ast_t *mpc_memo_ast_copy(mpc_ast_t *a) {
+
+  int j;
+  mpc_ast_t *b;
+
+  if (a == NULL) { return NULL; }
+
+  b = malloc(sizeof(mpc_ast_t));
+  b->tag = malloc(strlen(a->tag) + 1);
+  strcpy(b->tag, a->tag);
+  b->contents = malloc(strlen(a->contents) + 1);
+  strcpy(b->contents, a->contents);
+  b->state = a->state;
+  b->children_num = a->children_num;
+  b->children = NULL;
+
+  if (a->children_num > 0) {
+    b->children = malloc(sizeof(mpc_ast_t*) * a->children_num);
+    for (j = 0; j < a->children_num; j++) {
+      b->children[j] = mpc_memo_ast_copy(a->children[j]);
+    }
+  }
+
+  return b;
+}
+
+static size_t mpc_memo_hash(mpc_parser_t *p, long pos) {
+  unsigned long long h = (unsigned long long)(size_t)p;
+  h ^= (unsigned long long)pos * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  return (size_t)h;
+}
+
+static mpc_memo_t *mpc_memo_slot(mpc_memo_t *memo, size_t slots, mpc_parser_t *p, long pos) {
+  size_t j = mpc_memo_hash(p, pos) & (slots - 1);
+  while (memo[j].status != MPC_MEMO_EMPTY
+  &&    (memo[j].parser != p || memo[j].pos != pos)) {
+    j = (j + 1) & (slots - 1);
+  }
+  return &memo[j];
+}
+
+static void mpc_input_memo_enable(mpc_input_t *i) {
+  if (i->type == MPC_INPUT_PIPE) { return; }
+  i->memo_slots = MPC_MEMO_SLOTS_MIN;
+  i->memo_num = 0;
+  i->memo = calloc(i->memo_slots, sizeof(mpc_memo_t));
+}
+
+static mpc_memo_t *mpc_input_memo_find(mpc_input_t *i, mpc_parser_t *p, long pos) {
+  return mpc_memo_slot(i->memo, i->memo_slots, p, pos);
+}
+
+static mpc_memo_t *mpc_input_memo_insert(mpc_input_t *i, mpc_parser_t *p, long pos) {
+
+  size_t j;
+  mpc_memo_t *m;
+  mpc_memo_t *memo;
+
+  /* Keep the table at most three quarters full so probes stay short */
+  if ((i->memo_num + 1) * 4 > i->memo_slots * 3) {
+    memo = calloc(i->memo_slots * 2, sizeof(mpc_memo_t));
+    for (j = 0; j < i->memo_slots; j++) {
+      if (i->memo[j].status == MPC_MEMO_EMPTY) { continue; }
+      *mpc_memo_slot(memo, i->memo_slots * 2, i->memo[j].parser, i->memo[j].pos) = i->memo[j];
+    }
+    free(i->memo);
+    i->memo = memo;
+    i->memo_slots *= 2;
+  }
+
+  m = mpc_input_memo_find(i, p, pos);
+  if (m->status == MPC_MEMO_EMPTY) {
+    i->memo_num++;
+    m->parser = p;
+    m->pos = pos;
+    m->result = NULL;
+  }
+  return m;
+}
+
+static void mpc_input_memo_result_delete(mpc_input_t *i, mpc_memo_result_t *x) {
+  if (x == NULL) { return; }
+  mpc_ast_delete(x->output);
+  mpc_err_delete_internal(i, x->error);
+  free(x);
+}
+
+static void mpc_input_memo_delete(mpc_input_t *i) {
+  size_t j;
+  for (j = 0; j < i->memo_slots; j++) {
+    if (i->memo[j].status == MPC_MEMO_EMPTY) { continue; }
+    mpc_input_memo_result_delete(i, i->memo[j].result);
+  }
+  free(i->memo);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+}
+
 /*
 ** Parser Type
 */
@@ -918,7 +1272,9 @@ enum {
   MPC_TYPE_SOI        = 27,
   MPC_TYPE_EOI        = 28,
 
-  MPC_TYPE_SEPBY1     = 29
+  MPC_TYPE_SEPBY1     = 29,
+
+  MPC_TYPE_DFA        = 30
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -940,6 +1296,17 @@ typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_parser_t *sep; } mpc_pdata_sepby1;
 
+typedef struct {
+  int states;
+  int classes;
+  unsigned char class_of[256];
+  int *next;
+  char *accept;
+  char *expected;
+} mpc_dfa_t;
+
+typedef struct { mpc_dfa_t *x; } mpc_pdata_dfa_t;
+
 typedef union {
   mpc_pdata_fail_t fail;
   mpc_pdata_lift_t lift;
@@ -959,6 +1326,7 @@ typedef union {
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
   mpc_pdata_sepby1 sepby1;
+  mpc_pdata_dfa_t dfa;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -1038,43 +1406,150 @@ static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x) {
   d(mpc_export(i, x));
 }
 
-enum {
-  MPC_PARSE_STACK_MIN = 4
-};
-
-#define MPC_SUCCESS(x) r->output = x; return 1
-#define MPC_FAILURE(x) r->error = x; return 0
-#define MPC_PRIMITIVE(x) \
-  if (x) { MPC_SUCCESS(r->output); } \
-  else { MPC_FAILURE(NULL); }
+static void mpc_dfa_delete(mpc_dfa_t *d) {
+  free(d->next);
+  free(d->accept);
+  free(d->expected);
+  free(d);
+}
 
-#define MPC_MAX_RECURSION_DEPTH 1000
+static mpc_dfa_t *mpc_dfa_copy(mpc_dfa_t *d) {
+  mpc_dfa_t *e = malloc(sizeof(mpc_dfa_t));
+  *e = *d;
+  e->next = malloc(sizeof(int) * d->states * d->classes);
+  memcpy(e->next, d->next, sizeof(int) * d->states * d->classes);
+  e->accept = malloc(d->states);
+  memcpy(e->accept, d->accept, d->states);
+  e->expected = malloc(strlen(d->expected) + 1);
+  strcpy(e->expected, d->expected);
+  return e;
+}
 
-static mpc_result_t *mpc_grow_results(mpc_input_t *i, int j, mpc_result_t *results_stk, mpc_result_t *results){
-  mpc_result_t *tmp_results = results;
+/*
+** Runs a regex DFA and consumes the longest
+** prefix it accepts. String inputs are scanned
+** in place, other inputs are read once and
+** then replayed up to the end of the match.
+*/
+static int mpc_input_dfa(mpc_input_t *i, mpc_dfa_t *d, mpc_result_t *r) {
+
+  int s = 0;
+  long j, n = 0, accepted = d->accept[0] ? 0 : -1;
+  char c, *o;
+  const unsigned char *x;
+
+  if (i->type == MPC_INPUT_STRING) {
+    x = (const unsigned char*)i->string + i->state.pos;
+    while (x[n]) {
+      s = d->next[s * d->classes + d->class_of[x[n]]];
+      if (s < 0) { break; }
+      n++;
+      if (d->accept[s]) { accepted = n; }
+    }
+  } else {
+    mpc_input_mark(i);
+    while (!mpc_input_terminated(i)) {
+      c = mpc_input_getc(i);
+      s = d->next[s * d->classes + d->class_of[(unsigned char)c]];
+      if (s < 0) { mpc_input_failure(i, c); break; }
+      mpc_input_success(i, c, NULL);
+      n++;
+      if (d->accept[s]) { accepted = n; }
+    }
+    mpc_input_rewind(i);
+  }
 
-  if (j == MPC_PARSE_STACK_MIN) {
-    int results_slots = j + j / 2;
-    tmp_results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-    memcpy(tmp_results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-  } else if (j >= MPC_PARSE_STACK_MIN) {
-    int results_slots = j + j / 2;
-    tmp_results = mpc_realloc(i, tmp_results, sizeof(mpc_result_t) * results_slots);
+  /* Report the failure where the DFA got stuck */
+  if (accepted < 0) {
+    r->error = NULL;
+    if (!i->suppress) {
+      mpc_input_mark(i);
+      for (j = 0; j < n; j++) { mpc_input_success(i, mpc_input_getc(i), NULL); }
+      r->error = mpc_err_new(i, d->expected);
+      mpc_input_rewind(i);
+    }
+    return 0;
   }
 
-  return tmp_results;
+  o = mpc_malloc(i, accepted + 1);
+  for (j = 0; j < accepted; j++) {
+    o[j] = mpc_input_getc(i);
+    mpc_input_success(i, o[j], NULL);
+  }
+  o[accepted] = '\0';
+  r->output = o;
+  return 1;
 }
 
-static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+enum {
+  MPC_PARSE_STACK_MIN  = 4,
+  MPC_PARSE_FRAMES_MIN = 256,
+  MPC_PARSE_CALL       = 2
+};
 
-  int j = 0, k = 0;
-  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
+/*
+** Parse Frames
+**
+** Parsers run on an explicit stack of frames
+** owned by the input instead of the C stack, so
+** the nesting depth of the input is limited by
+** memory alone. A frame holds the parser, how
+** far it got and the results of its children so
+** far. Frames move when the stack grows, so the
+** results are only ever reached through the
+** frame.
+*/
+
+struct mpc_frame_t {
+  mpc_parser_t *p;
+  int j;
+  int k;
+  int slots;
+  int memo;
+  int seen;
+  long pos;
   mpc_result_t *results;
+  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
+};
 
-  if (depth == MPC_MAX_RECURSION_DEPTH)
-  {
-    MPC_FAILURE(mpc_err_fail(i, "Maximum recursion depth exceeded!"));
+#ifndef MPC_MAX_RECURSION_DEPTH
+#define MPC_MAX_RECURSION_DEPTH 1000000
+#endif
+
+static mpc_result_t *mpc_frame_results(mpc_frame_t *f) {
+  return f->results ? f->results : f->results_stk;
+}
+
+static mpc_result_t *mpc_frame_reserve(mpc_input_t *i, mpc_frame_t *f, int n) {
+
+  int slots;
+
+  if (n <= MPC_PARSE_STACK_MIN || n <= f->slots) { return mpc_frame_results(f); }
+
+  slots = n + n / 2;
+  if (f->results == NULL) {
+    f->results = mpc_malloc(i, sizeof(mpc_result_t) * slots);
+    memcpy(f->results, f->results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
+  } else {
+    f->results = mpc_realloc(i, f->results, sizeof(mpc_result_t) * slots);
   }
+  f->slots = slots;
+
+  return f->results;
+}
+
+#define MPC_SUCCESS(x) r->output = x; return 1
+#define MPC_FAILURE(x) r->error = x; return 0
+#define MPC_PRIMITIVE(x) \
+  if (x) { MPC_SUCCESS(r->output); } \
+  else { MPC_FAILURE(NULL); }
+#define MPC_CALL(x) *c = x; return MPC_PARSE_CALL
+
+/*
+** Parsers which never run other parsers. Returns
+** -1 for any other type.
+*/
+static int mpc_parse_primitive(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
 
   switch (p->type) {
 
@@ -1090,6 +1565,7 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r->output));
     case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r->output));
     case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r->output));
+    case MPC_TYPE_DFA:     return mpc_input_dfa(i, p->data.dfa.x, r);
 
     /* Other parsers */
 
@@ -1100,24 +1576,49 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
     case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
 
+    default: return -1;
+  }
+
+}
+
+/*
+** Advances the parser of frame `f`. `x` is -1
+** when the frame has just been entered and the
+** outcome of the child it asked for otherwise,
+** in which case `r` holds the child's output or
+** error. Returns 1 or 0 with the frame's own
+** result in `r` once it is done, or asks for
+** the child `c` to be run next.
+*/
+static int mpc_parse_step(mpc_input_t *i, mpc_frame_t *f, int x, mpc_result_t *r, mpc_parser_t **c, mpc_err_t **e) {
+
+  int k;
+  mpc_parser_t *p = f->p;
+  mpc_result_t *results;
+
+  switch (p->type) {
+
     /* Application Parsers */
 
     case MPC_TYPE_APPLY:
-      if (mpc_parse_run(i, p->data.apply.x, r, e, depth+1)) {
+      if (x < 0) { MPC_CALL(p->data.apply.x); }
+      if (x) {
         MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, r->output));
       } else {
         MPC_FAILURE(r->output);
       }
 
     case MPC_TYPE_APPLY_TO:
-      if (mpc_parse_run(i, p->data.apply_to.x, r, e, depth+1)) {
+      if (x < 0) { MPC_CALL(p->data.apply_to.x); }
+      if (x) {
         MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, r->output, p->data.apply_to.d));
       } else {
         MPC_FAILURE(r->error);
       }
 
     case MPC_TYPE_CHECK:
-      if (mpc_parse_run(i, p->data.check.x, r, e, depth+1)) {
+      if (x < 0) { MPC_CALL(p->data.check.x); }
+      if (x) {
         if (p->data.check.f(&r->output)) {
           MPC_SUCCESS(r->output);
         } else {
@@ -1129,7 +1630,8 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
       }
 
     case MPC_TYPE_CHECK_WITH:
-      if (mpc_parse_run(i, p->data.check_with.x, r, e, depth+1)) {
+      if (x < 0) { MPC_CALL(p->data.check_with.x); }
+      if (x) {
         if (p->data.check_with.f(&r->output, p->data.check_with.d)) {
           MPC_SUCCESS(r->output);
         } else {
@@ -1141,22 +1643,26 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
       }
 
     case MPC_TYPE_EXPECT:
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.expect.x, r, e, depth+1)) {
-        mpc_input_suppress_disable(i);
+      if (x < 0) {
+        mpc_input_suppress_enable(i);
+        MPC_CALL(p->data.expect.x);
+      }
+      mpc_input_suppress_disable(i);
+      if (x) {
         MPC_SUCCESS(r->output);
       } else {
-        mpc_input_suppress_disable(i);
         MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
       }
 
     case MPC_TYPE_PREDICT:
-      mpc_input_backtrack_disable(i);
-      if (mpc_parse_run(i, p->data.predict.x, r, e, depth+1)) {
-        mpc_input_backtrack_enable(i);
+      if (x < 0) {
+        mpc_input_backtrack_disable(i);
+        MPC_CALL(p->data.predict.x);
+      }
+      mpc_input_backtrack_enable(i);
+      if (x) {
         MPC_SUCCESS(r->output);
       } else {
-        mpc_input_backtrack_enable(i);
         MPC_FAILURE(r->error);
       }
 
@@ -1165,9 +1671,12 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     /* TODO: Update Not Error Message */
 
     case MPC_TYPE_NOT:
-      mpc_input_mark(i);
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
+      if (x < 0) {
+        mpc_input_mark(i);
+        mpc_input_suppress_enable(i);
+        MPC_CALL(p->data.not.x);
+      }
+      if (x) {
         mpc_input_rewind(i);
         mpc_input_suppress_disable(i);
         mpc_parse_dtor(i, p->data.not.dx, r->output);
@@ -1179,7 +1688,8 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
       }
 
     case MPC_TYPE_MAYBE:
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
+      if (x < 0) { MPC_CALL(p->data.not.x); }
+      if (x) {
         MPC_SUCCESS(r->output);
       } else {
         *e = mpc_err_merge(i, *e, r->error);
@@ -1189,149 +1699,252 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     /* Repeat Parsers */
 
     case MPC_TYPE_MANY:
-
-      results = results_stk;
-
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
-      }
-
-      *e = mpc_err_merge(i, *e, results[j].error);
-
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-        if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-
     case MPC_TYPE_MANY1:
 
-      results = results_stk;
+      if (x < 0) { MPC_CALL(p->data.repeat.x); }
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
+      if (x) {
+        results = mpc_frame_reserve(i, f, f->j + 1);
+        results[f->j++] = *r;
+        MPC_CALL(p->data.repeat.x);
       }
 
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-
-        *e = mpc_err_merge(i, *e, results[j].error);
-
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      if (p->type == MPC_TYPE_MANY1 && f->j == 0) {
+        MPC_FAILURE(mpc_err_many1(i, r->error));
       }
 
-   case MPC_TYPE_SEPBY1:
+      *e = mpc_err_merge(i, *e, r->error);
+      MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)mpc_frame_results(f)));
 
-      results = results_stk;
+    /*
+    ** `k` is 0 while the first item runs, then
+    ** alternates between 1 for a separator and
+    ** 2 for the item following it.
+    */
+    case MPC_TYPE_SEPBY1:
 
-      if(mpc_parse_run(i, p->data.sepby1.x, &results[j], e, depth+1)){
-        j++;
-        results = mpc_grow_results(i, j, results_stk, results);
+      if (x < 0) { MPC_CALL(p->data.sepby1.x); }
 
-        while (
-          mpc_parse_run(i, p->data.sepby1.sep, &results[j], e, depth+1) &&
-          mpc_parse_run(i, p->data.sepby1.x, &results[j], e, depth+1)
-        ) {
-          j++;
-          results = mpc_grow_results(i, j, results_stk, results);
-        }
+      if (x && f->k != 1) {
+        results = mpc_frame_reserve(i, f, f->j + 1);
+        results[f->j++] = *r;
+        f->k = 1;
+        MPC_CALL(p->data.sepby1.sep);
       }
 
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        *e = mpc_err_merge(i, *e, results[j].error);
+      if (x) {
+        f->k = 2;
+        MPC_CALL(p->data.sepby1.x);
+      }
 
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      if (f->j == 0) {
+        MPC_FAILURE(mpc_err_many1(i, r->error));
       }
 
+      *e = mpc_err_merge(i, *e, r->error);
+      MPC_SUCCESS(mpc_parse_fold(i, p->data.sepby1.f, f->j, (mpc_val_t**)mpc_frame_results(f)));
+
     case MPC_TYPE_COUNT:
 
-      results = p->data.repeat.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.repeat.n)
-        : results_stk;
+      if (x < 0) {
+        mpc_frame_reserve(i, f, p->data.repeat.n);
+        MPC_CALL(p->data.repeat.x);
+      }
+
+      results = mpc_frame_reserve(i, f, f->j + 1);
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        if (j == p->data.repeat.n) { break; }
+      if (x) {
+        results[f->j++] = *r;
+        if (f->j != p->data.repeat.n) { MPC_CALL(p->data.repeat.x); }
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)results));
       }
 
-      if (j == p->data.repeat.n) {
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        for (k = 0; k < j; k++) {
-          mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
-        }
-        MPC_FAILURE(
-          mpc_err_count(i, results[j].error, p->data.repeat.n);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      for (k = 0; k < f->j; k++) {
+        mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
       }
+      MPC_FAILURE(mpc_err_count(i, r->error, p->data.repeat.n));
 
     /* Combinatory Parsers */
 
     case MPC_TYPE_OR:
 
       if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+      if (x < 0) { MPC_CALL(p->data.or.xs[0]); }
+      if (x) { MPC_SUCCESS(r->output); }
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
-
-      for (j = 0; j < p->data.or.n; j++) {
-        if (mpc_parse_run(i, p->data.or.xs[j], &results[j], e, depth+1)) {
-          MPC_SUCCESS(results[j].output;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        } else {
-          *e = mpc_err_merge(i, *e, results[j].error);
-        }
-      }
+      *e = mpc_err_merge(i, *e, r->error);
+      if (++f->j < p->data.or.n) { MPC_CALL(p->data.or.xs[f->j]); }
 
-      MPC_FAILURE(NULL;
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      MPC_FAILURE(NULL);
 
     case MPC_TYPE_AND:
+
       if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
+      if (x < 0) {
+        mpc_frame_reserve(i, f, p->data.and.n);
+        mpc_input_mark(i);
+        MPC_CALL(p->data.and.xs[0]);
+      }
 
-      mpc_input_mark(i);
-      for (j = 0; j < p->data.and.n; j++) {
-        if (!mpc_parse_run(i, p->data.and.xs[j], &results[j], e, depth+1)) {
-          mpc_input_rewind(i);
-          for (k = 0; k < j; k++) {
-            mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
-          }
-          MPC_FAILURE(results[j].error;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      results = mpc_frame_results(f);
+
+      if (!x) {
+        mpc_input_rewind(i);
+        for (k = 0; k < f->j; k++) {
+          mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
         }
+        MPC_FAILURE(r->error);
       }
+
+      results[f->j++] = *r;
+      if (f->j < p->data.and.n) { MPC_CALL(p->data.and.xs[f->j]); }
+
       mpc_input_unmark(i);
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.and.f, j, (mpc_val_t**)results);
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      MPC_SUCCESS(mpc_parse_fold(i, p->data.and.f, f->j, (mpc_val_t**)results));
+
+    /* End */
+
+    default:
+
+      MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
+  }
+
+}
+
+#undef MPC_CALL
+
+static void mpc_input_memo_restore(mpc_input_t *i, mpc_memo_result_t *m) {
+  i->state = m->state;
+  i->last = m->last;
+  if (i->type == MPC_INPUT_FILE) {
+    fseek(i->file, i->state.pos, SEEK_SET);
+  }
+}
+
+/*
+** Looks up the attempt of `p` at the current
+** position. Returns -1 when it has to be run,
+** setting `seen` if it has been attempted here
+** before.
+*/
+static int mpc_parse_memo_find(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, int *seen) {
+
+  mpc_memo_t *m = mpc_input_memo_find(i, p, i->state.pos);
+
+  /*
+  ** Attempts made while errors are suppressed produce no
+  ** error and add nothing to the accumulated one, so their
+  ** entries only stand in for other suppressed attempts.
+  ** Everything else an attempt merged into `e` is already
+  ** there and merging it again would change nothing.
+  */
+  *seen = 0;
+  if (m->status != MPC_MEMO_EMPTY && (!m->suppressed || i->suppress)) {
+    if (m->status == MPC_MEMO_SUCCESS) {
+      mpc_input_memo_restore(i, m->result);
+      r->output = mpc_memo_ast_copy(m->result->output);
+      return 1;
+    }
+    if (m->status == MPC_MEMO_FAILURE) {
+      mpc_input_memo_restore(i, m->result);
+      r->error = i->suppress ? NULL : mpc_err_copy(m->result->error);
+      return 0;
+    }
+    *seen = 1;
+  }
+
+  return -1;
+}
+
+static void mpc_parse_memo_store(mpc_input_t *i, mpc_frame_t *f, int x, mpc_result_t *r) {
+
+  mpc_memo_t *m = mpc_input_memo_insert(i, f->p, f->pos);
+  mpc_input_memo_result_delete(i, m->result);
+  m->result = NULL;
+  m->suppressed = i->suppress > 0;
+
+  if (!f->seen) {
+    m->status = MPC_MEMO_SEEN;
+    return;
+  }
+
+  m->status = x ? MPC_MEMO_SUCCESS : MPC_MEMO_FAILURE;
+  m->result = malloc(sizeof(mpc_memo_result_t));
+  m->result->state = i->state;
+  m->result->last = i->last;
+  m->result->output = x ? mpc_memo_ast_copy(r->output) : NULL;
+  m->result->error = x ? NULL : mpc_err_copy(r->error);
+}
+
+/*
+** Starts running `p`. Primitives and memoized
+** attempts finish straight away and return 1 or
+** 0, everything else gets a frame and returns
+** -1.
+*/
+static int mpc_parse_push(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
+
+  int x, seen = 0, memo = i->memo && p->name;
+  mpc_frame_t *f;
+
+  if (memo) {
+    x = mpc_parse_memo_find(i, p, r, &seen);
+    if (x >= 0) { return x; }
+  } else {
+    x = mpc_parse_primitive(i, p, r);
+    if (x >= 0) { return x; }
+  }
+
+  if (i->frames_num == MPC_MAX_RECURSION_DEPTH) {
+    MPC_FAILURE(mpc_err_fail(i, "Maximum recursion depth exceeded!"));
+  }
+
+  if (i->frames_num == i->frames_slots) {
+    i->frames_slots = i->frames_slots ? i->frames_slots * 2 : MPC_PARSE_FRAMES_MIN;
+    i->frames = realloc(i->frames, sizeof(mpc_frame_t) * i->frames_slots);
+  }
+
+  f = &i->frames[i->frames_num++];
+  f->p = p;
+  f->j = 0;
+  f->k = 0;
+  f->slots = 0;
+  f->memo = memo;
+  f->seen = seen;
+  f->pos = i->state.pos;
+  f->results = NULL;
+  return -1;
+}
+
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e) {
+
+  int x;
+  mpc_frame_t *f;
+  mpc_parser_t *c = NULL;
 
-    /* End */
+  x = mpc_parse_push(i, p, r);
 
-    default:
+  while (i->frames_num > 0) {
 
-      MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
-  }
+    f = &i->frames[i->frames_num - 1];
 
-  return 0;
+    /* Memoized primitives get a frame too and finish at once */
+    if (x >= 0 || !f->memo || (x = mpc_parse_primitive(i, f->p, r)) < 0) {
+      x = mpc_parse_step(i, f, x, r, &c, e);
+    }
+
+    if (x == MPC_PARSE_CALL) {
+      x = mpc_parse_push(i, c, r);
+      continue;
+    }
+
+    if (f->memo) { mpc_parse_memo_store(i, f, x, r); }
+    if (f->results) { mpc_free(i, f->results); }
+    i->frames_num--;
+  }
 
+  return x;
 }
 
 #undef MPC_SUCCESS
@@ -1342,7 +1955,7 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   int x;
   mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
-  x = mpc_parse_run(i, p, r, &e, 0);
+  x = mpc_parse_run(i, p, r, &e);
   if (x) {
     mpc_err_delete_internal(i, e);
     r->output = mpc_export(i, r->output);
@@ -1400,6 +2013,35 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   return res;
 }
 
+int mpc_parse_mode(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, int mode) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string);
+  if (mode & MPC_PARSE_PACKRAT) { mpc_input_memo_enable(i); }
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_contents_mode(const char *filename, mpc_parser_t *p, mpc_result_t *r, int mode) {
+
+  FILE *f = fopen(filename, "rb");
+  mpc_input_t *i;
+  int res;
+
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to open file!");
+    return 0;
+  }
+
+  i = mpc_input_new_file(filename, f);
+  if (mode & MPC_PARSE_PACKRAT) { mpc_input_memo_enable(i); }
+  res = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  fclose(f);
+  return res;
+}
+
 /*
 ** Building a Parser
 */
@@ -1466,6 +2108,8 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
       mpc_undefine_unretained(p->data.sepby1.sep, 0);
       break;
 
+    case MPC_TYPE_DFA: mpc_dfa_delete(p->data.dfa.x); break;
+
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
     case MPC_TYPE_AND: mpc_undefine_and(p); break;
 
@@ -1580,6 +2224,8 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       p->data.sepby1.sep = mpc_copy(a->data.sepby1.sep);
       break;
 
+    case MPC_TYPE_DFA: p->data.dfa.x = mpc_dfa_copy(a->data.dfa.x); break;
+
     case MPC_TYPE_OR:
       p->data.or.xs = malloc(a->data.or.n * sizeof(mpc_parser_t*));
       for (i = 0; i < a->data.or.n; i++) {
@@ -2409,16 +3055,577 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   return out;
 }
 
+/*
+** Regular Expression DFA
+**
+** Most token regexes are deterministic: every
+** choice and repetition can be decided by the
+** next character alone. For those the greedy,
+** non-backtracking combinators built further
+** down always match the longest prefix which
+** the regex accepts, so `mpc_re` compiles them
+** to a DFA and matches with a single table loop
+** instead.
+**
+** Regexes using anchors, the lookahead escapes
+** (`\b`, `\D`, ...) or choices and repetitions
+** which the next character does not decide keep
+** the combinator semantics and are built from
+** combinators as before.
+*/
+
+enum {
+  MPC_RE_NODE_SET   = 0,
+  MPC_RE_NODE_EMPTY = 1,
+  MPC_RE_NODE_CAT   = 2,
+  MPC_RE_NODE_ALT   = 3,
+  MPC_RE_NODE_STAR  = 4,
+  MPC_RE_NODE_PLUS  = 5,
+  MPC_RE_NODE_MAYBE = 6
+};
+
+enum {
+  MPC_RE_DFA_POSITIONS_MAX = 256,
+  MPC_RE_DFA_STATES_MAX    = 1024
+};
+
+typedef struct {
+  unsigned char bits[32];
+} mpc_re_set_t;
+
+typedef struct mpc_re_node_t {
+  int type;
+  int position;
+  int nullable;
+  mpc_re_set_t set;
+  mpc_re_set_t first;
+  mpc_re_set_t pfirst;
+  mpc_re_set_t plast;
+  struct mpc_re_node_t *a;
+  struct mpc_re_node_t *b;
+} mpc_re_node_t;
+
+typedef struct {
+  const char *s;
+  int mode;
+} mpc_re_reader_t;
+
+static void mpc_re_set_add(mpc_re_set_t *x, int c) {
+  x->bits[(unsigned char)c / 8] |= (unsigned char)(1 << ((unsigned char)c % 8));
+}
+
+static int mpc_re_set_has(const mpc_re_set_t *x, int c) {
+  return (x->bits[(unsigned char)c / 8] >> ((unsigned char)c % 8)) & 1;
+}
+
+static void mpc_re_set_union(mpc_re_set_t *x, const mpc_re_set_t *y) {
+  int j;
+  for (j = 0; j < 32; j++) { x->bits[j] |= y->bits[j]; }
+}
+
+static int mpc_re_set_disjoint(const mpc_re_set_t *x, const mpc_re_set_t *y) {
+  int j;
+  for (j = 0; j < 32; j++) { if (x->bits[j] & y->bits[j]) { return 0; } }
+  return 1;
+}
+
+static void mpc_re_set_chars(mpc_re_set_t *x, const char *s) {
+  while (*s) { mpc_re_set_add(x, *s); s++; }
+}
+
+static mpc_re_node_t *mpc_re_node_new(int type, mpc_re_node_t *a, mpc_re_node_t *b) {
+  mpc_re_node_t *n = calloc(1, sizeof(mpc_re_node_t));
+  n->type = type;
+  n->a = a;
+  n->b = b;
+  return n;
+}
+
+static void mpc_re_node_delete(mpc_re_node_t *n) {
+  if (n == NULL) { return; }
+  mpc_re_node_delete(n->a);
+  mpc_re_node_delete(n->b);
+  free(n);
+}
+
+static mpc_re_node_t *mpc_re_node_copy(mpc_re_node_t *n) {
+  mpc_re_node_t *m;
+  if (n == NULL) { return NULL; }
+  m = malloc(sizeof(mpc_re_node_t));
+  *m = *n;
+  m->a = mpc_re_node_copy(n->a);
+  m->b = mpc_re_node_copy(n->b);
+  return m;
+}
+
+/*
+** The reader accepts the same syntax as the
+** regex grammar below and returns NULL for
+** anything it cannot turn into a DFA, which
+** includes every malformed regex.
+*/
+
+static mpc_re_node_t *mpc_re_read_regex(mpc_re_reader_t *r);
+
+/* Mirrors `mpcf_re_range` */
+static mpc_re_node_t *mpc_re_read_range(const char *s, size_t l) {
+
+  size_t i, j, start, end;
+  int comp = s[0] == '^' ? 1 : 0;
+  const char *tmp;
+  mpc_re_set_t range;
+  mpc_re_node_t *n;
+
+  if (l == 0 || (comp && l == 1)) { return NULL; }
+
+  memset(&range, 0, sizeof(range));
+
+  for (i = comp; i < l; i++) {
+    if (s[i] == '\\') {
+      tmp = mpc_re_range_escape_char(s[i+1]);
+      if (tmp != NULL) { mpc_re_set_chars(&range, tmp); }
+      else { mpc_re_set_add(&range, s[i+1]); }
+      i++;
+    } else if (s[i] == '-') {
+      if (i + 1 == l || i == 0) {
+        mpc_re_set_add(&range, '-');
+      } else {
+        if (s[i-1] < 0 || s[i+1] < 0) { return NULL; }
+        start = s[i-1]+1;
+        end = s[i+1]-1;
+        for (j = start; j <= end; j++) { mpc_re_set_add(&range, (char)j); }
+      }
+    } else {
+      mpc_re_set_add(&range, s[i]);
+    }
+  }
+
+  n = mpc_re_node_new(MPC_RE_NODE_SET, NULL, NULL);
+  for (j = 1; j < 256; j++) {
+    if (mpc_re_set_has(&range, (int)j) != comp) { mpc_re_set_add(&n->set, (int)j); }
+  }
+  return n;
+}
+
+static mpc_re_node_t *mpc_re_read_base(mpc_re_reader_t *r) {
+
+  const char *start;
+  mpc_re_node_t *n;
+  char c = r->s[0];
+
+  if (c == '(') {
+    r->s++;
+    n = mpc_re_read_regex(r);
+    if (n == NULL) { return NULL; }
+    if (r->s[0] != ')') { mpc_re_node_delete(n); return NULL; }
+    r->s++;
+    return n;
+  }
+
+  if (c == '[') {
+    start = ++r->s;
+    while (r->s[0] != ']') {
+      if (r->s[0] == '\0') { return NULL; }
+      if (r->s[0] == '\\') {
+        if (r->s[1] == '\0') { return NULL; }
+        r->s++;
+      }
+      r->s++;
+    }
+    n = mpc_re_read_range(start, (size_t)(r->s - start));
+    r->s++;
+    return n;
+  }
+
+  if (c == '^' || c == '$') { return NULL; }
+
+  n = mpc_re_node_new(MPC_RE_NODE_SET, NULL, NULL);
+
+  if (c == '.') {
+    memset(&n->set, 0xFF, sizeof(n->set));
+    n->set.bits[0] &= (unsigned char)~1;
+    if (!(r->mode & MPC_RE_DOTALL)) {
+      n->set.bits['\n' / 8] &= (unsigned char)~(1 << ('\n' % 8));
+    }
+    r->s++;
+    return n;
+  }
+
+  if (c == '\\') {
+    switch (r->s[1]) {
+      case '\0':
+      case 'b': case 'B': case 'A': case 'Z':
+      case 'D': case 'S': case 'W':
+        mpc_re_node_delete(n);
+        return NULL;
+      case 'a': mpc_re_set_add(&n->set, '\a'); break;
+      case 'f': mpc_re_set_add(&n->set, '\f'); break;
+      case 'n': mpc_re_set_add(&n->set, '\n'); break;
+      case 'r': mpc_re_set_add(&n->set, '\r'); break;
+      case 't': mpc_re_set_add(&n->set, '\t'); break;
+      case 'v': mpc_re_set_add(&n->set, '\v'); break;
+      case 'd': mpc_re_set_chars(&n->set, "0123456789"); break;
+      case 's': mpc_re_set_chars(&n->set, " \f\n\r\t\v"); break;
+      case 'w':
+        mpc_re_set_chars(&n->set, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_");
+        break;
+      default: mpc_re_set_add(&n->set, r->s[1]); break;
+    }
+    r->s += 2;
+    return n;
+  }
+
+  mpc_re_set_add(&n->set, c);
+  r->s++;
+  return n;
+}
+
+static mpc_re_node_t *mpc_re_read_factor(mpc_re_reader_t *r) {
+
+  int j, count;
+  mpc_re_node_t *n, *x = mpc_re_read_base(r);
+
+  if (x == NULL) { return NULL; }
+
+  switch (r->s[0]) {
+    case '*': r->s++; return mpc_re_node_new(MPC_RE_NODE_STAR, x, NULL);
+    case '+': r->s++; return mpc_re_node_new(MPC_RE_NODE_PLUS, x, NULL);
+    case '?': r->s++; return mpc_re_node_new(MPC_RE_NODE_MAYBE, x, NULL);
+    case '{':
+      r->s++;
+      count = 0;
+      for (j = 0; isdigit((unsigned char)r->s[0]); j++, r->s++) {
+        count = count * 10 + (r->s[0] - '0');
+        if (count > MPC_RE_DFA_POSITIONS_MAX) { break; }
+      }
+      if (j == 0 || count == 0 || count > MPC_RE_DFA_POSITIONS_MAX || r->s[0] != '}') {
+        mpc_re_node_delete(x);
+        return NULL;
+      }
+      r->s++;
+      n = x;
+      for (j = 1; j < count; j++) {
+        n = mpc_re_node_new(MPC_RE_NODE_CAT, n, mpc_re_node_copy(x));
+      }
+      return n;
+    default: return x;
+  }
+}
+
+static mpc_re_node_t *mpc_re_read_term(mpc_re_reader_t *r) {
+
+  mpc_re_node_t *f, *n = mpc_re_node_new(MPC_RE_NODE_EMPTY, NULL, NULL);
+
+  while (r->s[0] != '\0' && r->s[0] != ')' && r->s[0] != '|') {
+    f = mpc_re_read_factor(r);
+    if (f == NULL) { mpc_re_node_delete(n); return NULL; }
+    if (n->type == MPC_RE_NODE_EMPTY) { free(n); n = f; }
+    else { n = mpc_re_node_new(MPC_RE_NODE_CAT, n, f); }
+  }
+
+  return n;
+}
+
+static mpc_re_node_t *mpc_re_read_regex(mpc_re_reader_t *r) {
+
+  mpc_re_node_t *t, *x;
+
+  t = mpc_re_read_term(r);
+  if (t == NULL) { return NULL; }
+  if (r->s[0] != '|') { return t; }
+
+  r->s++;
+  x = mpc_re_read_regex(r);
+  if (x == NULL) { mpc_re_node_delete(t); return NULL; }
+  return mpc_re_node_new(MPC_RE_NODE_ALT, t, x);
+}
+
+/*
+** Computes `nullable`, the set of first
+** characters and the first and last positions
+** of every node, numbering the leaves and
+** filling in the follow positions as it goes.
+*/
+static int mpc_re_analyse(mpc_re_node_t *n, int *positions, mpc_re_set_t *follow) {
+
+  int j;
+  mpc_re_node_t *a = n->a, *b = n->b;
+
+  if (a && !mpc_re_analyse(a, positions, follow)) { return 0; }
+  if (b && !mpc_re_analyse(b, positions, follow)) { return 0; }
+
+  switch (n->type) {
+
+    case MPC_RE_NODE_SET:
+      if (*positions == MPC_RE_DFA_POSITIONS_MAX) { return 0; }
+      n->position = (*positions)++;
+      n->nullable = 0;
+      n->first = n->set;
+      mpc_re_set_add(&n->pfirst, n->position);
+      mpc_re_set_add(&n->plast, n->position);
+      break;
+
+    case MPC_RE_NODE_EMPTY:
+      n->nullable = 1;
+      break;
+
+    case MPC_RE_NODE_CAT:
+      n->nullable = a->nullable && b->nullable;
+      n->first = a->first;
+      n->pfirst = a->pfirst;
+      if (a->nullable) {
+        mpc_re_set_union(&n->first, &b->first);
+        mpc_re_set_union(&n->pfirst, &b->pfirst);
+      }
+      n->plast = b->plast;
+      if (b->nullable) { mpc_re_set_union(&n->plast, &a->plast); }
+      for (j = 0; j < *positions; j++) {
+        if (mpc_re_set_has(&a->plast, j)) { mpc_re_set_union(&follow[j], &b->pfirst); }
+      }
+      break;
+
+    case MPC_RE_NODE_ALT:
+      n->nullable = a->nullable || b->nullable;
+      n->first = a->first;
+      mpc_re_set_union(&n->first, &b->first);
+      n->pfirst = a->pfirst;
+      mpc_re_set_union(&n->pfirst, &b->pfirst);
+      n->plast = a->plast;
+      mpc_re_set_union(&n->plast, &b->plast);
+      break;
+
+    case MPC_RE_NODE_STAR:
+    case MPC_RE_NODE_PLUS:
+    case MPC_RE_NODE_MAYBE:
+      n->nullable = n->type != MPC_RE_NODE_PLUS || a->nullable;
+      n->first = a->first;
+      n->pfirst = a->pfirst;
+      n->plast = a->plast;
+      if (n->type == MPC_RE_NODE_MAYBE) { break; }
+      for (j = 0; j < *positions; j++) {
+        if (mpc_re_set_has(&a->plast, j)) { mpc_re_set_union(&follow[j], &a->pfirst); }
+      }
+      break;
+  }
+
+  return 1;
+}
+
+/*
+** Checks that the combinators would never have
+** to choose differently from a longest match.
+** `follow` holds the characters which may come
+** right after `n`; nothing follows the whole
+** regex. Repetitions and optional parts must
+** not be able to match empty and must stop on
+** any character that can follow them, and the
+** alternatives of a choice must start with
+** different characters, where only the last one
+** may match empty.
+*/
+static int mpc_re_deterministic(mpc_re_node_t *n, const mpc_re_set_t *follow) {
+
+  mpc_re_set_t x;
+  mpc_re_node_t *a = n->a, *b = n->b;
+
+  switch (n->type) {
+
+    case MPC_RE_NODE_CAT:
+      x = b->first;
+      if (b->nullable) { mpc_re_set_union(&x, follow); }
+      return mpc_re_deterministic(a, &x) && mpc_re_deterministic(b, follow);
+
+    case MPC_RE_NODE_ALT:
+      if (a->nullable || !mpc_re_set_disjoint(&a->first, &b->first)) { return 0; }
+      if (b->nullable && !mpc_re_set_disjoint(&a->first, follow)) { return 0; }
+      return mpc_re_deterministic(a, follow) && mpc_re_deterministic(b, follow);
+
+    case MPC_RE_NODE_STAR:
+    case MPC_RE_NODE_PLUS:
+    case MPC_RE_NODE_MAYBE:
+      if (a->nullable || !mpc_re_set_disjoint(&a->first, follow)) { return 0; }
+      x = *follow;
+      if (n->type != MPC_RE_NODE_MAYBE) { mpc_re_set_union(&x, &a->first); }
+      return mpc_re_deterministic(a, &x);
+
+    default: return 1;
+  }
+}
+
+static void mpc_re_leaves(mpc_re_node_t *n, mpc_re_set_t *sets) {
+  if (n == NULL) { return; }
+  if (n->type == MPC_RE_NODE_SET) { sets[n->position] = n->set; }
+  mpc_re_leaves(n->a, sets);
+  mpc_re_leaves(n->b, sets);
+}
+
+/*
+** Subset construction over the positions. A
+** state is the set of positions matched by the
+** last character, the start state being the
+** empty set. Characters which no position tells
+** apart share a column of the table.
+*/
+static mpc_dfa_t *mpc_dfa_build(mpc_re_node_t *root, int positions, mpc_re_set_t *follow, const char *re) {
+
+  int c, j, k, s, t, slots;
+  mpc_re_set_t *sets, *states, next, signature[256];
+  mpc_dfa_t *d = calloc(1, sizeof(mpc_dfa_t));
+
+  sets = calloc(positions > 0 ? positions : 1, sizeof(mpc_re_set_t));
+  mpc_re_leaves(root, sets);
+
+  for (c = 0; c < 256; c++) {
+    memset(&signature[c], 0, sizeof(mpc_re_set_t));
+    for (j = 0; j < positions; j++) {
+      if (mpc_re_set_has(&sets[j], c)) { mpc_re_set_add(&signature[c], j); }
+    }
+    for (k = 0; k < c; k++) {
+      if (memcmp(&signature[k], &signature[c], sizeof(mpc_re_set_t)) == 0) { break; }
+    }
+    if (k < c) { d->class_of[c] = d->class_of[k]; }
+    else { d->class_of[c] = (unsigned char)d->classes++; }
+  }
+
+  slots = 16;
+  states = calloc(slots, sizeof(mpc_re_set_t));
+  d->next = malloc(sizeof(int) * slots * d->classes);
+  d->accept = malloc(slots);
+  d->states = 1;
+
+  for (s = 0; s < d->states; s++) {
+
+    d->accept[s] = s == 0
+      ? (char)root->nullable
+      : !mpc_re_set_disjoint(&states[s], &root->plast);
+
+    for (c = 0; c < 256; c++) {
+
+      /* One representative per class */
+      for (k = 0; k < c; k++) { if (d->class_of[k] == d->class_of[c]) { break; } }
+      if (k < c) { continue; }
+
+      memset(&next, 0, sizeof(next));
+      for (j = 0; j < positions; j++) {
+        if (!mpc_re_set_has(&sets[j], c)) { continue; }
+        if (s == 0) {
+          if (mpc_re_set_has(&root->pfirst, j)) { mpc_re_set_add(&next, j); }
+          continue;
+        }
+        for (k = 0; k < positions; k++) {
+          if (mpc_re_set_has(&states[s], k) && mpc_re_set_has(&follow[k], j)) {
+            mpc_re_set_add(&next, j);
+            break;
+          }
+        }
+      }
+
+      t = -1;
+      for (k = 0; k < positions && t == -1; k++) {
+        if (mpc_re_set_has(&next, k)) { t = 0; }
+      }
+
+      if (t == 0) {
+        for (t = 1; t < d->states; t++) {
+          if (memcmp(&states[t], &next, sizeof(next)) == 0) { break; }
+        }
+        if (t == d->states) {
+          if (d->states == MPC_RE_DFA_STATES_MAX) {
+            free(sets); free(states); mpc_dfa_delete(d);
+            return NULL;
+          }
+          if (d->states == slots) {
+            slots *= 2;
+            states = realloc(states, sizeof(mpc_re_set_t) * slots);
+            d->next = realloc(d->next, sizeof(int) * slots * d->classes);
+            d->accept = realloc(d->accept, slots);
+          }
+          states[d->states++] = next;
+        }
+      }
+
+      d->next[s * d->classes + d->class_of[c]] = t;
+    }
+  }
+
+  d->expected = malloc(strlen(re) + 3);
+  sprintf(d->expected, "/%s/", re);
+
+  free(sets);
+  free(states);
+  return d;
+}
+
+static mpc_dfa_t *mpc_dfa_compile(const char *re, int mode) {
+
+  int positions = 0;
+  mpc_re_set_t none;
+  mpc_re_set_t *follow;
+  mpc_re_node_t *root;
+  mpc_re_reader_t r;
+  mpc_dfa_t *d = NULL;
+
+  r.s = re;
+  r.mode = mode;
+  root = mpc_re_read_regex(&r);
+  if (root == NULL) { return NULL; }
+  if (r.s[0] != '\0') { mpc_re_node_delete(root); return NULL; }
+
+  memset(&none, 0, sizeof(none));
+  follow = calloc(MPC_RE_DFA_POSITIONS_MAX, sizeof(mpc_re_set_t));
+
+  if (mpc_re_analyse(root, &positions, follow)
+  &&  mpc_re_deterministic(root, &none)) {
+    d = mpc_dfa_build(root, positions, follow, re);
+  }
+
+  free(follow);
+  mpc_re_node_delete(root);
+  return d;
+}
+
 mpc_parser_t *mpc_re(const char *re) {
   return mpc_re_mode(re, MPC_RE_DEFAULT);
 }
 
+/*
+** A word followed by a boundary, such as /if\b/ for a keyword, is reported
+** by its word in errors rather than by its first character.
+*/
+static mpc_parser_t *mpc_re_keyword(const char *re) {
+
+  size_t n = 0;
+  char *word;
+  mpc_parser_t *p;
+
+  while (isalnum((unsigned char)re[n]) || re[n] == '_') { n++; }
+  if (n == 0 || strcmp(re + n, "\\b") != 0) { return NULL; }
+
+  word = malloc(n + 1);
+  memcpy(word, re, n);
+  word[n] = '\0';
+  p = mpc_expectf(mpc_and(2, mpcf_fst_free, mpc_string(word), mpc_boundary(), free), "\"%s\"", word);
+  free(word);
+  return p;
+}
+
 mpc_parser_t *mpc_re_mode(const char *re, int mode) {
 
   char *err_msg;
   mpc_parser_t *err_out;
   mpc_result_t r;
   mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose;
+  mpc_parser_t *p;
+  mpc_dfa_t *d;
+
+  if (!(mode & MPC_RE_NO_DFA) && (d = mpc_dfa_compile(re, mode)) != NULL) {
+    p = mpc_undefined();
+    p->type = MPC_TYPE_DFA;
+    p->data.dfa.x = d;
+    return p;
+  }
+
+  if ((p = mpc_re_keyword(re)) != NULL) { return p; }
 
   Regex  = mpc_new("regex");
   Term   = mpc_new("term");
@@ -2806,6 +4013,8 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
     free(s);
   }
 
+  if (p->type == MPC_TYPE_DFA) { printf("%s", p->data.dfa.x->expected); }
+
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
@@ -2932,28 +4141,43 @@ int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
 ** AST
 */
 
+static void mpc_ast_delete_no_children(mpc_ast_t *a) {
+  free(a->children);
+  free(a->tag);
+  free(a->contents);
+  free(a);
+}
+
+/*
+** Deletes the tree on an explicit stack of pending nodes rather than by
+** recursion, so arbitrarily deep trees cannot overflow the C stack.
+*/
 void mpc_ast_delete(mpc_ast_t *a) {
 
-  int i;
+  int i, num, max;
+  mpc_ast_t **pending;
 
   if (a == NULL) { return; }
 
-  for (i = 0; i < a->children_num; i++) {
-    mpc_ast_delete(a->children[i]);
-  }
+  max = 64;
+  pending = malloc(sizeof(mpc_ast_t*) * max);
+  pending[0] = a;
+  num = 1;
 
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
+  while (num > 0) {
+    a = pending[--num];
+    if (num + a->children_num > max) {
+      while (num + a->children_num > max) { max *= 2; }
+      pending = realloc(pending, sizeof(mpc_ast_t*) * max);
+    }
+    for (i = 0; i < a->children_num; i++) {
+      pending[num++] = a->children[i];
+    }
+    mpc_ast_delete_no_children(a);
+  }
 
-}
+  free(pending);
 
-static void mpc_ast_delete_no_children(mpc_ast_t *a) {
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
 }
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
@@ -4123,4 +5347,4 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
 
 void mpc_optimise(mpc_parser_t *p) {
   mpc_optimise_unretained(p, 1);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,250 @@
+#ifndef nemo_rt_h
+#define nemo_rt_h
+
+/*
+** Runtime of Nemo programs compiled to C with `nemo --emit-c`.
+**
+** Values are passed by value. Strings and collections are never modified
+** after they are built, so they are reference counted and copying a value
+** only bumps the count. A function taking a nemo_rt_value_t takes over the
+** caller's reference unless documented as borrowing it, and returned
+** values belong to the caller, as with NemoTypes moved through a pipeline.
+**
+** Builtins and operators behave as in the interpreter: an error is printed
+** to stdout and gives None, and mixing operand types ends the program.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  NEMO_RT_UNBOUND, /* a global that was never assigned */
+  NEMO_RT_VOID,
+  NEMO_RT_NUMBER,
+  NEMO_RT_CHAR,
+  NEMO_RT_STRING,
+  NEMO_RT_COLLECTION,
+  NEMO_RT_LAMBDA
+} nemo_rt_kind_t;
+
+typedef struct nemo_rt_string_t nemo_rt_string_t;
+typedef struct nemo_rt_collection_t nemo_rt_collection_t;
+typedef struct nemo_rt_lambda_t nemo_rt_lambda_t;
+typedef struct nemo_rt_tail_t nemo_rt_tail_t;
+
+typedef struct {
+  nemo_rt_kind_t kind;
+  union {
+    int32_t number;
+    char character;
+    nemo_rt_string_t *string;
+    nemo_rt_collection_t *collection;
+    const nemo_rt_lambda_t *lambda;
+  } as;
+} nemo_rt_value_t;
+
+struct nemo_rt_string_t {
+  size_t refs;
+  size_t size;
+  char data[];
+};
+
+struct nemo_rt_collection_t {
+  size_t refs;
+  size_t size;
+  nemo_rt_value_t values[];
+};
+
+/*
+** A compiled lambda. body binds argument to the parameters and runs the
+** statements. A call in tail position is not made by body: it stores the
+** callee and argument in tail and returns, and nemo_rt_call runs it, so
+** tail recursion runs in constant stack. source is printed for the value.
+*/
+typedef nemo_rt_value_t (*nemo_rt_body_t)(nemo_rt_value_t argument,
+                                          nemo_rt_tail_t *tail);
+
+struct nemo_rt_lambda_t {
+  nemo_rt_body_t body;
+  const char *source;
+};
+
+struct nemo_rt_tail_t {
+  const nemo_rt_lambda_t *callee;
+  nemo_rt_value_t argument;
+};
+
+#define NEMO_RT_VOID_INIT {NEMO_RT_VOID, {0}}
+
+/* Sets up buffered output. Called first by a compiled main. */
+void nemo_rt_init(void);
+
+void nemo_rt_free(nemo_rt_value_t value);
+
+static inline nemo_rt_value_t nemo_rt_void(void) {
+  nemo_rt_value_t value = NEMO_RT_VOID_INIT;
+  return value;
+}
+
+static inline nemo_rt_value_t nemo_rt_number(int32_t number) {
+  nemo_rt_value_t value;
+  value.kind = NEMO_RT_NUMBER;
+  value.as.number = number;
+  return value;
+}
+
+static inline nemo_rt_value_t nemo_rt_char(char character) {
+  nemo_rt_value_t value;
+  value.kind = NEMO_RT_CHAR;
+  value.as.character = character;
+  return value;
+}
+
+static inline nemo_rt_value_t nemo_rt_lambda(const nemo_rt_lambda_t *lambda) {
+  nemo_rt_value_t value;
+  value.kind = NEMO_RT_LAMBDA;
+  value.as.lambda = lambda;
+  return value;
+}
+
+/* A new reference to a borrowed value. */
+static inline nemo_rt_value_t nemo_rt_retain(nemo_rt_value_t value) {
+  if (value.kind == NEMO_RT_STRING) {
+    value.as.string->refs++;
+  } else if (value.kind == NEMO_RT_COLLECTION) {
+    value.as.collection->refs++;
+  }
+  return value;
+}
+
+static inline void nemo_rt_release(nemo_rt_value_t value) {
+  if ((value.kind == NEMO_RT_STRING && --value.as.string->refs == 0) ||
+      (value.kind == NEMO_RT_COLLECTION && --value.as.collection->refs == 0)) {
+    nemo_rt_free(value);
+  }
+}
+
+/* Stores value in a variable, releasing what it held. */
+static inline void nemo_rt_assign(nemo_rt_value_t *variable,
+                                  nemo_rt_value_t value) {
+  nemo_rt_release(*variable);
+  *variable = value;
+}
+
+nemo_rt_value_t nemo_rt_string(const char *data, size_t size);
+/* Takes over the count values. */
+nemo_rt_value_t nemo_rt_collection(size_t count, const nemo_rt_value_t *values);
+
+/* Reads a borrowed global, reporting one that was never assigned. */
+nemo_rt_value_t nemo_rt_global(nemo_rt_value_t global);
+/* Prints message as a failed expression does and gives None. */
+nemo_rt_value_t nemo_rt_error(const char *message);
+
+/*
+** Stages replace the running result of a pipeline in place, taking over the
+** value it held.
+**
+** Operators: numbers take the inline path; anything else goes through
+** nemo_rt_operator. Comparisons give the number 1 or 0.
+*/
+typedef enum {
+  NEMO_RT_ADD,
+  NEMO_RT_SUB,
+  NEMO_RT_MUL,
+  NEMO_RT_DIV,
+  NEMO_RT_MOD,
+  NEMO_RT_LT,
+  NEMO_RT_LE,
+  NEMO_RT_EQ,
+  NEMO_RT_GE,
+  NEMO_RT_GT
+} nemo_rt_op_t;
+
+void nemo_rt_operator(nemo_rt_op_t op, nemo_rt_value_t *a, nemo_rt_value_t b);
+
+/* Prints the error the interpreter prints for a zero divisor and exits. */
+_Noreturn void nemo_rt_division_by_zero(void);
+
+/* The smallest number divided by -1 wraps to itself, with a remainder of 0. */
+static inline int32_t nemo_rt_divide(int32_t x, int32_t y) {
+  if (y == 0) {
+    nemo_rt_division_by_zero();
+  }
+  return y == -1 ? (int32_t)(0u - (uint32_t)x) : x / y;
+}
+
+static inline int32_t nemo_rt_remainder(int32_t x, int32_t y) {
+  if (y == 0) {
+    nemo_rt_division_by_zero();
+  }
+  return y == -1 ? 0 : x % y;
+}
+
+/* x and y are the operands as uint32_t, for arithmetic that wraps. */
+#define NEMO_RT_BINARY(name, op, expression)                                  \
+  static inline void name(nemo_rt_value_t *a, nemo_rt_value_t b) {            \
+    if (a->kind == NEMO_RT_NUMBER && b.kind == NEMO_RT_NUMBER) {              \
+      const uint32_t x = (uint32_t)a->as.number;                              \
+      const uint32_t y = (uint32_t)b.as.number;                               \
+      (void)x;                                                                \
+      (void)y;                                                                \
+      a->as.number = expression;                                              \
+    } else {                                                                  \
+      nemo_rt_operator(op, a, b);                                             \
+    }                                                                         \
+  }
+
+NEMO_RT_BINARY(nemo_rt_add, NEMO_RT_ADD, (int32_t)(x + y))
+NEMO_RT_BINARY(nemo_rt_sub, NEMO_RT_SUB, (int32_t)(x - y))
+NEMO_RT_BINARY(nemo_rt_mul, NEMO_RT_MUL, (int32_t)(x * y))
+NEMO_RT_BINARY(nemo_rt_div, NEMO_RT_DIV,
+               nemo_rt_divide(a->as.number, b.as.number))
+NEMO_RT_BINARY(nemo_rt_mod, NEMO_RT_MOD,
+               nemo_rt_remainder(a->as.number, b.as.number))
+NEMO_RT_BINARY(nemo_rt_lt, NEMO_RT_LT, a->as.number < b.as.number)
+NEMO_RT_BINARY(nemo_rt_le, NEMO_RT_LE, a->as.number <= b.as.number)
+NEMO_RT_BINARY(nemo_rt_eq, NEMO_RT_EQ, a->as.number == b.as.number)
+NEMO_RT_BINARY(nemo_rt_ge, NEMO_RT_GE, a->as.number >= b.as.number)
+NEMO_RT_BINARY(nemo_rt_gt, NEMO_RT_GT, a->as.number > b.as.number)
+
+#undef NEMO_RT_BINARY
+
+/*
+** Calls. The callee of nemo_rt_apply and nemo_rt_tail_call is borrowed and
+** is "Function not found" unless it is a lambda. nemo_rt_bind binds the
+** argument of a lambda with arity parameters to its first locals; with
+** several parameters it must be a collection of as many values.
+*/
+void nemo_rt_call(nemo_rt_value_t *value, const nemo_rt_lambda_t *lambda);
+void nemo_rt_apply(nemo_rt_value_t *value, const nemo_rt_value_t *callee);
+nemo_rt_value_t nemo_rt_tail_call(nemo_rt_tail_t *tail,
+                                  const nemo_rt_value_t *callee,
+                                  nemo_rt_value_t argument);
+int nemo_rt_bind(nemo_rt_value_t argument, size_t arity,
+                 nemo_rt_value_t *locals);
+void nemo_rt_not_found(nemo_rt_value_t *value);
+void nemo_rt_field(nemo_rt_value_t *value, const char *name);
+
+/*
+** Control flow. nemo_rt_test takes over the condition of an if or loop and
+** tells whether it holds: it is a nonzero number; anything else prints an
+** error and does not hold. nemo_rt_matches borrows both values and tells
+** whether a match subject equals a pattern, values of different types
+** being different.
+*/
+int nemo_rt_test(nemo_rt_value_t condition);
+int nemo_rt_matches(nemo_rt_value_t value, nemo_rt_value_t pattern);
+
+/* Builtins. */
+void nemo_rt_print(nemo_rt_value_t *value);
+void nemo_rt_println(nemo_rt_value_t *value);
+/* println without arguments, at the head of a pipeline. */
+nemo_rt_value_t nemo_rt_newline(void);
+void nemo_rt_exit(nemo_rt_value_t *code);
+void nemo_rt_len(nemo_rt_value_t *value);
+void nemo_rt_sum(nemo_rt_value_t *value);
+void nemo_rt_to_string(nemo_rt_value_t *value);
+void nemo_rt_join(nemo_rt_value_t *value);
+void nemo_rt_range(nemo_rt_value_t *bounds);
+
+#endif
@@ -0,0 +1,500 @@
+#include "runtime/nemo_rt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Messages match those of the interpreter so that a compiled program prints
+** exactly what the interpreted one does. */
+
+static void *allocate(size_t size) {
+  void *block = malloc(size);
+  if (block == NULL) {
+    fputs("Out of memory\n", stderr);
+    abort();
+  }
+  return block;
+}
+
+static const char *type_name(nemo_rt_kind_t kind) {
+  switch (kind) {
+  case NEMO_RT_NUMBER:
+    return "int";
+  case NEMO_RT_CHAR:
+    return "char";
+  case NEMO_RT_STRING:
+    return "string";
+  case NEMO_RT_COLLECTION:
+    return "collection";
+  case NEMO_RT_LAMBDA:
+    return "lambda";
+  case NEMO_RT_VOID:
+    return "void";
+  default:
+    return "unknown";
+  }
+}
+
+/* Prints an error and gives None in place of the failed stage. */
+static void fail(nemo_rt_value_t *value, const char *message) {
+  nemo_rt_release(*value);
+  *value = nemo_rt_void();
+  fputs(message, stdout);
+  fputc('\n', stdout);
+}
+
+static void type_error(nemo_rt_value_t *value, const char *builtin,
+                       const char *expected) {
+  printf("%s function takes %s argument, but got %s\n", builtin, expected,
+         type_name(value->kind));
+  nemo_rt_release(*value);
+  *value = nemo_rt_void();
+}
+
+static nemo_rt_string_t *new_string(size_t size) {
+  nemo_rt_string_t *string = allocate(sizeof(nemo_rt_string_t) + size + 1);
+  string->refs = 1;
+  string->size = size;
+  string->data[size] = '\0';
+  return string;
+}
+
+static nemo_rt_collection_t *new_collection(size_t size) {
+  nemo_rt_collection_t *collection =
+      allocate(sizeof(nemo_rt_collection_t) + size * sizeof(nemo_rt_value_t));
+  collection->refs = 1;
+  collection->size = size;
+  return collection;
+}
+
+static nemo_rt_value_t string_value(nemo_rt_string_t *string) {
+  nemo_rt_value_t value;
+  value.kind = NEMO_RT_STRING;
+  value.as.string = string;
+  return value;
+}
+
+static nemo_rt_value_t collection_value(nemo_rt_collection_t *collection) {
+  nemo_rt_value_t value;
+  value.kind = NEMO_RT_COLLECTION;
+  value.as.collection = collection;
+  return value;
+}
+
+void nemo_rt_init(void) { setvbuf(stdout, NULL, _IOFBF, 1 << 16); }
+
+void nemo_rt_free(nemo_rt_value_t value) {
+  if (value.kind == NEMO_RT_COLLECTION) {
+    nemo_rt_collection_t *collection = value.as.collection;
+    for (size_t i = 0; i < collection->size; i++) {
+      nemo_rt_release(collection->values[i]);
+    }
+    free(collection);
+  } else if (value.kind == NEMO_RT_STRING) {
+    free(value.as.string);
+  }
+}
+
+nemo_rt_value_t nemo_rt_string(const char *data, size_t size) {
+  nemo_rt_string_t *string = new_string(size);
+  memcpy(string->data, data, size);
+  return string_value(string);
+}
+
+nemo_rt_value_t nemo_rt_collection(size_t count,
+                                   const nemo_rt_value_t *values) {
+  nemo_rt_collection_t *collection = new_collection(count);
+  if (count > 0) {
+    memcpy(collection->values, values, count * sizeof(nemo_rt_value_t));
+  }
+  return collection_value(collection);
+}
+
+nemo_rt_value_t nemo_rt_global(nemo_rt_value_t global) {
+  if (global.kind == NEMO_RT_UNBOUND) {
+    return nemo_rt_error("Variable not found");
+  }
+  return nemo_rt_retain(global);
+}
+
+nemo_rt_value_t nemo_rt_error(const char *message) {
+  nemo_rt_value_t value = nemo_rt_void();
+  fail(&value, message);
+  return value;
+}
+
+static nemo_rt_value_t concat(nemo_rt_value_t a, nemo_rt_value_t b) {
+  if (a.kind == NEMO_RT_STRING) {
+    const nemo_rt_string_t *x = a.as.string;
+    const nemo_rt_string_t *y = b.as.string;
+    nemo_rt_string_t *string = new_string(x->size + y->size);
+    memcpy(string->data, x->data, x->size);
+    memcpy(string->data + x->size, y->data, y->size);
+    return string_value(string);
+  }
+
+  const nemo_rt_collection_t *x = a.as.collection;
+  const nemo_rt_collection_t *y = b.as.collection;
+  nemo_rt_collection_t *collection = new_collection(x->size + y->size);
+  for (size_t i = 0; i < x->size; i++) {
+    collection->values[i] = nemo_rt_retain(x->values[i]);
+  }
+  for (size_t i = 0; i < y->size; i++) {
+    collection->values[x->size + i] = nemo_rt_retain(y->values[i]);
+  }
+  return collection_value(collection);
+}
+
+static int32_t compare(nemo_rt_op_t op, int32_t x, int32_t y) {
+  switch (op) {
+  case NEMO_RT_LT:
+    return x < y;
+  case NEMO_RT_LE:
+    return x <= y;
+  case NEMO_RT_EQ:
+    return x == y;
+  case NEMO_RT_GE:
+    return x >= y;
+  default:
+    return x > y;
+  }
+}
+
+/* Orders strings bytewise, shorter first on a common prefix. */
+static int32_t order(const nemo_rt_string_t *x, const nemo_rt_string_t *y) {
+  const size_t size = x->size < y->size ? x->size : y->size;
+  const int result = memcmp(x->data, y->data, size);
+  if (result != 0) {
+    return result < 0 ? -1 : 1;
+  }
+  return x->size < y->size ? -1 : x->size > y->size ? 1 : 0;
+}
+
+static int equal(nemo_rt_value_t a, nemo_rt_value_t b) {
+  if (a.kind != b.kind) {
+    return 0;
+  }
+  switch (a.kind) {
+  case NEMO_RT_NUMBER:
+    return a.as.number == b.as.number;
+  case NEMO_RT_CHAR:
+    return a.as.character == b.as.character;
+  case NEMO_RT_STRING:
+    return order(a.as.string, b.as.string) == 0;
+  case NEMO_RT_LAMBDA:
+    return a.as.lambda == b.as.lambda;
+  case NEMO_RT_COLLECTION:
+    if (a.as.collection->size != b.as.collection->size) {
+      return 0;
+    }
+    for (size_t i = 0; i < a.as.collection->size; i++) {
+      if (!equal(a.as.collection->values[i], b.as.collection->values[i])) {
+        return 0;
+      }
+    }
+    return 1;
+  default:
+    return 1;
+  }
+}
+
+void nemo_rt_division_by_zero(void) {
+  printf("Division by zero\n");
+  exit(0);
+}
+
+void nemo_rt_operator(nemo_rt_op_t op, nemo_rt_value_t *a, nemo_rt_value_t b) {
+  if (a->kind != b.kind) {
+    printf("Operator types should be equal but got types%s and %s\n",
+           type_name(a->kind), type_name(b.kind));
+    exit(0);
+  }
+
+  nemo_rt_value_t result = nemo_rt_void();
+  if (a->kind == NEMO_RT_NUMBER || a->kind == NEMO_RT_CHAR) {
+    const int32_t x =
+        a->kind == NEMO_RT_NUMBER ? a->as.number : a->as.character;
+    const int32_t y = b.kind == NEMO_RT_NUMBER ? b.as.number : b.as.character;
+    int32_t value = 0;
+    switch (op) {
+    case NEMO_RT_ADD:
+      value = (int32_t)((uint32_t)x + (uint32_t)y);
+      break;
+    case NEMO_RT_SUB:
+      value = (int32_t)((uint32_t)x - (uint32_t)y);
+      break;
+    case NEMO_RT_MUL:
+      value = (int32_t)((uint32_t)x * (uint32_t)y);
+      break;
+    case NEMO_RT_DIV:
+      value = nemo_rt_divide(x, y);
+      break;
+    case NEMO_RT_MOD:
+      value = nemo_rt_remainder(x, y);
+      break;
+    default:
+      *a = nemo_rt_number(compare(op, x, y));
+      return;
+    }
+    *a = a->kind == NEMO_RT_NUMBER ? nemo_rt_number(value)
+                                   : nemo_rt_char((char)value);
+    return;
+  }
+
+  if (op == NEMO_RT_EQ) {
+    result = nemo_rt_number(equal(*a, b));
+  } else if (a->kind == NEMO_RT_STRING && op >= NEMO_RT_LT) {
+    result = nemo_rt_number(compare(op, order(a->as.string, b.as.string), 0));
+  } else if ((a->kind == NEMO_RT_STRING || a->kind == NEMO_RT_COLLECTION) &&
+             op == NEMO_RT_ADD) {
+    result = concat(*a, b);
+  }
+
+  nemo_rt_release(*a);
+  nemo_rt_release(b);
+  *a = result;
+}
+
+int nemo_rt_test(nemo_rt_value_t condition) {
+  if (condition.kind == NEMO_RT_NUMBER) {
+    return condition.as.number != 0;
+  }
+  printf("Condition should be a number, but got %s\n",
+         type_name(condition.kind));
+  nemo_rt_release(condition);
+  return 0;
+}
+
+int nemo_rt_matches(nemo_rt_value_t value, nemo_rt_value_t pattern) {
+  return equal(value, pattern);
+}
+
+void nemo_rt_call(nemo_rt_value_t *value, const nemo_rt_lambda_t *lambda) {
+  nemo_rt_tail_t tail;
+  tail.callee = lambda;
+  tail.argument = *value;
+  do {
+    lambda = tail.callee;
+    tail.callee = NULL;
+    *value = lambda->body(tail.argument, &tail);
+  } while (tail.callee != NULL);
+}
+
+void nemo_rt_apply(nemo_rt_value_t *value, const nemo_rt_value_t *callee) {
+  if (callee->kind != NEMO_RT_LAMBDA) {
+    nemo_rt_not_found(value);
+    return;
+  }
+  nemo_rt_call(value, callee->as.lambda);
+}
+
+nemo_rt_value_t nemo_rt_tail_call(nemo_rt_tail_t *tail,
+                                  const nemo_rt_value_t *callee,
+                                  nemo_rt_value_t argument) {
+  if (callee->kind != NEMO_RT_LAMBDA) {
+    nemo_rt_not_found(&argument);
+    return argument;
+  }
+  tail->callee = callee->as.lambda;
+  tail->argument = argument;
+  return nemo_rt_void();
+}
+
+int nemo_rt_bind(nemo_rt_value_t argument, size_t arity,
+                 nemo_rt_value_t *locals) {
+  if (arity == 1) {
+    locals[0] = argument;
+    return 1;
+  }
+  if (arity > 1 && (argument.kind != NEMO_RT_COLLECTION ||
+                    argument.as.collection->size != arity)) {
+    printf("lambda takes a collection of %zu arguments, but got %s\n", arity,
+           type_name(argument.kind));
+    nemo_rt_release(argument);
+    return 0;
+  }
+  for (size_t i = 0; i < arity; i++) {
+    locals[i] = nemo_rt_retain(argument.as.collection->values[i]);
+  }
+  nemo_rt_release(argument);
+  return 1;
+}
+
+void nemo_rt_not_found(nemo_rt_value_t *value) {
+  fail(value, "Function not found");
+}
+
+void nemo_rt_field(nemo_rt_value_t *value, const char *name) {
+  printf("Field .%s needs a record, but got %s\n", name,
+         type_name(value->kind));
+  nemo_rt_release(*value);
+  *value = nemo_rt_void();
+}
+
+static void print(nemo_rt_value_t value) {
+  switch (value.kind) {
+  case NEMO_RT_VOID:
+    fputs("None", stdout);
+    break;
+  case NEMO_RT_NUMBER:
+    printf("%d", (int)value.as.number);
+    break;
+  case NEMO_RT_CHAR:
+    fputc(value.as.character, stdout);
+    break;
+  case NEMO_RT_STRING:
+    fwrite(value.as.string->data, 1, value.as.string->size, stdout);
+    break;
+  case NEMO_RT_COLLECTION:
+    fputs("[ ", stdout);
+    for (size_t i = 0; i < value.as.collection->size; i++) {
+      print(value.as.collection->values[i]);
+      fputc(' ', stdout);
+    }
+    fputc(']', stdout);
+    break;
+  case NEMO_RT_LAMBDA:
+    fputs(value.as.lambda->source, stdout);
+    break;
+  default:
+    fputs("Not implemeneted", stdout);
+  }
+}
+
+void nemo_rt_print(nemo_rt_value_t *value) {
+  print(*value);
+  nemo_rt_release(*value);
+  *value = nemo_rt_void();
+}
+
+void nemo_rt_println(nemo_rt_value_t *value) {
+  nemo_rt_print(value);
+  *value = nemo_rt_newline();
+}
+
+nemo_rt_value_t nemo_rt_newline(void) {
+  fputc('\n', stdout);
+  return nemo_rt_void();
+}
+
+void nemo_rt_exit(nemo_rt_value_t *code) {
+  if (code->kind != NEMO_RT_NUMBER) {
+    type_error(code, "exit", "an integer");
+    return;
+  }
+  exit(code->as.number);
+}
+
+void nemo_rt_len(nemo_rt_value_t *value) {
+  size_t size = 0;
+  if (value->kind == NEMO_RT_COLLECTION) {
+    size = value->as.collection->size;
+  } else if (value->kind == NEMO_RT_STRING) {
+    size = value->as.string->size;
+  } else {
+    type_error(value, "len", "a collection or string");
+    return;
+  }
+  nemo_rt_release(*value);
+  *value = nemo_rt_number((int32_t)size);
+}
+
+void nemo_rt_sum(nemo_rt_value_t *value) {
+  if (value->kind != NEMO_RT_COLLECTION) {
+    type_error(value, "sum", "a collection");
+    return;
+  }
+
+  uint32_t sum = 0;
+  const nemo_rt_collection_t *collection = value->as.collection;
+  for (size_t i = 0; i < collection->size; i++) {
+    if (collection->values[i].kind != NEMO_RT_NUMBER) {
+      /* The interpreter reports the failed std::get. */
+      fail(value, "std::get: wrong index for variant");
+      return;
+    }
+    sum += (uint32_t)collection->values[i].as.number;
+  }
+  nemo_rt_release(*value);
+  *value = nemo_rt_number((int32_t)sum);
+}
+
+void nemo_rt_to_string(nemo_rt_value_t *value) {
+  char digits[16];
+  switch (value->kind) {
+  case NEMO_RT_NUMBER:
+    *value = nemo_rt_string(digits,
+                            (size_t)snprintf(digits, sizeof(digits), "%d",
+                                             (int)value->as.number));
+    break;
+  case NEMO_RT_CHAR:
+    *value = nemo_rt_string(&value->as.character, 1);
+    break;
+  case NEMO_RT_STRING:
+    break;
+  default:
+    nemo_rt_release(*value);
+    *value = nemo_rt_void();
+  }
+}
+
+void nemo_rt_join(nemo_rt_value_t *value) {
+  if (value->kind != NEMO_RT_COLLECTION) {
+    type_error(value, "join", "a collection");
+    return;
+  }
+
+  const nemo_rt_collection_t *collection = value->as.collection;
+  nemo_rt_string_t *string = new_string(collection->size);
+  for (size_t i = 0; i < collection->size; i++) {
+    if (collection->values[i].kind != NEMO_RT_CHAR) {
+      free(string);
+      fail(value, "std::get: wrong index for variant");
+      return;
+    }
+    string->data[i] = collection->values[i].as.character;
+  }
+  nemo_rt_release(*value);
+  *value = string_value(string);
+}
+
+void nemo_rt_range(nemo_rt_value_t *bounds) {
+  if (bounds->kind != NEMO_RT_COLLECTION) {
+    type_error(bounds, "range", "a collection");
+    return;
+  }
+
+  const nemo_rt_collection_t *collection = bounds->as.collection;
+  if (collection->size == 0 || collection->size > 3) {
+    fail(bounds, "range function takes a collection of size 1, 2 or 3");
+    return;
+  }
+  for (size_t i = 0; i < collection->size; i++) {
+    if (collection->values[i].kind != NEMO_RT_NUMBER) {
+      fail(bounds, "range function takes a collection of integers");
+      return;
+    }
+  }
+
+  int32_t start = 0;
+  int32_t end = collection->values[0].as.number;
+  int32_t step = 1;
+  if (collection->size > 1) {
+    start = collection->values[0].as.number;
+    end = collection->values[1].as.number;
+    if (collection->size == 3) {
+      step = collection->values[2].as.number;
+    }
+  }
+  nemo_rt_release(*bounds);
+
+  size_t count = 0;
+  if (start < end && step > 0) {
+    count = (size_t)(((int64_t)end - start + step - 1) / step);
+  }
+  nemo_rt_collection_t *range = new_collection(count);
+  for (size_t i = 0; i < count; i++) {
+    range->values[i] = nemo_rt_number((int32_t)(start + (int64_t)i * step));
+  }
+  *bounds = collection_value(range);
+}
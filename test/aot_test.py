@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Compiles scripts with nemo --emit-c and the C compiler, and checks that
+each executable prints what the interpreter prints and exits the same way.
+
+usage: aot_test.py NEMO RUNTIME_INCLUDE RUNTIME_LIB SCRIPT... -- CC...
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def run(command):
+    return subprocess.run(command, capture_output=True, text=True)
+
+
+def check(nemo, include, runtime, compiler, script, directory):
+    name = os.path.splitext(os.path.basename(script))[0]
+    source = os.path.join(directory, name + ".c")
+    executable = os.path.join(directory, name)
+
+    emitted = run([nemo, "--emit-c=" + source, script])
+    if emitted.returncode != 0:
+        return f"{script}: --emit-c failed\n{emitted.stderr}"
+    compiled = run(compiler + ["-O2", "-I", include, source, runtime,
+                               "-o", executable])
+    if compiled.returncode != 0:
+        return f"{script}: C compiler failed\n{compiled.stderr}"
+
+    expected = run([nemo, script])
+    actual = run([executable])
+    if (actual.stdout, actual.returncode) != (expected.stdout,
+                                              expected.returncode):
+        return (f"{script}: compiled program differs\n"
+                f"--- interpreter (exit {expected.returncode})\n"
+                f"{expected.stdout}"
+                f"--- compiled (exit {actual.returncode})\n"
+                f"{actual.stdout}")
+    return None
+
+
+def main():
+    separator = sys.argv.index("--")
+    nemo, include, runtime, *scripts = sys.argv[1:separator]
+    compiler = sys.argv[separator + 1:]
+
+    failures = []
+    with tempfile.TemporaryDirectory() as directory:
+        for script in scripts:
+            failure = check(nemo, include, runtime, compiler, script,
+                            directory)
+            if failure is not None:
+                failures.append(failure)
+
+    for failure in failures:
+        print(failure)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
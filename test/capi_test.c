@@ -0,0 +1,151 @@
+#include "interpreter/capi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Compiles one script, runs it against several borrowed host arrays and
+** checks results and zero-copy views through the C API. */
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void capture(void *user, const char *data, size_t size) {
+  strncat((char *)user, data, size);
+}
+
+/* Host function: scale takes a number and returns it multiplied by the
+** factor passed as user data. */
+static nemo_value_t *scale(nemo_vm_t *vm, nemo_value_t **args, size_t count,
+                           void *user) {
+  if (count != 1 || nemo_value_type(args[0]) != NEMO_NUMBER) {
+    nemo_raise(vm, "scale takes one number");
+    return NULL;
+  }
+  return nemo_number(vm, nemo_value_number(args[0]) * *(int *)user);
+}
+
+int main(void) {
+  static char output[4096];
+  int factor = 3;
+  int code = 0;
+  size_t count = 0;
+  nemo_vm_t *vm = nemo_vm_new(0);
+  CHECK(vm != NULL);
+  if (vm == NULL) {
+    return 1;
+  }
+  nemo_vm_set_output(vm, capture, output);
+  nemo_register(vm, "scale", scale, &factor);
+
+  /* Inputs are bound before compiling so the script resolves them as
+  ** globals. */
+  nemo_set_global(vm, "xs", nemo_number_array(vm, NULL, 0));
+  nemo_set_global(vm, "letters", nemo_char_array(vm, "", 0));
+
+  nemo_script_t *script =
+      nemo_compile(vm, "<capi>",
+                   "let total <= xs |> sum |> scale\n"
+                   "let word <= letters |> join\n"
+                   "let view <= xs\n"
+                   "word |> println\n");
+  CHECK(script != NULL);
+
+  for (int32_t n = 1; n <= 100; n++) {
+    int32_t numbers[100];
+    char letters[100];
+    for (int32_t i = 0; i < n; i++) {
+      numbers[i] = i + 1;
+      letters[i] = 'a' + i % 26;
+    }
+
+    nemo_set_global(vm, "xs", nemo_number_array(vm, numbers, n));
+    nemo_set_global(vm, "letters", nemo_char_array(vm, letters, n));
+    output[0] = '\0';
+    CHECK(nemo_run(vm, script));
+
+    nemo_value_t *total = nemo_get_global(vm, "total");
+    CHECK(nemo_value_type(total) == NEMO_NUMBER);
+    CHECK(nemo_value_number(total) == n * (n + 1) / 2 * factor);
+    nemo_value_delete(total);
+
+    /* The array global is the host buffer itself. */
+    nemo_value_t *view = nemo_get_global(vm, "view");
+    CHECK(nemo_value_type(view) == NEMO_NUMBER_ARRAY);
+    CHECK(nemo_value_numbers(view, &count) == numbers && count == (size_t)n);
+    nemo_value_delete(view);
+
+    /* Strings are read in place as well. */
+    size_t size = 0;
+    nemo_value_t *word = nemo_get_global(vm, "word");
+    const char *chars = nemo_value_chars(word, &size);
+    CHECK(chars != NULL && size == (size_t)n &&
+          memcmp(chars, letters, n) == 0);
+    CHECK(strlen(output) == (size_t)n + 1 && memcmp(output, letters, n) == 0);
+    nemo_value_delete(word);
+  }
+
+  /* Collections built by the script are copied into the handle once. */
+  nemo_script_t *range = nemo_compile(vm, "<capi>", "let r <= [2 6] |> range");
+  CHECK(range != NULL && nemo_run(vm, range));
+  nemo_value_t *r = nemo_get_global(vm, "r");
+  const int32_t *numbers = nemo_value_numbers(r, &count);
+  CHECK(numbers != NULL && count == 4 && numbers[0] == 2 && numbers[3] == 5);
+  CHECK(nemo_value_chars(r, &count) == NULL);
+  nemo_value_delete(r);
+
+  /* Host errors and exit stay inside the VM. */
+  output[0] = '\0';
+  nemo_script_t *bad = nemo_compile(vm, "<capi>", "\"x\" |> scale\n4 |> exit");
+  CHECK(bad != NULL && nemo_run(vm, bad));
+  CHECK(strstr(output, "scale takes one number") != NULL);
+  CHECK(nemo_exit_code(vm, &code) && code == 4);
+
+  CHECK(nemo_compile(vm, "<capi>", "let <= ") == NULL);
+
+  /* Runaway recursion fails the run instead of the host. */
+  output[0] = '\0';
+  nemo_script_t *deep = nemo_compile(
+      vm, "<capi>",
+      "let nt <= (n) -> { if n = 0 { 0 } else { n - 1 |> nt + 1 } }\n"
+      "1000000 |> nt |> println");
+  CHECK(deep != NULL && !nemo_run(vm, deep));
+  CHECK(strstr(output, "maximum call depth") != NULL);
+
+  /* So does source nested too deep to compile. */
+  output[0] = '\0';
+  const int depth = 100000;
+  char *nested = malloc(2 * depth + 16);
+  strcpy(nested, "let x <= ");
+  memset(nested + 9, '[', depth);
+  memset(nested + 9 + depth, ']', depth);
+  nested[9 + 2 * depth] = '\0';
+  CHECK(nemo_compile(vm, "<capi>", nested) == NULL);
+  CHECK(strstr(output, "Nesting deeper than") != NULL);
+  free(nested);
+
+  /* Syntax errors name the keywords an expression may start with. */
+  output[0] = '\0';
+  CHECK(nemo_compile(vm, "<capi>", "let x <= \n") == NULL);
+  CHECK(strstr(output, "\"if\", \"match\", \"while\"") != NULL);
+
+  /* Values outlive their VM. */
+  nemo_value_t *kept = nemo_get_global(vm, "r");
+  nemo_vm_delete(vm);
+  numbers = nemo_value_numbers(kept, &count);
+  CHECK(numbers != NULL && count == 4 && numbers[3] == 5);
+  nemo_value_delete(kept);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include "interpreter/instance.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Runs independent interpreters on many threads at once. Every instance must
+// produce exactly the output, exit code and memory accounting of the same
+// session run alone on the main thread.
+static const char *scripts[] = {
+    "let xs <= [2000] |> range\n"
+    "xs |> sum |> println\n"
+    "xs |> len |> println\n",
+
+    "let greeting <= \"Hello\" + \" \" + \"world\"\n"
+    "greeting |> println\n"
+    "greeting |> len |> to_string |> println\n",
+
+    "\"quiet\" |> shout |> println\n"
+    "[1 20 3] |> range |> println\n"
+    "let inc <= (x: number) -> { x + 1 }\n"
+    "inc |> println\n",
+
+    "[100000] |> range |> len |> println\n",
+
+    "\"bye\" |> println\n"
+    "3 |> exit\n"
+    "\"unreachable\" |> println\n",
+};
+
+struct Outcome {
+  std::string output;
+  std::vector<std::optional<int>> exitCodes;
+  nemo::memory::Usage total;
+};
+
+static Outcome runSession(size_t memoryLimit) {
+  Outcome outcome;
+  std::ostringstream output;
+  {
+    nemo::Interpreter interpreter(output, memoryLimit);
+    interpreter.registerNative<std::string(std::string_view)>(
+        "shout", [](std::string_view text) {
+          std::string loud(text);
+          for (auto &c : loud) {
+            c = toupper(c);
+          }
+          return loud;
+        });
+    for (const auto *script : scripts) {
+      interpreter.run("<stress>", script);
+      outcome.exitCodes.push_back(interpreter.exitCode());
+    }
+    outcome.total = interpreter.memory().total;
+  }
+  outcome.output = output.str();
+  return outcome;
+}
+
+// Values copied out of a session, and host values moved into one, are
+// released against the Accounting that allocated them, so both end up with
+// no live bytes. One copy is freed by another thread while the session runs.
+static bool releasesAcrossSessions() {
+  std::ostringstream output;
+  nemo::Interpreter interpreter(output);
+  interpreter.run("<host>", "let s <= \"longer than any inline string\"\n");
+  const auto live = interpreter.memory().total.live;
+  {
+    auto copy = interpreter.global("s");
+  }
+  std::thread freeing([copy = interpreter.global("s")]() mutable {
+    copy.reset();
+  });
+  interpreter.run("<host>", "let t <= \"s\" + \" and more\" |> len\n");
+  freeing.join();
+  const std::string_view host = "a host string of the same size";
+  interpreter.setGlobal("h", stringType(host));
+  interpreter.run("<host>", "let h <= 0\nlet s <= 0\n");
+  return live != 0 && interpreter.memory().total.live == 0 &&
+         nemo::memory::accounting.total.live == 0;
+}
+
+// Typed host functions may take and return integers wider than a Nemo
+// number; a result out of its range raises an error instead of truncating.
+static bool checksNativeRanges() {
+  std::ostringstream output;
+  nemo::Interpreter interpreter(output);
+  interpreter.registerNative<int64_t(int64_t)>(
+      "widen", [](int64_t x) { return x * 65536 * 65536; });
+  interpreter.run("<host>", "0 |> widen |> println\n1 |> widen |> println\n");
+  const auto text = output.str();
+  return text.starts_with("0\n") &&
+         text.find("widen function returned 4294967296") != std::string::npos;
+}
+
+static bool same(const Outcome &a, const Outcome &b) {
+  return a.output == b.output && a.exitCodes == b.exitCodes &&
+         a.total.live == b.total.live && a.total.peak == b.total.peak &&
+         a.total.allocated == b.total.allocated;
+}
+
+int main(int argc, char **argv) {
+  int threads = 8;
+  int rounds = 20;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--threads") == 0) {
+      threads = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--rounds") == 0) {
+      rounds = atoi(argv[i + 1]);
+    }
+  }
+
+  if (!releasesAcrossSessions()) {
+    std::cerr << "values were released against the wrong accounting"
+              << std::endl;
+    return 1;
+  }
+  if (!checksNativeRanges()) {
+    std::cerr << "a native result out of range was not reported" << std::endl;
+    return 1;
+  }
+
+  // One unlimited session and one whose limit stops the large range.
+  const size_t limits[] = {0, 64 * 1024};
+  Outcome expected[2];
+  for (int k = 0; k < 2; k++) {
+    expected[k] = runSession(limits[k]);
+  }
+  if (expected[0].output == expected[1].output) {
+    std::cerr << "memory limit had no effect" << std::endl;
+    return 1;
+  }
+
+  std::atomic<int> failures{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (int round = 0; round < rounds; round++) {
+        const int k = (t + round) % 2;
+        if (!same(runSession(limits[k]), expected[k])) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  if (failures > 0) {
+    std::cerr << failures << " of " << threads * rounds
+              << " sessions differed from the single-threaded run"
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << expected[0].output;
+  return 0;
+}